@@ -0,0 +1,409 @@
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "CLI11.hpp"
+
+#define ASIO_HAS_IO_URING 1
+#include "dpf.hpp"
+#include "grotto.hpp"
+
+static constexpr std::size_t L = 64;
+int32_t bitlength = L;
+
+using input_type = dpf::modint<L>;
+using output_type = dpf::modint<L>;
+
+output_type * scaled_lut;
+
+// range of signal bits (n) and LUT sizes (J) swept by this binary; as for
+// nillion, every (n, J) pair is a separate set of instantiations
+#ifndef WAVE_MIN_N
+#define WAVE_MIN_N 32
+#endif
+#ifndef WAVE_MAX_N
+#define WAVE_MAX_N 32
+#endif
+#ifndef WAVE_MIN_J
+#define WAVE_MIN_J 10
+#endif
+#ifndef WAVE_MAX_J
+#define WAVE_MAX_J 24
+#endif
+
+#include "Haar.hpp"
+#include "bior.hpp"
+
+/// Microbenchmarks for the kernels of the online and preprocessing phases.
+///
+/// Each benchmark runs its kernel in a loop, doubling the iteration count
+/// until one run takes at least `--min-time`, and reports that run's time
+/// per operation along with the bytes each operation produces or consumes
+/// (LUT bytes swept, key bytes generated or (de)serialized, and so on). The
+/// output is one CSV row or JSON object per (kernel, n, J, L).
+namespace bench
+{
+
+using clock = std::chrono::steady_clock;
+
+/// keeps the compiler from discarding `value` (or the work producing it)
+template <typename T>
+HEDLEY_ALWAYS_INLINE
+void do_not_optimize(const T & value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct options
+{
+    double min_time = 0.2;          ///< seconds per measured run
+    std::size_t min_J = WAVE_MIN_J;
+    std::size_t max_J = WAVE_MAX_J;
+    std::vector<std::size_t> dcf_bits = {16, 24, 32, 40, 48, 56, 64};
+    std::string filter;             ///< only kernels whose name contains this
+    bool json = false;
+};
+
+class reporter
+{
+  public:
+    explicit reporter(const options & opts) : opts_{opts}, first_{true}
+    {
+        if (opts_.json) std::cout << "[";
+        else std::cout << "kernel,n,J,L,iterations,ns_per_op,bytes_per_op\n";
+    }
+
+    ~reporter()
+    {
+        if (opts_.json) std::cout << "\n]\n";
+    }
+
+    bool wanted(const std::string & kernel) const
+    {
+        return kernel.find(opts_.filter) != std::string::npos;
+    }
+
+    /// times `op` and reports it as one row
+    template <typename Function>
+    void run(const std::string & kernel, std::size_t n, std::size_t J, std::size_t bits,
+        std::size_t bytes_per_op, Function && op)
+    {
+        if (!wanted(kernel)) return;
+        op();  // warm up caches and lazily selected kernels
+        std::size_t iterations = 1;
+        std::chrono::duration<double> elapsed;
+        for (;; iterations *= 2)
+        {
+            auto before = clock::now();
+            for (std::size_t i = 0; i < iterations; ++i) op();
+            elapsed = clock::now() - before;
+            if (elapsed.count() >= opts_.min_time) break;
+        }
+        double ns_per_op = elapsed.count() * 1e9 / iterations;
+
+        if (opts_.json)
+        {
+            std::cout << (first_ ? "\n" : ",\n") << "  {\"kernel\": \"" << kernel << "\", \"n\": " << n
+                      << ", \"J\": " << J << ", \"L\": " << bits << ", \"iterations\": " << iterations
+                      << ", \"ns_per_op\": " << ns_per_op << ", \"bytes_per_op\": " << bytes_per_op << "}";
+        }
+        else
+        {
+            std::cout << kernel << ',' << n << ',' << J << ',' << bits << ',' << iterations
+                      << ',' << ns_per_op << ',' << bytes_per_op << '\n';
+        }
+        std::cout.flush();
+        first_ = false;
+    }
+
+  private:
+    const options & opts_;
+    bool first_;
+};
+
+using dpf_type = DEDUCE_DPF_TYPE_T(dpf::wildcard_value<dpf::modint<L>>{});
+
+/// a freshly generated key pair whose wildcard input has been assigned, as
+/// it would be after the online phase's reveal
+struct assigned_dpfs
+{
+    std::shared_ptr<dpf_type> key0, key1;
+    dpf::modint<L> shifted_input;  ///< what `offset_x.reconstruct` returned
+};
+
+inline assigned_dpfs make_assigned_dpfs()
+{
+    auto [dpf0, dpf1] = dpf::make_dpf(dpf::wildcard_value<dpf::modint<L>>(dpf::uniform_sample<dpf::modint<L>>()));
+    auto key0 = std::make_shared<dpf_type>(std::move(dpf0)), key1 = std::make_shared<dpf_type>(std::move(dpf1));
+    auto [x0, x1] = dpf::additively_share(dpf::uniform_sample<dpf::modint<L>>());
+    auto blinded0 = key0->offset_x.compute_and_get_share(x0);
+    auto blinded1 = key1->offset_x.compute_and_get_share(x1);
+    auto shifted_input = key0->offset_x.reconstruct(blinded1);
+    key1->offset_x.reconstruct(blinded0);
+    return {key0, key1, shifted_input};
+}
+
+/// an `AsyncReadStream` over a byte vector, standing in for a dealer file
+class memory_read_stream
+{
+  public:
+    using executor_type = asio::io_context::executor_type;
+
+    memory_read_stream(asio::io_context & io_context, const std::vector<unsigned char> & data)
+      : executor_{io_context.get_executor()}, data_{data}, pos_{0} { }
+
+    executor_type get_executor() const noexcept { return executor_; }
+
+    void rewind() { pos_ = 0; }
+
+    template <typename MutableBufferSequence,
+              typename CompletionToken>
+    auto async_read_some(const MutableBufferSequence & buffers, CompletionToken && token)
+    {
+        return ::asio::async_initiate<CompletionToken, void(::asio::error_code, std::size_t)>(
+            [this, buffers](auto handler)
+            {
+                auto size = ::asio::buffer_copy(buffers, ::asio::buffer(data_.data() + pos_, data_.size() - pos_));
+                pos_ += size;
+                ::asio::error_code error = size ? ::asio::error_code{} : ::asio::error::eof;
+                ::asio::post(executor_, [h = std::move(handler), error, size]() mutable
+                {
+                    std::move(h)(error, size);
+                });
+            },
+            token);
+    }
+
+  private:
+    executor_type executor_;
+    const std::vector<unsigned char> & data_;
+    std::size_t pos_;
+};
+
+/// DCF key generation, evaluation and (de)serialization at `bits`-bit inputs
+template <std::size_t bits>
+void run_dcf(reporter & report)
+{
+    std::mt19937_64 rng{bits};
+    auto mask = bits == 64 ? ~std::uint64_t(0) : (std::uint64_t(1) << bits) - 1;
+
+    auto keys = keyGenDCF(bits, bits, GroupElement(rng() & mask, bits), GroupElement(1, bits));
+    // a packed key, as written by `async_make_dcf` or `append_dcf`
+    auto bytes = dcf_block_bytes(bits) + dcf_value_bytes(bits);
+
+    report.run("dcf_keygen", 0, 0, bits, 2 * bytes, [&]()
+    {
+        auto fresh = keyGenDCF(bits, bits, GroupElement(rng() & mask, bits), GroupElement(1, bits));
+        do_not_optimize(fresh.first.k);
+        free_dcf(fresh.first);
+        free_dcf(fresh.second);
+    });
+
+    report.run("dcf_eval", 0, 0, bits, bytes, [&]()
+    {
+        GroupElement out{0};
+        evalDCF(0, &out, GroupElement(rng() & mask, bits), keys.first);
+        do_not_optimize(out.value);
+    });
+
+    prepfile::record_builder record;
+    report.run("dcf_append", 0, 0, bits, bytes, [&]()
+    {
+        record.clear();
+        append_dcf(record, keys.first);
+        do_not_optimize(record.bytes().data());
+    });
+
+    record.clear();
+    append_dcf(record, keys.first);
+    dcf_key_buffer buffer;
+    report.run("dcf_load", 0, 0, bits, bytes, [&]()
+    {
+        prepfile::record_cursor cursor{record.bytes().data(), record.bytes().data() + record.bytes().size()};
+        auto & key = load_dcf(cursor, bits, buffer);
+        do_not_optimize(key.v);
+    });
+
+    // the stream path: what `async_make_dcf` writes and `async_read_dcf` reads
+    std::vector<unsigned char> stream(bytes);
+    std::memcpy(stream.data(), keys.first.k, dcf_block_bytes(bits));
+    pack_dcf_values(keys.first, stream.data() + dcf_block_bytes(bits));
+    asio::io_context io_context{1};
+    memory_read_stream dealer{io_context, stream};
+    report.run("dcf_read", 0, 0, bits, bytes, [&]()
+    {
+        dealer.rewind();
+        async_read_dcf<bits>(dealer, io_context.get_executor(), buffer,
+            [](const asio::error_code & error, const DCFKeyPack &, std::size_t)
+            {
+                if (error) asio::detail::throw_error(error, "async_read_dcf");
+            });
+        io_context.restart();
+        io_context.run();
+    });
+
+    free_dcf(keys.first);
+    free_dcf(keys.second);
+}
+
+/// the parity and LUT kernels at one `(n, J)`
+template <std::size_t n, std::size_t J>
+void run_lut(reporter & report)
+{
+    static constexpr std::size_t segments = std::size_t(1) << J;
+    static constexpr std::size_t words = (segments + 63) / 64;
+    auto [dpf, peer, shifted] = make_assigned_dpfs();
+    auto x = shifted.reduced_value();
+    auto lut = parities::lut_words();
+
+    report.run("segment_parities", n, J, L, segments, [&]()
+    {
+        auto bytes = grotto::segment_parities<n, J>(*dpf);
+        do_not_optimize(bytes.data());
+    });
+
+    report.run("segment_parities_packed", n, J, L, words * sizeof(std::uint64_t), [&]()
+    {
+        auto packed = parities::segment_parities_packed<n, J>(*dpf, x);
+        do_not_optimize(packed.data());
+    });
+
+    auto packed = parities::segment_parities_packed<n, J>(*dpf, x);
+    report.run("masked_sum", n, J, L, segments * sizeof(std::uint64_t), [&]()
+    {
+        auto sums = lut_kernel::masked_sum(packed.data(), lut, segments);
+        do_not_optimize(sums.sum0);
+    });
+
+    report.run("masked_sum_dual", n, J, L, (segments + 1) * sizeof(std::uint64_t), [&]()
+    {
+        auto sums = lut_kernel::masked_sum(packed.data(), lut, lut + 1, segments);
+        do_not_optimize(sums.sum0);
+    });
+
+    report.run("fused_masked_sum", n, J, L, segments * sizeof(std::uint64_t), [&]()
+    {
+        auto sums = parities::fused_masked_sum<n, J>(*dpf, x, lut);
+        do_not_optimize(sums.sum0);
+    });
+
+    report.run("fused_masked_sum_dual", n, J, L, (segments + 1) * sizeof(std::uint64_t), [&]()
+    {
+        auto sums = parities::fused_masked_sum<n, J>(*dpf, x, lut, lut + 1);
+        do_not_optimize(sums.sum0);
+    });
+}
+
+/// the kernels that do not depend on `(n, J)`
+inline void run_fixed(reporter & report)
+{
+    report.run("dpf_keygen", 0, 0, L, 2 * sizeof(dpf_type), [&]()
+    {
+        auto keys = dpf::make_dpf(dpf::wildcard_value<dpf::modint<L>>(dpf::uniform_sample<dpf::modint<L>>()));
+        do_not_optimize(keys.first.root);
+    });
+
+    // one multiplication per op, including the blinding that precedes it
+    beaver_Haar haar;
+    haar.sign = dpf::uniform_sample<dpf::modint<L>>();
+    haar.inner_product = dpf::uniform_sample<dpf::modint<L>>();
+    haar.blinded_sign2 = dpf::uniform_sample<dpf::modint<L>>();
+    haar.blinded_inner_product2 = dpf::uniform_sample<dpf::modint<L>>();
+    report.run("beaver_Haar", 0, 0, L, 2 * sizeof(dpf::modint<L>), [&]()
+    {
+        beaver_Haar bvr = haar;
+        do_not_optimize(bvr.get_blinded_operands());
+        do_not_optimize(bvr.do_evaluation());
+    });
+
+    beaver bior;
+    bior.sign = dpf::uniform_sample<dpf::modint<L>>();
+    bior.inner_product0 = dpf::uniform_sample<dpf::modint<L>>();
+    bior.inner_product1 = dpf::uniform_sample<dpf::modint<L>>();
+    bior.coefficient = dpf::uniform_sample<dpf::modint<L>>();
+    bior.blinded_sign2 = dpf::uniform_sample<dpf::modint<L>>();
+    bior.blinded_inner_product02 = dpf::uniform_sample<dpf::modint<L>>();
+    bior.blinded_inner_product12 = dpf::uniform_sample<dpf::modint<L>>();
+    bior.blinded_coefficient2 = dpf::uniform_sample<dpf::modint<L>>();
+    report.run("beaver_bior", 0, 0, L, 4 * sizeof(dpf::modint<L>), [&]()
+    {
+        beaver bvr = bior;
+        do_not_optimize(bvr.get_blinded_operands());
+        do_not_optimize(bvr.do_evaluation());
+    });
+}
+
+/// DCF widths that `--dcf-bits` may pick from
+using dcf_widths = std::index_sequence<8, 16, 24, 32, 40, 48, 56, 64>;
+
+template <std::size_t... Bits>
+void run_dcf_sweep(reporter & report, const options & opts, std::index_sequence<Bits...>)
+{
+    for (auto bits : opts.dcf_bits)
+    {
+        if (((bits != Bits) && ...)) throw std::invalid_argument("--dcf-bits must be a multiple of 8 from 8 to 64");
+    }
+    for (auto bits : opts.dcf_bits) ((bits == Bits ? run_dcf<Bits>(report) : void()), ...);
+}
+
+/// runs `run_lut<n, J>` for every instantiated J that `opts` selects
+template <std::size_t n, std::size_t... Js>
+void run_lut_sweep_J(reporter & report, const options & opts, std::index_sequence<Js...>)
+{
+    ((WAVE_MIN_J + Js <= n && WAVE_MIN_J + Js >= opts.min_J && WAVE_MIN_J + Js <= opts.max_J
+        ? run_lut<n, WAVE_MIN_J + Js>(report) : void()), ...);
+}
+
+/// runs `run_lut_sweep_J` for every instantiated n
+template <std::size_t... Ns>
+void run_lut_sweep_n(reporter & report, const options & opts, std::index_sequence<Ns...>)
+{
+    (run_lut_sweep_J<WAVE_MIN_N + Ns>(report, opts, std::make_index_sequence<WAVE_MAX_J - WAVE_MIN_J + 1>{}), ...);
+}
+
+}  // namespace bench
+
+int main(int argc, char * argv[])
+{
+    fss_init();
+
+    bench::options opts;
+    CLI::App args("Microbenchmarks for the protocol kernels", "bench");
+    args.add_option("--min-time", opts.min_time, "Seconds per measured run")
+        ->capture_default_str();
+    args.add_option("--min-J", opts.min_J, "Smallest LUT size (J) to sweep")
+        ->capture_default_str();
+    args.add_option("--max-J", opts.max_J, "Largest LUT size (J) to sweep")
+        ->capture_default_str();
+    args.add_option("--dcf-bits", opts.dcf_bits, "DCF input bitlengths (L) to sweep (multiples of 8)")
+        ->capture_default_str();
+    args.add_option("--filter", opts.filter, "Only run kernels whose name contains this");
+    args.add_flag("--json", opts.json, "Print JSON instead of CSV");
+    CLI11_PARSE(args, argc, argv);
+
+    // random LUT for every swept J (bior reads one entry past the end)
+    std::vector<output_type> lut((std::size_t(1) << WAVE_MAX_J) + 1);
+    std::mt19937_64 rng{0};
+    for (auto & entry : lut) entry = output_type(rng());
+    scaled_lut = lut.data();
+
+    try
+    {
+        bench::reporter report{opts};
+        bench::run_fixed(report);
+        bench::run_dcf_sweep(report, opts, bench::dcf_widths{});
+        bench::run_lut_sweep_n(report, opts, std::make_index_sequence<WAVE_MAX_N - WAVE_MIN_N + 1>{});
+    }
+    catch (const std::exception & e)
+    {
+        std::cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
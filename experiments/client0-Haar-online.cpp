@@ -24,7 +24,9 @@ int main(int argc, char * argv[])
 
     try
     {
-        asio::stream_file dealer{io_context, "Haar.0", asio::stream_file::read_only};
+        // written by client0-Haar-preprocess (see prepfile.hpp)
+        prepfile::mapped_file dealer{io_context.get_executor(), "Haar.0",
+            prepfile::transform_t::Haar, L, n, J, false};
         tcp::acceptor acceptor{io_context,
             tcp::endpoint(tcp::v4(), peer_port)};
 
@@ -33,7 +35,7 @@ int main(int argc, char * argv[])
         peer.set_option(tcp::no_delay(true));
         // std::cout << "Received connection from peer\n";
 
-        auto ret = async_online_Haar<L>(dealer, peer, work_executor, 100, count, asio::use_future);
+        auto ret = async_online_Haar<L,j,n>(dealer, peer, work_executor, 100, count, false, asio::use_future);
 
         auto before = std::chrono::high_resolution_clock::now();
         io_context.run();
@@ -1,3 +1,4 @@
+#include <sys/stat.h>
 #include "grotto.hpp"
 
 #include "params.hpp"
@@ -11,9 +12,15 @@ int main(int argc, char * argv[])
 {
     fss_init();
 
+    // tap 1 reads one entry past tap 0, so the LUT holds 2^J+1 entries
     int fd = open("lut.dat", O_RDONLY);
-    scaled_lut = reinterpret_cast<output_type *>(mmap(nullptr, interval_bytes, PROT_READ, MAP_PRIVATE|MAP_NORESERVE, fd, off_t(0)));
-    scaled_lut2 = reinterpret_cast<output_type *>(mmap(nullptr, interval_bytes, PROT_READ, MAP_PRIVATE|MAP_NORESERVE, fd, off_t(0)));
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0 || std::size_t(st.st_size) < bior_lut_bytes<J>)
+    {
+        std::cout << "lut.dat must hold at least " << bior_lut_bytes<J> << " bytes (regenerate it with luts/lut.py)\n";
+        exit(EXIT_FAILURE);
+    }
+    scaled_lut = reinterpret_cast<output_type *>(mmap(nullptr, bior_lut_bytes<J>, PROT_READ, MAP_PRIVATE|MAP_NORESERVE, fd, off_t(0)));
 
     asio::io_context io_context{1};
 
@@ -22,7 +29,9 @@ int main(int argc, char * argv[])
 
     try
     {
-        asio::stream_file dealer{io_context, "bior.0", asio::stream_file::read_only};
+        // written by client0-bior-preprocess (see prepfile.hpp)
+        prepfile::mapped_file dealer{io_context.get_executor(), "bior.0",
+            prepfile::transform_t::bior, L, n, J, false};
         tcp::acceptor acceptor{io_context,
             tcp::endpoint(tcp::v4(), peer_port)};
 
@@ -31,7 +40,7 @@ int main(int argc, char * argv[])
         peer.set_option(tcp::no_delay(true));
         // std::cout << "Received connection from peer\n";
 
-        auto ret = async_online_bior<L,j,n>(dealer, peer, work_executor, 0, 100, count, asio::use_future);
+        auto ret = async_online_bior<L,j,n>(dealer, peer, work_executor, 0, 100, count, false, asio::use_future);
 
         auto before = std::chrono::high_resolution_clock::now();
         io_context.run();
@@ -25,7 +25,9 @@ int main(int argc, char * argv[])
 
     try
     {
-        asio::stream_file dealer{io_context, "Haar.1", asio::stream_file::read_only};
+        // written by client1-Haar-preprocess (see prepfile.hpp)
+        prepfile::mapped_file dealer{io_context.get_executor(), "Haar.1",
+            prepfile::transform_t::Haar, L, n, J, false};
         asio::ip::tcp::resolver resolver{io_context};
         auto peer_endpoints = resolver.resolve(peer_address, peer_port);
 
@@ -34,7 +36,7 @@ int main(int argc, char * argv[])
         peer.set_option(tcp::no_delay(true));
         // std::cout << "Connected to peer\n";
 
-        auto ret = async_online_Haar<L>(dealer, peer, work_executor, 100, count, asio::use_future);
+        auto ret = async_online_Haar<L,j,n>(dealer, peer, work_executor, 100, count, false, asio::use_future);
 
         auto before = std::chrono::high_resolution_clock::now();
         io_context.run();
@@ -34,7 +34,7 @@ int main(int argc, char * argv[])
         dealer.set_option(tcp::no_delay(true));
         std::cout << "Connected to dealer\n";
 
-        auto ret = async_read_preprocess_Haar<L>(dealer, outfile, work_executor, count, asio::use_future);
+        auto ret = async_read_preprocess_Haar<L>(dealer, outfile, work_executor, count, false, asio::use_future);
 
         auto before = std::chrono::high_resolution_clock::now();
         io_context.run();
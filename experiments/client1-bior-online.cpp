@@ -1,4 +1,5 @@
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <chrono>
 
 #define ASIO_HAS_IO_URING 1
@@ -17,9 +18,15 @@ int main(int argc, char * argv[])
 {
     fss_init();
 
+    // tap 1 reads one entry past tap 0, so the LUT holds 2^J+1 entries
     int fd = open("lut.dat", O_RDONLY);
-    scaled_lut = reinterpret_cast<output_type *>(mmap(nullptr, interval_bytes, PROT_READ, MAP_PRIVATE|MAP_NORESERVE, fd, off_t(0)));
-    scaled_lut2 = reinterpret_cast<output_type *>(mmap(nullptr, interval_bytes, PROT_READ, MAP_PRIVATE|MAP_NORESERVE, fd, off_t(0)));
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0 || std::size_t(st.st_size) < bior_lut_bytes<J>)
+    {
+        std::cout << "lut.dat must hold at least " << bior_lut_bytes<J> << " bytes (regenerate it with luts/lut.py)\n";
+        exit(EXIT_FAILURE);
+    }
+    scaled_lut = reinterpret_cast<output_type *>(mmap(nullptr, bior_lut_bytes<J>, PROT_READ, MAP_PRIVATE|MAP_NORESERVE, fd, off_t(0)));
 
     asio::io_context io_context{1};
 
@@ -28,7 +35,9 @@ int main(int argc, char * argv[])
 
     try
     {
-        asio::stream_file dealer{io_context, "bior.1", asio::stream_file::read_only};
+        // written by client1-bior-preprocess (see prepfile.hpp)
+        prepfile::mapped_file dealer{io_context.get_executor(), "bior.1",
+            prepfile::transform_t::bior, L, n, J, false};
         asio::ip::tcp::resolver resolver{io_context};
         auto peer_endpoints = resolver.resolve(peer_address, peer_port);
 
@@ -37,7 +46,7 @@ int main(int argc, char * argv[])
         peer.set_option(tcp::no_delay(true));
         // std::cout << "Connected to peer\n";
 
-        auto ret = async_online_bior<L,j,n>(dealer, peer, work_executor, 1, 100, count, asio::use_future);
+        auto ret = async_online_bior<L,j,n>(dealer, peer, work_executor, 1, 100, count, false, asio::use_future);
 
         auto before = std::chrono::high_resolution_clock::now();
         io_context.run();
@@ -25,7 +25,7 @@ int main(int argc, char * argv[])
                                         asio::stream_file::create     |
                                         asio::stream_file::truncate};
 
-        auto ret = async_make_preprocess_Haar<L>(client0, client1, work_executor, count, asio::use_future);
+        auto ret = async_make_preprocess_Haar<L>(client0, client1, work_executor, count, false, asio::use_future);
 
         auto before = std::chrono::high_resolution_clock::now();
         io_context.run();
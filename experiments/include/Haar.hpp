@@ -1,13 +1,22 @@
 #ifndef HAAR_HPP__
 #define HAAR_HPP__
 
+#include "arena.hpp"
+#include "batch.hpp"
+#include "dealer.hpp"
+#include "parities.hpp"
+#include "pipeline.hpp"
+#include "prepfile.hpp"
+#include "prg.hpp"
+#include "stats.hpp"
+
 template <std::size_t bits,
           typename PeerT,
           typename ExecutorT,
           typename CompletionToken>
 [[nodiscard]]
 HEDLEY_ALWAYS_INLINE
-auto async_make_beaver_Haar(PeerT & peer0, PeerT & peer1, ExecutorT work_executor, CompletionToken && token)
+auto async_make_beaver_Haar(PeerT & peer0, PeerT & peer1, ExecutorT work_executor, bool compressed, CompletionToken && token)
 {
     #include <asio/yield.hpp>
     return ::asio::async_compose<
@@ -20,6 +29,8 @@ auto async_make_beaver_Haar(PeerT & peer0, PeerT & peer1, ExecutorT work_executo
                 work_executor,
                 bvr0 = std::make_shared<std::array<dpf::modint<bits>, 3>>(),
                 bvr1 = std::make_shared<std::array<dpf::modint<bits>, 3>>(),
+                seed = std::make_shared<prg::seed_type>(),
+                compressed,
                 bytes_written0 = std::size_t(0),
                 bytes_written1 = std::size_t(0),
                 coro = ::asio::coroutine()
@@ -33,14 +44,27 @@ auto async_make_beaver_Haar(PeerT & peer0, PeerT & peer1, ExecutorT work_executo
             {
                 reenter (coro)
                 {
-                    yield dpf::asio::async_post(work_executor, [bvr0,bvr1,&self]()
+                    yield dpf::asio::async_post(work_executor, [bvr0,bvr1,seed,compressed,&self]()
                     {
+                        if (compressed)
+                        {
+                            // party 0's shares come from the seed; party 1's
+                            // blinds are fresh, and its correction makes up
+                            // the difference
+                            *seed = prg::make_seed();
+                            *bvr0 = prg::expand_shares<dpf::modint<bits>, 3>(*seed);
+                            (*bvr1)[0] = dpf::uniform_sample<dpf::modint<bits>>();
+                            (*bvr1)[1] = dpf::uniform_sample<dpf::modint<bits>>();
+                            (*bvr1)[2] = (*bvr0)[0]*(*bvr1)[1]+(*bvr0)[1]*(*bvr1)[0]-(*bvr0)[2];
+                            return;
+                        }
                         std::tie((*bvr0)[0], (*bvr1)[0]) = dpf::additively_share(dpf::uniform_sample<dpf::modint<bits>>());
                         std::tie((*bvr0)[1], (*bvr1)[1]) = dpf::additively_share(dpf::uniform_sample<dpf::modint<bits>>());
                         std::tie((*bvr0)[2], (*bvr1)[2]) = dpf::additively_share((*bvr0)[0]*(*bvr1)[1]+(*bvr0)[1]*(*bvr1)[0]);
                     }, std::move(self));
 
-                    yield ::asio::async_write(peer0, asio::buffer(*bvr0, sizeof(*bvr0)), std::move(self));
+                    yield ::asio::async_write(peer0, compressed ? asio::buffer(*seed)
+                                                                : asio::buffer(*bvr0, sizeof(*bvr0)), std::move(self));
 
                     bytes_written0 += bytes_just_written;
 
@@ -119,6 +143,8 @@ struct beaver_Haar
         ready_{false} { }
     beaver_Haar(beaver_Haar &&) = default;
     beaver_Haar(const beaver_Haar &) = default;
+    beaver_Haar & operator=(beaver_Haar &&) = default;
+    beaver_Haar & operator=(const beaver_Haar &) = default;
 
     auto get_blinded_operands()
     {
@@ -177,13 +203,22 @@ struct beaver_Haar
     bool ready_;
 };
 
+/// sets the dealer-supplied values of `bvr`, in the order the dealer sends them
+HEDLEY_ALWAYS_INLINE
+void assign_beaver_Haar(beaver_Haar & bvr, const std::array<dpf::modint<L>, 3> & values)
+{
+    bvr.sign_blind = values[0];
+    bvr.inner_product_blind = values[1];
+    bvr.correction = values[2];
+}
+
 template <std::size_t bits,
           typename DealerT,
           typename ExecutorT,
           typename CompletionToken>
 [[nodiscard]]
 HEDLEY_ALWAYS_INLINE
-auto async_read_beaver_Haar(DealerT & dealer, ExecutorT work_executor, CompletionToken && token)
+auto async_read_beaver_Haar(DealerT & dealer, ExecutorT work_executor, bool seeded, CompletionToken && token)
 {
     #include <asio/yield.hpp>
     return ::asio::async_compose<
@@ -194,6 +229,8 @@ auto async_read_beaver_Haar(DealerT & dealer, ExecutorT work_executor, Completio
                 &dealer,
                 work_executor,
                 bvr = std::make_shared<beaver_Haar>(),
+                seed = std::make_shared<prg::seed_type>(),
+                seeded,
                 bytes_read = std::size_t(0),
                 coro = ::asio::coroutine()
             ]
@@ -206,16 +243,25 @@ auto async_read_beaver_Haar(DealerT & dealer, ExecutorT work_executor, Completio
             {
                 reenter (coro)
                 {
-                    yield ::asio::async_read(dealer, std::array<asio::mutable_buffer, 3>{
-                        asio::buffer(&bvr->sign_blind, sizeof(bvr->sign_blind)),
-                        asio::buffer(&bvr->inner_product_blind, sizeof(bvr->inner_product_blind)),
-                        asio::buffer(&bvr->correction, sizeof(bvr->correction))
-                    }, std::move(self));
+                    if (seeded)
+                    {
+                        yield ::asio::async_read(dealer, asio::buffer(*seed), std::move(self));
+                    }
+                    else
+                    {
+                        yield ::asio::async_read(dealer, std::array<asio::mutable_buffer, 3>{
+                            asio::buffer(&bvr->sign_blind, sizeof(bvr->sign_blind)),
+                            asio::buffer(&bvr->inner_product_blind, sizeof(bvr->inner_product_blind)),
+                            asio::buffer(&bvr->correction, sizeof(bvr->correction))
+                        }, std::move(self));
+                    }
 
                     bytes_read += bytes_just_read;
 
                     if (error) asio::detail::throw_error(error, "async_read");
 
+                    if (seeded) assign_beaver_Haar(*bvr, prg::expand_shares<dpf::modint<L>, 3>(*seed));
+
                     self.complete(error, *bvr, bytes_read);
                 }
             },
@@ -300,13 +346,98 @@ auto async_mult(DealerT & dealer, PeerT & peer, ExecutorT work_executor, std::sh
         token, dealer, peer, work_executor);
 }
 
+template <std::size_t bits,
+          typename DealerT,
+          typename PeerT,
+          typename ExecutorT>
+struct mult1x1_batch_coro : asio::coroutine
+{
+#include <asio/yield.hpp>
+  public:
+    mult1x1_batch_coro(DealerT & dealer, PeerT & peer,
+        ExecutorT work_executor, std::shared_ptr<std::vector<beaver_Haar>> bvrs)
+      : dealer_{dealer}, peer_{peer}, work_executor_{work_executor},
+        bvrs_{std::move(bvrs)},
+        blinded_{std::make_shared<std::vector<dpf::modint<L>>>(2 * bvrs_->size())},
+        blinded2_{std::make_shared<std::vector<dpf::modint<L>>>(2 * bvrs_->size())},
+        outputs_{std::make_shared<std::vector<output_type>>(bvrs_->size())},
+        bytes_read_{0}, bytes_written_{0} { }
+
+    template <typename Self>
+    void operator()(Self & self,
+                    const asio::error_code & error = {},
+                    std::size_t bytes_just_read = 0,
+                    std::size_t bytes_just_written = 0)
+    {
+        reenter(*this)
+        {
+            yield dpf::asio::async_post(work_executor_, [bvrs = this->bvrs_, blinded = this->blinded_]()
+            {
+                for (std::size_t i = 0; i < bvrs->size(); ++i)
+                {
+                    std::tie((*blinded)[2*i], (*blinded)[2*i+1]) = (*bvrs)[i].get_blinded_operands();
+                }
+            }, std::move(self));
+
+            yield async_exchange(peer_, asio::buffer(*blinded_), asio::buffer(*blinded2_), std::move(self));
+            bytes_read_ += bytes_just_read;
+            bytes_written_ += bytes_just_written;
+            if (error) asio::detail::throw_error(error, "async_exchange(blinded)");
+
+            yield dpf::asio::async_post(work_executor_, [bvrs = this->bvrs_, blinded2 = this->blinded2_, outputs = this->outputs_]()
+            {
+                for (std::size_t i = 0; i < bvrs->size(); ++i)
+                {
+                    auto & bvr = (*bvrs)[i];
+                    bvr.blinded_sign2 = (*blinded2)[2*i];
+                    bvr.blinded_inner_product2 = (*blinded2)[2*i+1];
+                    (*outputs)[i] = bvr.do_evaluation();
+                }
+            }, std::move(self));
+
+            self.complete(error, *outputs_, bytes_read_, bytes_written_);
+        }
+    }
+
+  private:
+    DealerT & dealer_;
+    PeerT & peer_;
+    ExecutorT work_executor_;
+    std::shared_ptr<std::vector<beaver_Haar>> bvrs_;
+    std::shared_ptr<std::vector<dpf::modint<L>>> blinded_, blinded2_;
+    std::shared_ptr<std::vector<output_type>> outputs_;
+    std::size_t bytes_read_, bytes_written_;
+#include <asio/unyield.hpp>
+};
+
+/// multiplies every `(sign, inner_product)` pair in `*bvrs` using a single
+/// exchange of blinded operands with the peer
+template <std::size_t bits,
+          typename DealerT,
+          typename PeerT,
+          typename ExecutorT,
+          typename CompletionToken>
+[[nodiscard]]
+HEDLEY_ALWAYS_INLINE
+auto async_mult_batch(DealerT & dealer, PeerT & peer, ExecutorT work_executor, std::shared_ptr<std::vector<beaver_Haar>> bvrs, CompletionToken && token)
+{
+    return asio::async_compose<CompletionToken,
+        void(asio::error_code,
+            std::vector<output_type> outputs,
+            std::size_t,
+            std::size_t)>(mult1x1_batch_coro<bits, DealerT, PeerT, ExecutorT>{dealer, peer, work_executor, std::move(bvrs)},
+        token, dealer, peer, work_executor);
+}
+
+/// generates `count` indices one after another; `async_make_preprocess_Haar`
+/// runs many of these concurrently, one per chunk of indices
 template <std::size_t bits,
           typename PeerT,
           typename ExecutorT,
           typename CompletionToken>
 [[nodiscard]]
 HEDLEY_ALWAYS_INLINE
-auto async_make_preprocess_Haar(PeerT & peer0, PeerT & peer1, ExecutorT work_executor, std::size_t count, CompletionToken && token)
+auto async_make_preprocess_Haar_serial(PeerT & peer0, PeerT & peer1, ExecutorT work_executor, std::size_t count, bool compressed, CompletionToken && token)
 {
     #include <asio/yield.hpp>
     return ::asio::async_compose<
@@ -321,6 +452,7 @@ auto async_make_preprocess_Haar(PeerT & peer0, PeerT & peer1, ExecutorT work_exe
                 bytes_written1 = std::size_t(0),
                 args = dpf::make_dpfargs(dpf::wildcard<dpf::modint<bits>>),
                 count,
+                compressed,
                 iter = std::size_t(0),
                 coro = ::asio::coroutine()
             ]
@@ -342,7 +474,7 @@ auto async_make_preprocess_Haar(PeerT & peer0, PeerT & peer1, ExecutorT work_exe
                         bytes_written1 += bytes_just_written1;
                         if (error) asio::detail::throw_error(error, "async_make_dpf");
 
-                        yield async_make_beaver_Haar<64>(peer0, peer1, work_executor, std::move(self));
+                        yield async_make_beaver_Haar<64>(peer0, peer1, work_executor, compressed, std::move(self));
                         bytes_written0 += bytes_just_written0;
                         bytes_written1 += bytes_just_written1;
                         if (error) asio::detail::throw_error(error, "async_make_beaver_Haar");
@@ -355,6 +487,23 @@ auto async_make_preprocess_Haar(PeerT & peer0, PeerT & peer1, ExecutorT work_exe
     #include <asio/unyield.hpp>
 }
 
+template <std::size_t bits,
+          typename PeerT,
+          typename ExecutorT,
+          typename CompletionToken>
+[[nodiscard]]
+HEDLEY_ALWAYS_INLINE
+auto async_make_preprocess_Haar(PeerT & peer0, PeerT & peer1, ExecutorT work_executor, std::size_t count, bool compressed, CompletionToken && token)
+{
+    return async_make_preprocess_parallel(peer0, peer1, work_executor, count,
+        default_dealer_chunk, default_dealer_window(),
+        [compressed](auto & stream0, auto & stream1, auto strand, std::size_t size, auto && handler)
+        {
+            async_make_preprocess_Haar_serial<bits>(stream0, stream1, strand, size, compressed, std::move(handler));
+        },
+        token);
+}
+
 template <std::size_t bits,
           typename DealerT,
           typename ExecutorT>
@@ -373,9 +522,12 @@ struct read_preprocess_Haar_coro : asio::coroutine
     using dpf_values = std::tuple<correction_words_array, correction_advice_array, dpf_priv_values>;
   public:
     read_preprocess_Haar_coro(DealerT & dealer, asio::stream_file & outfile,
-        ExecutorT work_executor, std::size_t count)
+        ExecutorT work_executor, std::size_t count, bool seeded)
       : dealer_{dealer}, outfile_{outfile}, work_executor_{work_executor},
-        count_{count},
+        count_{count}, seeded_{seeded}, seed_{std::make_shared<prg::seed_type>()},
+        writer_{std::make_shared<prepfile::writer>(prepfile::make_header(prepfile::transform_t::Haar,
+            bits, 0, 0, seeded, count))},
+        record_{std::make_shared<prepfile::record_builder>()},
         bytes_read_{0}, bytes_written_{0} { }
 
     template <typename Self>
@@ -407,23 +559,43 @@ struct read_preprocess_Haar_coro : asio::coroutine
     {
         reenter(*this)
         {
+            outfile_.seek(writer_->data_offset(), asio::stream_file::seek_set);
+
             while (count_--)
             {
                 yield dpf::asio::async_read_dpf_inner<dpf_type>(dealer_, work_executor_, std::move(self));
                 if (error) asio::detail::throw_error(error, "async_make_dpf_inner");
 
-                yield asio::async_write(outfile_, asio::buffer(&*dpf_, sizeof(*dpf_)), std::move(self));
-                bytes_written_ += bytes_just_written;
-                if (error) asio::detail::throw_error(error, "async_write(dpf)");
+                if (seeded_)
+                {
+                    yield asio::async_read(dealer_, asio::buffer(*seed_), std::move(self));
+                    bytes_read_ += bytes_just_written;
+                    if (error) asio::detail::throw_error(error, "async_read(seed)");
+                }
+                else
+                {
+                    yield async_read_beaver_Haar_inner<64>(dealer_, work_executor_, std::move(self));
+                    if (error) asio::detail::throw_error(error, "async_make_beaver_Haar");
+                }
 
-                yield async_read_beaver_Haar_inner<64>(dealer_, work_executor_, std::move(self));
-                if (error) asio::detail::throw_error(error, "async_make_beaver_Haar");
+                // record layout: dpf_values, then the Beaver triple (or its seed)
+                record_->clear();
+                record_->append(*dpf_);
+                if (seeded_) record_->append(*seed_);
+                else record_->append(*bvr_);
+                record_->finish();
+                writer_->add_record(record_->bytes().size());
 
-                yield asio::async_write(outfile_, asio::buffer(&*bvr_, sizeof(*bvr_)), std::move(self));
+                yield asio::async_write(outfile_, asio::buffer(record_->bytes()), std::move(self));
                 bytes_written_ += bytes_just_written;
-                if (error) asio::detail::throw_error(error, "async_write(beaver)");
+                if (error) asio::detail::throw_error(error, "async_write(record)");
             }
 
+            outfile_.seek(0, asio::stream_file::seek_set);
+            yield asio::async_write(outfile_, writer_->finish(), std::move(self));
+            bytes_written_ += bytes_just_written;
+            if (error) asio::detail::throw_error(error, "async_write(header)");
+
             self.complete(error, bytes_read_, bytes_written_);
         }
     }
@@ -433,6 +605,10 @@ struct read_preprocess_Haar_coro : asio::coroutine
     asio::stream_file & outfile_;
     ExecutorT work_executor_;
     std::size_t count_;
+    bool seeded_;
+    std::shared_ptr<prg::seed_type> seed_;
+    std::shared_ptr<prepfile::writer> writer_;
+    std::shared_ptr<prepfile::record_builder> record_;
     std::size_t bytes_read_, bytes_written_;
     std::unique_ptr<dpf_values> dpf_;
     std::unique_ptr<std::array<dpf::modint<bits>, 3>> bvr_;
@@ -446,23 +622,106 @@ template <std::size_t bits,
           typename CompletionToken>
 [[nodiscard]]
 HEDLEY_ALWAYS_INLINE
-auto async_read_preprocess_Haar(DealerT & dealer, OutfileT & outfile, ExecutorT work_executor, std::size_t count, CompletionToken && token)
+auto async_read_preprocess_Haar(DealerT & dealer, OutfileT & outfile, ExecutorT work_executor, std::size_t count, bool seeded, CompletionToken && token)
 {
     return asio::async_compose<CompletionToken,
         void(asio::error_code,
              std::size_t,
-             std::size_t)>(read_preprocess_Haar_coro<bits, DealerT, ExecutorT>{dealer, outfile, work_executor, count},
+             std::size_t)>(read_preprocess_Haar_coro<bits, DealerT, ExecutorT>{dealer, outfile, work_executor, count, seeded},
         token, dealer, outfile, work_executor);
 }
 
+/// adds a masked LUT reduction into `bvr.inner_product` and `bvr.sign`
+HEDLEY_ALWAYS_INLINE
+void Haar_accumulate(beaver_Haar & bvr, const lut_kernel::masked_sums & sums)
+{
+    bvr.inner_product += dpf::modint<L>(sums.sum0);
+    bvr.sign += dpf::modint<L>(sums.count);
+}
+
+/// adds the LUT entry of every segment with odd parity into
+/// `bvr.inner_product` and the number of such segments into `bvr.sign`
+template <std::size_t j,
+          std::size_t n,
+          typename DpfT>
+HEDLEY_ALWAYS_INLINE
+void Haar_inner_product(const DpfT & dpf, std::uint64_t shifted_input, beaver_Haar & bvr)
+{
+    Haar_accumulate(bvr, parities::fused_masked_sum<n, n-j>(dpf, shifted_input, parities::lut_words()));
+}
+
+/// per-evaluation state for `async_online_Haar_pipelined`
 template <std::size_t bits,
+          std::size_t j,
+          std::size_t n>
+struct Haar_evaluation
+{
+    using dpf_type = DEDUCE_DPF_TYPE_T(dpf::wildcard_value<dpf::modint<bits>>{});
+
+    void blind_input(dpf::modint<L> input_share)
+    {
+        blinded_input = dpf->offset_x.compute_and_get_share(input_share);
+    }
+
+    void compute()
+    {
+        auto shifted_input = dpf->offset_x.reconstruct(blinded_input2);
+        Haar_inner_product<j, n>(*dpf, shifted_input.reduced_value(), bvr);
+        std::tie(operands[0], operands[1]) = bvr.get_blinded_operands();
+    }
+
+    auto finish()
+    {
+        bvr.blinded_sign2 = operands2[0];
+        bvr.blinded_inner_product2 = operands2[1];
+        return bvr.do_evaluation();
+    }
+
+    template <typename DealerT, typename ExecutorT, typename CompletionToken>
+    static auto async_read(DealerT & dealer, ExecutorT work_executor,
+        std::shared_ptr<Haar_evaluation> evaluation, CompletionToken && token);
+
+    template <typename ExecutorT, typename CompletionToken>
+    static auto async_read(prepfile::mapped_file & dealer, ExecutorT,
+        std::shared_ptr<Haar_evaluation> evaluation, CompletionToken && token)
+    {
+        return prepfile::async_load(dealer, std::move(evaluation), std::forward<CompletionToken>(token));
+    }
+
+    /// takes this evaluation's dealer values from a mapped record (see
+    /// `read_preprocess_Haar_coro` for the layout) and returns its size
+    std::size_t load(prepfile::record_cursor record)
+    {
+        using dpf_values = std::tuple<typename dpf_type::correction_words_array,
+            typename dpf_type::correction_advice_array,
+            std::tuple<typename dpf_type::interior_node, typename dpf_type::leaf_tuple,
+                typename dpf_type::beaver_tuple, typename dpf_type::input_type>>;
+        auto & [correction_words, correction_advice, priv] = record.next<dpf_values>();
+        auto & [root, leaves, beavers, offset_share] = priv;
+        dpf = make_recycled<dpf_type>(arena, root, correction_words, correction_advice,
+            leaves, beavers, offset_share);
+        assign_beaver_Haar(bvr, seeded ? prg::expand_shares<dpf::modint<L>, 3>(record.next<prg::seed_type>())
+                                       : record.next<std::array<dpf::modint<L>, 3>>());
+        return record.bytes_read();
+    }
+
+    bool seeded = false;  ///< whether the dealer sends a seed for `bvr`
+    std::shared_ptr<recycling_arena> arena;  ///< where `dpf` is allocated (shared by all slots)
+    std::shared_ptr<dpf_type> dpf;
+    beaver_Haar bvr;
+    dpf::modint<L> blinded_input, blinded_input2;
+    std::array<dpf::modint<L>, 2> operands, operands2;
+};
+
+template <std::size_t bits,
+          std::size_t j,
+          std::size_t n,
           typename DealerT,
-          typename PeerT,
           typename ExecutorT>
-struct online_Haar_coro : asio::coroutine
+struct read_Haar_evaluation_coro : asio::coroutine
 {
 #include <asio/yield.hpp>
-    using dpf_type = DEDUCE_DPF_TYPE_T(dpf::wildcard_value<dpf::modint<bits>>{});
+    using dpf_type = typename Haar_evaluation<bits, j, n>::dpf_type;
     using correction_words_array = typename dpf_type::correction_words_array;
     using correction_advice_array = typename dpf_type::correction_advice_array;
     using interior_node = typename dpf_type::interior_node;
@@ -473,11 +732,10 @@ struct online_Haar_coro : asio::coroutine
     using dpf_priv_values = std::tuple<interior_node, leaf_tuple, beaver_tuple, input_type>;
     using dpf_values = std::tuple<correction_words_array, correction_advice_array, dpf_priv_values>;
   public:
-    online_Haar_coro(DealerT & dealer, PeerT & peer,
-        ExecutorT work_executor, dpf::modint<L> input_share, std::size_t count)
-      : dealer_{dealer}, peer_{peer}, work_executor_{work_executor},
-        input_share_{input_share}, count_{count},
-        dealer_bytes_read_{0}, peer_bytes_read_{0}, bytes_written_{0} { }
+    read_Haar_evaluation_coro(DealerT & dealer, ExecutorT work_executor,
+        std::shared_ptr<Haar_evaluation<bits, j, n>> evaluation)
+      : dealer_{dealer}, work_executor_{work_executor},
+        evaluation_{std::move(evaluation)}, bytes_read_{0} { }
 
     template <typename Self>
     void operator()(Self & self,
@@ -485,10 +743,10 @@ struct online_Haar_coro : asio::coroutine
                     std::size_t bytes_just_read,
                     dpf_values dpf)
     {
-        dealer_bytes_read_ += bytes_just_read;
+        bytes_read_ += bytes_just_read;
         auto & [correction_words, correction_advice, priv] = dpf;
         auto & [root, leaves, beavers, offset_share] = priv;
-        dpf_ = std::make_shared<dpf_type>(root, correction_words, correction_advice,
+        evaluation_->dpf = make_recycled<dpf_type>(evaluation_->arena, root, correction_words, correction_advice,
             leaves, beavers, offset_share);
         (*this)(self, error);
     }
@@ -499,11 +757,72 @@ struct online_Haar_coro : asio::coroutine
                     beaver_Haar bvr,
                     std::size_t bytes_just_read)
     {
-        dealer_bytes_read_ += bytes_just_read;
-        bvr_ = std::make_shared<beaver_Haar>(bvr);
+        bytes_read_ += bytes_just_read;
+        evaluation_->bvr = std::move(bvr);
         (*this)(self, error);
     }
 
+    template <typename Self>
+    void operator()(Self & self,
+                    const asio::error_code & error = {},
+                    std::size_t = 0)
+    {
+        reenter(*this)
+        {
+            yield dpf::asio::async_read_dpf_inner<dpf_type>(dealer_, work_executor_, std::move(self));
+            if (error) asio::detail::throw_error(error, "async_read_dpf_inner");
+
+            yield async_read_beaver_Haar<64>(dealer_, work_executor_, evaluation_->seeded, std::move(self));
+            if (error) asio::detail::throw_error(error, "async_read_beaver_Haar");
+
+            self.complete(error, bytes_read_);
+        }
+    }
+
+  private:
+    DealerT & dealer_;
+    ExecutorT work_executor_;
+    std::shared_ptr<Haar_evaluation<bits, j, n>> evaluation_;
+    std::size_t bytes_read_;
+#include <asio/unyield.hpp>
+};
+
+template <std::size_t bits,
+          std::size_t j,
+          std::size_t n>
+template <typename DealerT, typename ExecutorT, typename CompletionToken>
+auto Haar_evaluation<bits, j, n>::async_read(DealerT & dealer, ExecutorT work_executor,
+    std::shared_ptr<Haar_evaluation> evaluation, CompletionToken && token)
+{
+    return asio::async_compose<CompletionToken,
+        void(asio::error_code,
+             std::size_t)>(read_Haar_evaluation_coro<bits, j, n, DealerT, ExecutorT>{dealer, work_executor, std::move(evaluation)},
+        token, dealer, work_executor);
+}
+
+template <std::size_t bits,
+          std::size_t j,
+          std::size_t n,
+          typename DealerT,
+          typename PeerT,
+          typename ExecutorT>
+struct online_Haar_coro : asio::coroutine
+{
+#include <asio/yield.hpp>
+    using evaluation_type = Haar_evaluation<bits, j, n>;
+    using dpf_type = typename evaluation_type::dpf_type;
+  public:
+    online_Haar_coro(DealerT & dealer, PeerT & peer,
+        ExecutorT work_executor, dpf::modint<L> input_share, std::size_t count, bool seeded)
+      : dealer_{dealer}, peer_{peer}, work_executor_{work_executor},
+        input_share_{input_share}, count_{count},
+        dealer_bytes_read_{0}, peer_bytes_read_{0}, bytes_written_{0},
+        record_{std::make_shared<evaluation_type>()}, bvr_{std::make_shared<beaver_Haar>()}
+    {
+        record_->seeded = seeded;
+        record_->arena = std::make_shared<recycling_arena>();
+    }
+
     template <typename Self>
     void operator()(Self & self,
                     const asio::error_code & error,
@@ -513,6 +832,16 @@ struct online_Haar_coro : asio::coroutine
     {
         peer_bytes_read_ += bytes_just_read;
         bytes_written_ += bytes_just_written;
+        shifted_input_ = shifted_input;
+        (*this)(self, error);
+    }
+
+    template <typename Self>
+    void operator()(Self & self,
+                    const asio::error_code & error,
+                    lut_kernel::masked_sums sums)
+    {
+        Haar_accumulate(*bvr_, sums);
         (*this)(self, error);
     }
 
@@ -532,29 +861,30 @@ struct online_Haar_coro : asio::coroutine
         {
             while (count_--)
             {
-                yield dpf::asio::async_read_dpf_inner<dpf_type>(dealer_, work_executor_, std::move(self));
-                if (error) asio::detail::throw_error(error, "async_read_dpf_inner");
-
-                yield async_read_beaver_Haar<64>(dealer_, work_executor_, std::move(self));
-                if (error) asio::detail::throw_error(error, "async_make_beaver_Haar");
+                // from a stream or a mapped preprocessing file
+                probe_.start(bytes_so_far());
+                yield evaluation_type::async_read(dealer_, work_executor_, record_, std::move(self));
+                dealer_bytes_read_ += bytes_just_written;
+                if (error) asio::detail::throw_error(error, "async_read(evaluation)");
+                probe_.stop(stats::stage::dealer_record, bytes_so_far());
+                dpf_ = record_->dpf;
+                *bvr_ = record_->bvr;
 
+                probe_.start(bytes_so_far());
                 yield dpf::asio::async_assign_wildcard_input(peer_, work_executor_, *dpf_, input_share_, std::move(self));
                 if (error) asio::detail::throw_error(error, "async_assign_wildcard_input");
+                probe_.stop(stats::stage::reveal, bytes_so_far(), 1);
 
-                yield dpf::asio::async_post(work_executor_, [bvr = this->bvr_, dpf = this->dpf_]()mutable
-                {
-                    auto parities = grotto::segment_parities<n,J>(*dpf);
-                    for (std::size_t i = 0; i < twoJ; ++i)
-                    {
-                        if (!parities[i]) continue;
-                        bvr->inner_product += scaled_lut[i];
-                        bvr->sign++;
-                    }
-                }, std::move(self));
-                if (error) asio::detail::throw_error(error, "async_post");
+                probe_.start();
+                yield parities::async_fused_masked_sum<n, n-j>(work_executor_, dpf_, shifted_input_.reduced_value(),
+                    parities::lut_words(), nullptr, parities::default_chunks<n-j>(), std::move(self));
+                if (error) asio::detail::throw_error(error, "async_fused_masked_sum");
+                probe_.stop(stats::stage::lut_eval);
 
+                probe_.start(bytes_so_far());
                 yield async_mult<bits>(dealer_, peer_, work_executor_, bvr_, std::move(self));
                 if (error) asio::detail::throw_error(error, "async_post");
+                probe_.stop(stats::stage::beaver, bytes_so_far(), 1);
             }
             self.complete(error, dealer_bytes_read_, peer_bytes_read_, bytes_written_);
         }
@@ -567,26 +897,214 @@ struct online_Haar_coro : asio::coroutine
     dpf::modint<L> input_share_;
     std::size_t count_;
     std::size_t dealer_bytes_read_, peer_bytes_read_, bytes_written_;
+    std::shared_ptr<evaluation_type> record_;  ///< reused for every dealer read
     std::shared_ptr<dpf_type> dpf_;
     std::shared_ptr<beaver_Haar> bvr_;
+    dpf::modint<L> shifted_input_;
+    stats::probe probe_;
+
+    std::size_t bytes_so_far() const { return dealer_bytes_read_ + peer_bytes_read_ + bytes_written_; }
 #include <asio/unyield.hpp>
 };
 
 template <std::size_t bits,
+          std::size_t j,
+          std::size_t n,
           typename DealerT,
           typename PeerT,
           typename ExecutorT,
           typename CompletionToken>
 [[nodiscard]]
 HEDLEY_ALWAYS_INLINE
-auto async_online_Haar(DealerT & dealer, PeerT & peer, ExecutorT work_executor, dpf::modint<L> input_share, std::size_t count, CompletionToken && token)
+auto async_online_Haar(DealerT & dealer, PeerT & peer, ExecutorT work_executor, dpf::modint<L> input_share, std::size_t count, bool seeded, CompletionToken && token)
 {
     return asio::async_compose<CompletionToken,
         void(asio::error_code,
              std::size_t,
              std::size_t,
-             std::size_t)>(online_Haar_coro<bits, DealerT, PeerT, ExecutorT>{dealer, peer, work_executor, input_share, count},
+             std::size_t)>(online_Haar_coro<bits, j, n, DealerT, PeerT, ExecutorT>{dealer, peer, work_executor, input_share, count, seeded},
               token, dealer, peer, work_executor);
 }
 
+template <std::size_t bits,
+          std::size_t j,
+          std::size_t n,
+          typename DealerT,
+          typename PeerT,
+          typename ExecutorT>
+struct online_Haar_batch_coro : asio::coroutine
+{
+#include <asio/yield.hpp>
+    using evaluation_type = Haar_evaluation<bits, j, n>;
+    using dpf_type = typename evaluation_type::dpf_type;
+  public:
+    online_Haar_batch_coro(DealerT & dealer, PeerT & peer,
+        ExecutorT work_executor, std::vector<dpf::modint<L>> input_shares, bool seeded)
+      : dealer_{dealer}, peer_{peer}, work_executor_{work_executor},
+        input_shares_{std::make_shared<std::vector<dpf::modint<L>>>(std::move(input_shares))},
+        shifted_inputs_{std::make_shared<std::vector<dpf::modint<L>>>()},
+        dpfs_{std::make_shared<std::vector<std::shared_ptr<dpf_type>>>()},
+        bvrs_{std::make_shared<std::vector<beaver_Haar>>()},
+        record_{std::make_shared<evaluation_type>()},
+        iter_{0},
+        dealer_bytes_read_{0}, peer_bytes_read_{0}, bytes_written_{0}
+    {
+        dpfs_->reserve(input_shares_->size());
+        bvrs_->reserve(input_shares_->size());
+        record_->seeded = seeded;
+    }
+
+    template <typename Self>
+    void operator()(Self & self,
+                    const asio::error_code & error,
+                    std::vector<output_type> outputs,
+                    std::size_t bytes_just_read,
+                    std::size_t bytes_just_written)
+    {
+        outputs_ = std::move(outputs);
+        (*this)(self, error, bytes_just_read, bytes_just_written);
+    }
+
+    template <typename Self>
+    void operator()(Self & self,
+                    const asio::error_code & error = {},
+                    std::size_t bytes_just_read = 0,
+                    std::size_t bytes_just_written = 0)
+    {
+        reenter(*this)
+        {
+            // one record at a time, from a stream or a mapped preprocessing file
+            while (iter_++ < input_shares_->size())
+            {
+                probe_.start(bytes_so_far());
+                yield evaluation_type::async_read(dealer_, work_executor_, record_, std::move(self));
+                dealer_bytes_read_ += bytes_just_read;
+                if (error) asio::detail::throw_error(error, "async_read(evaluation)");
+                probe_.stop(stats::stage::dealer_record, bytes_so_far());
+                dpfs_->push_back(std::move(record_->dpf));
+                bvrs_->push_back(record_->bvr);
+            }
+
+            probe_.start(bytes_so_far());
+            yield async_assign_wildcard_inputs(peer_, work_executor_, dpfs_, input_shares_, shifted_inputs_, std::move(self));
+            peer_bytes_read_ += bytes_just_read;
+            bytes_written_ += bytes_just_written;
+            if (error) asio::detail::throw_error(error, "async_assign_wildcard_inputs");
+            probe_.stop(stats::stage::reveal, bytes_so_far(), 1);
+
+            probe_.start();
+            yield async_post_bulk(work_executor_, parities::batch_tiling{dpfs_->size()}.tiles(),
+                [bvrs = this->bvrs_, dpfs = this->dpfs_, shifted_inputs = this->shifted_inputs_](std::size_t t)
+            {
+                parities::batch_tiling tiling{dpfs->size()};
+                auto first = tiling.first(t), size = tiling.size(t);
+                std::array<lut_kernel::masked_sums, parities::max_batch_tile> sums{};
+                parities::fused_masked_sum_batch<n, n-j>(dpfs->data() + first, shifted_inputs->data() + first, size,
+                    parities::lut_words(), nullptr, sums.data());
+                for (std::size_t i = 0; i < size; ++i) Haar_accumulate((*bvrs)[first + i], sums[i]);
+            }, std::move(self));
+            if (error) asio::detail::throw_error(error, "async_post_bulk");
+            probe_.stop(stats::stage::lut_eval);
+
+            probe_.start(bytes_so_far());
+            yield async_mult_batch<bits>(dealer_, peer_, work_executor_, bvrs_, std::move(self));
+            peer_bytes_read_ += bytes_just_read;
+            bytes_written_ += bytes_just_written;
+            if (error) asio::detail::throw_error(error, "async_mult_batch");
+            probe_.stop(stats::stage::beaver, bytes_so_far(), 1);
+
+            self.complete(error, outputs_, dealer_bytes_read_, peer_bytes_read_, bytes_written_);
+        }
+    }
+
+  private:
+    DealerT & dealer_;
+    PeerT & peer_;
+    ExecutorT work_executor_;
+    std::shared_ptr<std::vector<dpf::modint<L>>> input_shares_;
+    std::shared_ptr<std::vector<dpf::modint<L>>> shifted_inputs_;
+    std::shared_ptr<std::vector<std::shared_ptr<dpf_type>>> dpfs_;
+    std::shared_ptr<std::vector<beaver_Haar>> bvrs_;
+    std::shared_ptr<evaluation_type> record_;  ///< reused for every dealer read
+    std::vector<output_type> outputs_;
+    std::size_t iter_;
+    std::size_t dealer_bytes_read_, peer_bytes_read_, bytes_written_;
+    stats::probe probe_;
+
+    std::size_t bytes_so_far() const { return dealer_bytes_read_ + peer_bytes_read_ + bytes_written_; }
+#include <asio/unyield.hpp>
+};
+
+/// evaluates Haar on every share in `input_shares`, reading one set of dealer
+/// values per input and using exactly two peer round trips for the whole
+/// batch (one to reveal the shifted inputs and one for the Beaver products)
+template <std::size_t bits,
+          std::size_t j,
+          std::size_t n,
+          typename DealerT,
+          typename PeerT,
+          typename ExecutorT,
+          typename CompletionToken>
+[[nodiscard]]
+HEDLEY_ALWAYS_INLINE
+auto async_online_Haar_batch(DealerT & dealer, PeerT & peer, ExecutorT work_executor, std::vector<dpf::modint<L>> input_shares, bool seeded, CompletionToken && token)
+{
+    return asio::async_compose<CompletionToken,
+        void(asio::error_code,
+             std::vector<output_type>,
+             std::size_t,
+             std::size_t,
+             std::size_t)>(online_Haar_batch_coro<bits, j, n, DealerT, PeerT, ExecutorT>{dealer, peer, work_executor, std::move(input_shares), seeded},
+              token, dealer, peer, work_executor);
+}
+
+/// like `async_online_Haar`, but keeps up to `window` evaluations in flight
+/// so that dealer reads, DPF evaluation and peer waits overlap; input shares
+/// come from `inputs` and output shares go to `outputs` (see `shares.hpp`)
+template <std::size_t bits,
+          std::size_t j,
+          std::size_t n,
+          typename DealerT,
+          typename PeerT,
+          typename ExecutorT,
+          typename InputT,
+          typename OutputT,
+          typename CompletionToken>
+[[nodiscard]]
+HEDLEY_ALWAYS_INLINE
+auto async_online_Haar_pipelined(DealerT & dealer, PeerT & peer, ExecutorT work_executor, InputT && inputs, OutputT && outputs, std::size_t count, std::size_t window, bool seeded, CompletionToken && token)
+{
+    Haar_evaluation<bits, j, n> prototype;
+    prototype.seeded = seeded;
+    prototype.arena = std::make_shared<recycling_arena>();
+    return async_online_pipeline(dealer, peer, work_executor, prototype,
+        std::forward<InputT>(inputs), std::forward<OutputT>(outputs), count, window,
+        std::forward<CompletionToken>(token));
+}
+
+
+/// like `async_online_Haar_pipelined`, but over a `coalesce::channel`, so
+/// that evaluations exchange with the peer independently and their messages
+/// share packets
+template <std::size_t bits,
+          std::size_t j,
+          std::size_t n,
+          typename DealerT,
+          typename ChannelT,
+          typename ExecutorT,
+          typename InputT,
+          typename OutputT,
+          typename CompletionToken>
+[[nodiscard]]
+HEDLEY_ALWAYS_INLINE
+auto async_online_Haar_coalesced(DealerT & dealer, ChannelT & channel, ExecutorT work_executor, InputT && inputs, OutputT && outputs, std::size_t count, std::size_t window, bool seeded, CompletionToken && token)
+{
+    Haar_evaluation<bits, j, n> prototype;
+    prototype.seeded = seeded;
+    prototype.arena = std::make_shared<recycling_arena>();
+    return async_online_coalesced(dealer, channel, work_executor, prototype,
+        std::forward<InputT>(inputs), std::forward<OutputT>(outputs), count, window,
+        std::forward<CompletionToken>(token));
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,128 @@
+#ifndef ARENA_HPP__
+#define ARENA_HPP__
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+/// A recycling arena for the per-evaluation objects of the online phase.
+///
+/// Every evaluation allocates the same few objects (its DPF, its Beaver
+/// state) and frees them once the evaluation is done; allocating them from a
+/// `recycling_arena` puts each freed block on a free list for its size, so in
+/// the steady state these objects come from the free list rather than the
+/// heap. Blocks are released only when the arena is destroyed, and the arena
+/// is kept alive by every allocator that refers to it.
+///
+/// Objects may be released on a worker thread (e.g., when a posted lambda
+/// holds the last reference), so the free lists are guarded by a mutex; it
+/// is uncontended in practice.
+///
+/// (Handler state for the asio operations themselves is already recycled by
+/// asio's per-thread cache, which is what the default associated allocator
+/// uses, so it is not routed through the arena.)
+class recycling_arena
+{
+  public:
+    static constexpr std::size_t alignment = 64;
+
+    recycling_arena() = default;
+    recycling_arena(const recycling_arena &) = delete;
+    recycling_arena & operator=(const recycling_arena &) = delete;
+
+    ~recycling_arena()
+    {
+        for (auto & bin : bins_)
+        {
+            for (auto block : bin.free) ::operator delete(block, std::align_val_t{alignment});
+        }
+    }
+
+    void * allocate(std::size_t size)
+    {
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            for (auto & bin : bins_)
+            {
+                if (bin.size == size && !bin.free.empty())
+                {
+                    auto block = bin.free.back();
+                    bin.free.pop_back();
+                    return block;
+                }
+            }
+        }
+        return ::operator new(size, std::align_val_t{alignment});
+    }
+
+    void deallocate(void * block, std::size_t size)
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        for (auto & bin : bins_)
+        {
+            if (bin.size == size)
+            {
+                bin.free.push_back(block);
+                return;
+            }
+        }
+        bins_.push_back(size_bin{size, {block}});
+    }
+
+  private:
+    struct size_bin
+    {
+        std::size_t size;
+        std::vector<void *> free;
+    };
+
+    std::mutex mutex_;
+    std::vector<size_bin> bins_;  ///< only a handful of distinct sizes ever occur
+};
+
+/// standard allocator that draws from a shared `recycling_arena`
+template <typename T>
+class arena_allocator
+{
+  public:
+    using value_type = T;
+
+    explicit arena_allocator(std::shared_ptr<recycling_arena> arena) : arena_{std::move(arena)} { }
+
+    template <typename U>
+    arena_allocator(const arena_allocator<U> & other) : arena_{other.arena()} { }
+
+    T * allocate(std::size_t n)
+    {
+        static_assert(alignof(T) <= recycling_arena::alignment, "recycling_arena: over-aligned type");
+        return static_cast<T *>(arena_->allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T * p, std::size_t n) { arena_->deallocate(p, n * sizeof(T)); }
+
+    const std::shared_ptr<recycling_arena> & arena() const { return arena_; }
+
+    template <typename U>
+    bool operator==(const arena_allocator<U> & other) const { return arena_ == other.arena(); }
+
+    template <typename U>
+    bool operator!=(const arena_allocator<U> & other) const { return arena_ != other.arena(); }
+
+  private:
+    std::shared_ptr<recycling_arena> arena_;
+};
+
+/// like `std::make_shared<T>`, but allocates from `arena` (or from the heap
+/// if `arena` is null)
+template <typename T, typename... Args>
+HEDLEY_ALWAYS_INLINE
+std::shared_ptr<T> make_recycled(const std::shared_ptr<recycling_arena> & arena, Args && ... args)
+{
+    if (!arena) return std::make_shared<T>(std::forward<Args>(args)...);
+    return std::allocate_shared<T>(arena_allocator<T>{arena}, std::forward<Args>(args)...);
+}
+
+#endif  // ARENA_HPP__
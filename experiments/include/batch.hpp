@@ -0,0 +1,209 @@
+#ifndef BATCH_HPP__
+#define BATCH_HPP__
+
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <vector>
+
+namespace detail
+{
+
+template <typename Handler, typename Function>
+struct bulk_post_state
+{
+    bulk_post_state(Handler && h, Function && f, std::size_t count)
+      : handler{std::move(h)}, function{std::move(f)}, remaining{count},
+        work{::asio::get_associated_executor(handler)} { }
+
+    Handler handler;
+    Function function;
+    std::atomic<std::size_t> remaining;
+    ::asio::executor_work_guard<::asio::associated_executor_t<Handler>> work;
+    std::mutex mutex;
+    std::exception_ptr exception;
+};
+
+template <typename Handler>
+struct exchange_state
+{
+    explicit exchange_state(Handler && h)
+      : handler{std::move(h)}, work{::asio::get_associated_executor(handler)} { }
+
+    Handler handler;
+    ::asio::executor_work_guard<::asio::associated_executor_t<Handler>> work;
+    ::asio::error_code error{};
+    std::size_t bytes_read = 0, bytes_written = 0;
+    int remaining = 2;  // both halves complete on the peer's (single) thread
+};
+
+template <typename StateT>
+void finish_exchange_half(std::shared_ptr<StateT> st, const ::asio::error_code & error)
+{
+    if (error && !st->error) st->error = error;
+    if (--st->remaining) return;
+    auto ex = ::asio::get_associated_executor(st->handler);
+    ::asio::dispatch(ex, [st]()
+    {
+        st->work.reset();
+        std::move(st->handler)(st->error, st->bytes_read, st->bytes_written);
+    });
+}
+
+}  // namespace detail
+
+/// posts `f(0)`, ..., `f(count-1)` to `work_executor` and completes once
+/// every call has returned; an exception thrown by any call is rethrown
+/// from the completion handler's executor
+template <typename ExecutorT,
+          typename Function,
+          typename CompletionToken>
+[[nodiscard]]
+HEDLEY_ALWAYS_INLINE
+auto async_post_bulk(ExecutorT work_executor, std::size_t count, Function && f, CompletionToken && token)
+{
+    return ::asio::async_initiate<CompletionToken, void(::asio::error_code)>(
+        [work_executor, count](auto handler, auto f) mutable
+        {
+            using state_type = detail::bulk_post_state<decltype(handler), decltype(f)>;
+            if (HEDLEY_UNLIKELY(count == 0))
+            {
+                auto ex = ::asio::get_associated_executor(handler);
+                ::asio::post(ex, [h = std::move(handler)]() mutable { std::move(h)(::asio::error_code{}); });
+                return;
+            }
+            auto st = std::make_shared<state_type>(std::move(handler), std::move(f), count);
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                ::asio::post(work_executor, [st, i]()
+                {
+                    try
+                    {
+                        st->function(i);
+                    }
+                    catch (...)
+                    {
+                        std::lock_guard<std::mutex> lock{st->mutex};
+                        if (!st->exception) st->exception = std::current_exception();
+                    }
+                    if (--st->remaining) return;
+                    auto ex = ::asio::get_associated_executor(st->handler);
+                    ::asio::post(ex, [st]()
+                    {
+                        st->work.reset();
+                        if (st->exception) std::rethrow_exception(st->exception);
+                        std::move(st->handler)(::asio::error_code{});
+                    });
+                });
+            }
+        },
+        token, std::forward<Function>(f));
+}
+
+/// writes `out` to and reads `in` from `peer` concurrently, completing with
+/// the number of bytes read and written once both transfers are done; unlike
+/// a write followed by a read, this cannot deadlock when both peers send
+/// more than the socket buffers can hold
+template <typename PeerT,
+          typename ConstBufferSequence,
+          typename MutableBufferSequence,
+          typename CompletionToken>
+[[nodiscard]]
+HEDLEY_ALWAYS_INLINE
+auto async_exchange(PeerT & peer, const ConstBufferSequence & out, const MutableBufferSequence & in, CompletionToken && token)
+{
+    return ::asio::async_initiate<CompletionToken, void(::asio::error_code,  // error status
+                                                        std::size_t,         // bytes_read
+                                                        std::size_t)>(       // bytes_written
+        [&peer, out, in](auto handler)
+        {
+            using state_type = detail::exchange_state<decltype(handler)>;
+            auto st = std::make_shared<state_type>(std::move(handler));
+            ::asio::async_write(peer, out, [st](const ::asio::error_code & error, std::size_t bytes_written)
+            {
+                st->bytes_written = bytes_written;
+                detail::finish_exchange_half(st, error);
+            });
+            ::asio::async_read(peer, in, [st](const ::asio::error_code & error, std::size_t bytes_read)
+            {
+                st->bytes_read = bytes_read;
+                detail::finish_exchange_half(st, error);
+            });
+        },
+        token);
+}
+
+/// batched counterpart of `dpf::asio::async_assign_wildcard_input`: blinds
+/// each input share with its key's wildcard offset, exchanges all of the
+/// blinded shares with the peer in one message, and then assigns the
+/// reconstructed (shifted) inputs to the keys and to `*shifted_inputs`
+template <typename DpfT,
+          typename InputT,
+          typename PeerT,
+          typename ExecutorT,
+          typename CompletionToken>
+[[nodiscard]]
+HEDLEY_ALWAYS_INLINE
+auto async_assign_wildcard_inputs(PeerT & peer, ExecutorT work_executor,
+    std::shared_ptr<std::vector<std::shared_ptr<DpfT>>> dpfs,
+    std::shared_ptr<std::vector<InputT>> input_shares,
+    std::shared_ptr<std::vector<InputT>> shifted_inputs,
+    CompletionToken && token)
+{
+    #include <asio/yield.hpp>
+    return ::asio::async_compose<
+        CompletionToken, void(::asio::error_code,  // error status
+                              std::size_t,         // bytes_read
+                              std::size_t)>(       // bytes_written
+            [
+                &peer,
+                work_executor,
+                dpfs,
+                input_shares,
+                shifted_inputs,
+                blinded = std::make_shared<std::vector<InputT>>(input_shares->size()),
+                blinded2 = std::make_shared<std::vector<InputT>>(input_shares->size()),
+                bytes_read = std::size_t(0),
+                bytes_written = std::size_t(0),
+                coro = ::asio::coroutine()
+            ]
+            (
+                auto & self,
+                const ::asio::error_code & error = {},
+                std::size_t bytes_just_read = 0,
+                std::size_t bytes_just_written = 0
+            )
+            mutable
+            {
+                reenter (coro)
+                {
+                    yield dpf::asio::async_post(work_executor, [dpfs, input_shares, blinded]()
+                    {
+                        for (std::size_t i = 0; i < blinded->size(); ++i)
+                        {
+                            (*blinded)[i] = (*dpfs)[i]->offset_x.compute_and_get_share((*input_shares)[i]);
+                        }
+                    }, std::move(self));
+
+                    yield async_exchange(peer, ::asio::buffer(*blinded), ::asio::buffer(*blinded2), std::move(self));
+                    bytes_read += bytes_just_read;
+                    bytes_written += bytes_just_written;
+                    if (error) asio::detail::throw_error(error, "async_exchange(blinded)");
+
+                    yield dpf::asio::async_post(work_executor, [dpfs, blinded2, shifted_inputs]()
+                    {
+                        shifted_inputs->resize(blinded2->size());
+                        for (std::size_t i = 0; i < blinded2->size(); ++i)
+                        {
+                            (*shifted_inputs)[i] = (*dpfs)[i]->offset_x.reconstruct((*blinded2)[i]);
+                        }
+                    }, std::move(self));
+
+                    self.complete(error, bytes_read, bytes_written);
+                }
+            },
+        token, peer, work_executor);
+    #include <asio/unyield.hpp>
+}
+
+#endif  // BATCH_HPP__
@@ -1,9 +1,21 @@
 #ifndef BIOR_HPP__
 #define BIOR_HPP__
 
+#include "arena.hpp"
+#include "batch.hpp"
+#include "dealer.hpp"
+#include "parities.hpp"
+#include "pipeline.hpp"
+#include "prepfile.hpp"
+#include "prg.hpp"
+#include "stats.hpp"
 #include "dcf.hpp"
 
-output_type * scaled_lut2;
+/// bior reads both taps from `scaled_lut`: tap 0 of segment `i` is entry
+/// `i` and tap 1 is entry `i+1`, so the table holds one entry past the last
+/// of the `2^J` segments (i.e., `lut.py --wave bior2.2` output rolled by two)
+template <std::size_t J>
+constexpr std::size_t bior_lut_bytes = ((1ul << J) + 1) * sizeof(output_type);
 
 template <std::size_t bits,
           std::size_t j,
@@ -13,7 +25,8 @@ template <std::size_t bits,
           typename CompletionToken>
 [[nodiscard]]
 HEDLEY_ALWAYS_INLINE
-auto async_make_beaver_bior(PeerT & peer0, PeerT & peer1, ExecutorT work_executor, CompletionToken && token)
+auto async_make_beaver_bior(PeerT & peer0, PeerT & peer1, ExecutorT work_executor,
+    std::shared_ptr<const std::array<dpf::modint<bits>, 8>> share0, CompletionToken && token)
 {
     #include <asio/yield.hpp>
     return ::asio::async_compose<
@@ -26,6 +39,7 @@ auto async_make_beaver_bior(PeerT & peer0, PeerT & peer1, ExecutorT work_executo
                 work_executor,
                 bvr0 = std::make_shared<std::array<dpf::modint<bits>, 8>>(),
                 bvr1 = std::make_shared<std::array<dpf::modint<bits>, 8>>(),
+                share0,
                 bytes_written0 = std::size_t(0),
                 bytes_written1 = std::size_t(0),
                 coro = ::asio::coroutine()
@@ -39,28 +53,40 @@ auto async_make_beaver_bior(PeerT & peer0, PeerT & peer1, ExecutorT work_executo
             {
                 reenter (coro)
                 {
-                    yield dpf::asio::async_post(work_executor, [bvr0,bvr1,&self]()
+                    yield dpf::asio::async_post(work_executor, [bvr0,bvr1,share0,&self]()
                     {
+                        // with a fixed `share0`, party 1's share of each value
+                        // is the value minus party 0's (seeded) share
+                        if (share0) *bvr0 = *share0;
+                        auto share = [&](std::size_t i, dpf::modint<bits> value)
+                        {
+                            if (share0) (*bvr1)[i] = value - (*bvr0)[i];
+                            else std::tie((*bvr0)[i], (*bvr1)[i]) = dpf::additively_share(value);
+                        };
+
                         auto U = dpf::uniform_sample<dpf::modint<bits>>();
-                        std::tie((*bvr0)[0], (*bvr1)[0]) = dpf::additively_share(U);
+                        share(0, U);
                         auto A = dpf::uniform_sample<dpf::modint<bits>>();
-                        std::tie((*bvr0)[1], (*bvr1)[1]) = dpf::additively_share(A);
+                        share(1, A);
                         auto B = dpf::uniform_sample<dpf::modint<bits>>();
-                        std::tie((*bvr0)[2], (*bvr1)[2]) = dpf::additively_share(B);
+                        share(2, B);
                         auto X = dpf::uniform_sample<dpf::modint<bits>>();
-                        std::tie((*bvr0)[3], (*bvr1)[3]) = dpf::additively_share(X);
+                        share(3, X);
 
-                        std::tie((*bvr0)[4], (*bvr1)[4]) = dpf::additively_share(A*X-B);
-                        std::tie((*bvr0)[5], (*bvr1)[5]) = dpf::additively_share(U*X);
-                        std::tie((*bvr0)[6], (*bvr1)[6]) = dpf::additively_share(U*A);
-                        std::tie((*bvr0)[7], (*bvr1)[7]) = dpf::additively_share(U*(A*X-B));
+                        share(4, A*X-B);
+                        share(5, U*X);
+                        share(6, U*A);
+                        share(7, U*(A*X-B));
                     }, std::move(self));
 
-                    yield ::asio::async_write(peer0, asio::buffer(*bvr0, sizeof(*bvr0)), std::move(self));
+                    if (!share0)
+                    {
+                        yield ::asio::async_write(peer0, asio::buffer(*bvr0, sizeof(*bvr0)), std::move(self));
 
-                    bytes_written0 += bytes_just_written;
+                        bytes_written0 += bytes_just_written;
 
-                    if (error) asio::detail::throw_error(error, "async_write");
+                        if (error) asio::detail::throw_error(error, "async_write");
+                    }
 
                     yield ::asio::async_write(peer1, asio::buffer(*bvr1, sizeof(*bvr1)), std::move(self));
 
@@ -154,6 +180,8 @@ struct beaver
         ready_{false} { }
     beaver(beaver &&) = default;
     beaver(const beaver &) = default;
+    beaver & operator=(beaver &&) = default;
+    beaver & operator=(const beaver &) = default;
 
     auto get_blinded_operands()
     {
@@ -235,6 +263,20 @@ struct beaver
     bool ready_;
 };
 
+/// sets the dealer-supplied values of `bvr`, in the order the dealer sends them
+HEDLEY_ALWAYS_INLINE
+void assign_beaver_bior(beaver & bvr, const std::array<dpf::modint<L>, 8> & values)
+{
+    bvr.sign_blind = values[0];
+    bvr.inner_product0_blind = values[1];
+    bvr.inner_product1_blind = values[2];
+    bvr.coefficient_blind = values[3];
+    bvr.correction_coeff_inner0_minus_inner1 = values[4];
+    bvr.correction_sign_coeff = values[5];
+    bvr.correction_sign_inner0 = values[6];
+    bvr.correction_sign_coeff_inner0_minus_inner1 = values[7];
+}
+
 template <std::size_t bits,
           std::size_t j,
           std::size_t n,
@@ -288,6 +330,26 @@ auto async_read_beaver_bior(DealerT & dealer, ExecutorT work_executor, Completio
     #include <asio/unyield.hpp>
 }
 
+/// in compressed mode, party 0 receives one seed per index in place of its
+/// `(r, rr)` shares and Beaver shares; expanding it yields those shares in
+/// the order they would otherwise have been read
+struct seeded_bior_shares
+{
+    explicit seeded_bior_shares(const prg::seed_type & seed)
+    {
+        auto shares = prg::expand_shares<dpf::modint<L>, 10>(seed);
+        r = shares[0];
+        rr = shares[1];
+        assign_beaver_bior(bvr, {shares[2], shares[3], shares[4], shares[5],
+                                 shares[6], shares[7], shares[8], shares[9]});
+    }
+
+    dpf::modint<L> r, rr;
+    beaver bvr;
+};
+
+/// generates `count` indices one after another; `async_make_preprocess_bior`
+/// runs many of these concurrently, one per chunk of indices
 template <std::size_t bits,
           std::size_t j,
           std::size_t n,
@@ -296,7 +358,7 @@ template <std::size_t bits,
           typename CompletionToken>
 [[nodiscard]]
 HEDLEY_ALWAYS_INLINE
-auto async_make_preprocess_bior(PeerT & peer0, PeerT & peer1, ExecutorT work_executor, std::size_t count, CompletionToken && token)
+auto async_make_preprocess_bior_serial(PeerT & peer0, PeerT & peer1, ExecutorT work_executor, std::size_t count, bool compressed, CompletionToken && token)
 {
     #include <asio/yield.hpp>
     return ::asio::async_compose<
@@ -310,9 +372,12 @@ auto async_make_preprocess_bior(PeerT & peer0, PeerT & peer1, ExecutorT work_exe
                 r = std::make_shared<dpf::modint<bits>>(),
                 rshare = std::make_shared<std::pair<dpf::modint<bits>, dpf::modint<bits>>>(),
                 rrshare = std::make_shared<std::pair<dpf::modint<bits>, dpf::modint<bits>>>(),
+                seed = std::make_shared<prg::seed_type>(),
+                bvr0 = std::make_shared<std::array<dpf::modint<bits>, 8>>(),
                 bytes_written0 = std::size_t(0),
                 bytes_written1 = std::size_t(0),
                 count,
+                compressed,
                 iter = std::size_t(0),
                 coro = ::asio::coroutine()
             ]
@@ -329,18 +394,35 @@ auto async_make_preprocess_bior(PeerT & peer0, PeerT & peer1, ExecutorT work_exe
                 {
                     while (iter++ < count)
                     {
-                        yield dpf::asio::async_post(work_executor, [r,rshare,rrshare,&self]()
+                        yield dpf::asio::async_post(work_executor, [r,rshare,rrshare,seed,bvr0,compressed,&self]()
                         {
                             *r = dpf::uniform_sample<dpf::modint<bits>>();
+                            dpf::modint<bits> rr = (r->reduced_value() >> L-n) % (1ul << j);
+                            if (compressed)
+                            {
+                                *seed = prg::make_seed();
+                                auto shares = prg::expand_shares<dpf::modint<bits>, 10>(*seed);
+                                *rshare = std::make_pair(shares[0], *r - shares[0]);
+                                *rrshare = std::make_pair(shares[1], rr - shares[1]);
+                                std::copy(shares.begin() + 2, shares.end(), bvr0->begin());
+                                return;
+                            }
                             *rshare = dpf::additively_share(*r);
-                            *rrshare = dpf::additively_share((r->reduced_value() >> L-n) % (1ul << j));
+                            *rrshare = dpf::additively_share(rr);
                         }, std::move(self));
 
-                        yield asio::async_write(peer0, std::array<asio::const_buffer, 2>
+                        if (compressed)
                         {
-                            asio::buffer(&rshare->first, sizeof(rshare->first)),
-                            asio::buffer(&rrshare->first, sizeof(rrshare->first))
-                        }, std::move(self));
+                            yield asio::async_write(peer0, asio::buffer(*seed), std::move(self));
+                        }
+                        else
+                        {
+                            yield asio::async_write(peer0, std::array<asio::const_buffer, 2>
+                            {
+                                asio::buffer(&rshare->first, sizeof(rshare->first)),
+                                asio::buffer(&rrshare->first, sizeof(rrshare->first))
+                            }, std::move(self));
+                        }
                         bytes_written0 += bytes_just_written0;
                         if (error) asio::detail::throw_error(error, "async_write(r0,rr0)");
 
@@ -368,7 +450,8 @@ auto async_make_preprocess_bior(PeerT & peer0, PeerT & peer1, ExecutorT work_exe
                         bytes_written1 += bytes_just_written1;
                         if (error) asio::detail::throw_error(error, "async_make_dcf");
 
-                        yield async_make_beaver_bior<L,j,n>(peer0, peer1, work_executor, std::move(self));
+                        yield async_make_beaver_bior<L,j,n>(peer0, peer1, work_executor,
+                            compressed ? bvr0 : nullptr, std::move(self));
                         bytes_written0 += bytes_just_written0;
                         bytes_written1 += bytes_just_written1;
                         if (error) asio::detail::throw_error(error, "async_make_beaver_bior");
@@ -380,6 +463,25 @@ auto async_make_preprocess_bior(PeerT & peer0, PeerT & peer1, ExecutorT work_exe
     #include <asio/unyield.hpp>
 }
 
+template <std::size_t bits,
+          std::size_t j,
+          std::size_t n,
+          typename PeerT,
+          typename ExecutorT,
+          typename CompletionToken>
+[[nodiscard]]
+HEDLEY_ALWAYS_INLINE
+auto async_make_preprocess_bior(PeerT & peer0, PeerT & peer1, ExecutorT work_executor, std::size_t count, bool compressed, CompletionToken && token)
+{
+    return async_make_preprocess_parallel(peer0, peer1, work_executor, count,
+        default_dealer_chunk, default_dealer_window(),
+        [compressed](auto & stream0, auto & stream1, auto strand, std::size_t size, auto && handler)
+        {
+            async_make_preprocess_bior_serial<bits, j, n>(stream0, stream1, strand, size, compressed, std::move(handler));
+        },
+        token);
+}
+
 template <std::size_t bits,
           std::size_t j,
           std::size_t n,
@@ -400,10 +502,15 @@ struct read_preprocess_bior_coro : asio::coroutine
     using dpf_values = std::tuple<correction_words_array, correction_advice_array, dpf_priv_values>;
   public:
     read_preprocess_bior_coro(DealerT & dealer, asio::stream_file & outfile,
-        ExecutorT work_executor, std::size_t count)
+        ExecutorT work_executor, std::size_t count, bool seeded)
       : dealer_{dealer}, outfile_{outfile}, work_executor_{work_executor},
         r_{std::make_shared<dpf::modint<L>>(0)}, rr_{std::make_shared<dpf::modint<L>>(0)},
-        count_{count},
+        seed_{std::make_shared<prg::seed_type>()},
+        count_{count}, seeded_{seeded},
+        writer_{std::make_shared<prepfile::writer>(prepfile::make_header(prepfile::transform_t::bior,
+            bits, n, n-j, seeded, count))},
+        record_{std::make_shared<prepfile::record_builder>()},
+        dcf_lo_{std::make_shared<dcf_key_buffer>()}, dcf_hi_{std::make_shared<dcf_key_buffer>()},
         bytes_read_{0}, bytes_written_{0} { }
 
     template <typename Self>
@@ -424,8 +531,6 @@ struct read_preprocess_bior_coro : asio::coroutine
                     std::size_t bytes_just_read)
     {
         bytes_read_ += bytes_just_read;
-        if (dcf_lo_) dcf_hi_ = std::make_shared<DCFKeyPack>(dcf);
-        else dcf_lo_ = std::make_shared<DCFKeyPack>(dcf);
         (*this)(self, error);
     }
 
@@ -447,68 +552,63 @@ struct read_preprocess_bior_coro : asio::coroutine
     {
         reenter(*this)
         {
+            outfile_.seek(writer_->data_offset(), asio::stream_file::seek_set);
+
             while (count_--)
             {
+                if (seeded_)
+                {
+                    yield asio::async_read(dealer_, asio::buffer(*seed_), std::move(self));
+                    bytes_read_ += bytes_just_written;
+                    if (error) asio::detail::throw_error(error, "async_read(seed)");
+                }
+                else
+                {
+                    yield asio::async_read(dealer_, std::array<asio::mutable_buffer, 2>{
+                        asio::buffer(&*r_, sizeof(*r_)),
+                        asio::buffer(&*rr_, sizeof(*rr_))
+                    }, std::move(self));
+                    bytes_read_ += bytes_just_written;
+                    if (error) asio::detail::throw_error(error, "async_read(r,rr)");
+                }
+
                 yield dpf::asio::async_read_dpf_inner<dpf_type>(dealer_, work_executor_, std::move(self));
                 if (error) asio::detail::throw_error(error, "async_read_dpf_inner");
 
-                yield asio::async_write(outfile_, asio::buffer(&*dpf_, sizeof(*dpf_)), std::move(self));
-                bytes_written_ += bytes_just_written;
-                if (error) asio::detail::throw_error(error, "async_write(dpf)");
-
-                yield asio::async_read(dealer_, std::array<asio::mutable_buffer, 2>{
-                    asio::buffer(&*r_, sizeof(*r_)),
-                    asio::buffer(&*rr_, sizeof(*rr_))
-                }, std::move(self));
-                bytes_read_ += bytes_just_written;
-                if (error) asio::detail::throw_error(error, "async_read(r,rr)");
-
-                yield asio::async_write(outfile_, std::array<asio::const_buffer, 2>
-                {
-                    asio::buffer(&*r_, sizeof(*r_)),
-                    asio::buffer(&*rr_, sizeof(*rr_))
-                }, std::move(self));
-                bytes_written_ += bytes_just_written;
-                if (error) asio::detail::throw_error(error, "async_write(r,rr)");
-
-                yield async_read_dcf<bits-n-j>(dealer_, work_executor_, std::move(self));
+                yield async_read_dcf<bits-n>(dealer_, work_executor_, *dcf_lo_, std::move(self));
                 if (error) asio::detail::throw_error(error, "async_read_dcf(lo)");
 
-                yield asio::async_write(outfile_, std::array<asio::const_buffer, 6>
-                {
-                    asio::buffer(&dcf_lo_->Bin, sizeof(int)),
-                    asio::buffer(&dcf_lo_->Bout, sizeof(int)),
-                    asio::buffer(&dcf_lo_->groupSize, sizeof(int)),
-                    asio::buffer(dcf_lo_->k, (dcf_lo_->Bin + 1) * sizeof(osuCrypto::block)),
-                    asio::buffer(dcf_lo_->g, dcf_lo_->groupSize * sizeof(GroupElement)),
-                    asio::buffer(dcf_lo_->v, dcf_lo_->Bin * dcf_lo_->groupSize * sizeof(GroupElement))
-                }, std::move(self));
-                bytes_written_ += bytes_just_written;
-                if (error) asio::detail::throw_error(error, "async_write(dcf_lo)");
-
-                yield async_read_dcf<bits-n>(dealer_, work_executor_, std::move(self));
+                yield async_read_dcf<bits-n+j>(dealer_, work_executor_, *dcf_hi_, std::move(self));
                 if (error) asio::detail::throw_error(error, "async_read_dcf(hi)");
 
-                yield asio::async_write(outfile_, std::array<asio::const_buffer, 6>
+                if (!seeded_)
                 {
-                    asio::buffer(&dcf_hi_->Bin, sizeof(int)),
-                    asio::buffer(&dcf_hi_->Bout, sizeof(int)),
-                    asio::buffer(&dcf_hi_->groupSize, sizeof(int)),
-                    asio::buffer(dcf_hi_->k, (dcf_hi_->Bin + 1) * sizeof(osuCrypto::block)),
-                    asio::buffer(dcf_hi_->g, dcf_hi_->groupSize * sizeof(GroupElement)),
-                    asio::buffer(dcf_hi_->v, dcf_hi_->Bin * dcf_hi_->groupSize * sizeof(GroupElement))
-                }, std::move(self));
-                bytes_written_ += bytes_just_written;
-                if (error) asio::detail::throw_error(error, "async_write(dcf_lo)");
-
-                yield async_read_beaver_bior_inner<L,j,n>(dealer_, work_executor_, std::move(self));
-                if (error) asio::detail::throw_error(error, "async_make_beaver_bior");
+                    yield async_read_beaver_bior_inner<L,j,n>(dealer_, work_executor_, std::move(self));
+                    if (error) asio::detail::throw_error(error, "async_make_beaver_bior");
+                }
 
-                yield asio::async_write(outfile_, asio::buffer(&*bvr_, sizeof(*bvr_)), std::move(self));
+                // record layout: (r, rr) (or the seed), dpf_values, dcf_lo,
+                // dcf_hi, then the Beaver values unless seeded
+                record_->clear();
+                if (seeded_) record_->append(*seed_);
+                else record_->append(std::array<dpf::modint<L>, 2>{*r_, *rr_});
+                record_->append(*dpf_);
+                append_dcf(*record_, dcf_lo_->key());
+                append_dcf(*record_, dcf_hi_->key());
+                if (!seeded_) record_->append(*bvr_);
+                record_->finish();
+                writer_->add_record(record_->bytes().size());
+
+                yield asio::async_write(outfile_, asio::buffer(record_->bytes()), std::move(self));
                 bytes_written_ += bytes_just_written;
-                if (error) asio::detail::throw_error(error, "async_write(beaver)");
+                if (error) asio::detail::throw_error(error, "async_write(record)");
             }
 
+            outfile_.seek(0, asio::stream_file::seek_set);
+            yield asio::async_write(outfile_, writer_->finish(), std::move(self));
+            bytes_written_ += bytes_just_written;
+            if (error) asio::detail::throw_error(error, "async_write(header)");
+
             self.complete(error, bytes_read_, bytes_written_);
         }
     }
@@ -520,9 +620,13 @@ struct read_preprocess_bior_coro : asio::coroutine
     std::size_t count_;
     std::size_t bytes_read_, bytes_written_;
     std::shared_ptr<dpf::modint<L>> r_, rr_;
+    std::shared_ptr<prg::seed_type> seed_;
+    bool seeded_;
+    std::shared_ptr<prepfile::writer> writer_;
+    std::shared_ptr<prepfile::record_builder> record_;
     std::shared_ptr<dpf_values> dpf_;
-    std::shared_ptr<DCFKeyPack> dcf_lo_;
-    std::shared_ptr<DCFKeyPack> dcf_hi_;
+    std::shared_ptr<dcf_key_buffer> dcf_lo_;
+    std::shared_ptr<dcf_key_buffer> dcf_hi_;
     std::shared_ptr<std::array<dpf::modint<bits>, 8>> bvr_;
 #include <asio/unyield.hpp>
 };
@@ -536,12 +640,12 @@ template <std::size_t bits,
           typename CompletionToken>
 [[nodiscard]]
 HEDLEY_ALWAYS_INLINE
-auto async_read_preprocess_bior(DealerT & dealer, OutfileT & outfile, ExecutorT work_executor, std::size_t count, CompletionToken && token)
+auto async_read_preprocess_bior(DealerT & dealer, OutfileT & outfile, ExecutorT work_executor, std::size_t count, bool seeded, CompletionToken && token)
 {
     return asio::async_compose<CompletionToken,
         void(asio::error_code,
              std::size_t,
-             std::size_t)>(read_preprocess_bior_coro<bits, j, n, DealerT, ExecutorT>{dealer, outfile, work_executor, count},
+             std::size_t)>(read_preprocess_bior_coro<bits, j, n, DealerT, ExecutorT>{dealer, outfile, work_executor, count, seeded},
         token, dealer, outfile, work_executor);
 }
 
@@ -612,6 +716,8 @@ struct mult_coro : asio::coroutine
 };
 
 template <std::size_t bits,
+          std::size_t j,
+          std::size_t n,
           typename DealerT,
           typename PeerT,
           typename ExecutorT,
@@ -634,10 +740,223 @@ template <std::size_t bits,
           typename DealerT,
           typename PeerT,
           typename ExecutorT>
-struct online_bior_coro : asio::coroutine
+struct mult_batch_coro : asio::coroutine
 {
 #include <asio/yield.hpp>
+  public:
+    mult_batch_coro(DealerT & dealer, PeerT & peer,
+        ExecutorT work_executor, std::shared_ptr<std::vector<beaver>> bvrs)
+      : dealer_{dealer}, peer_{peer}, work_executor_{work_executor},
+        bvrs_{std::move(bvrs)},
+        blinded_{std::make_shared<std::vector<dpf::modint<L>>>(4 * bvrs_->size())},
+        blinded2_{std::make_shared<std::vector<dpf::modint<L>>>(4 * bvrs_->size())},
+        outputs_{std::make_shared<std::vector<output_type>>(bvrs_->size())},
+        bytes_read_{0}, bytes_written_{0} { }
+
+    template <typename Self>
+    void operator()(Self & self,
+                    const asio::error_code & error = {},
+                    std::size_t bytes_just_read = 0,
+                    std::size_t bytes_just_written = 0)
+    {
+        reenter(*this)
+        {
+            yield dpf::asio::async_post(work_executor_, [bvrs = this->bvrs_, blinded = this->blinded_]()
+            {
+                for (std::size_t i = 0; i < bvrs->size(); ++i)
+                {
+                    std::tie((*blinded)[4*i], (*blinded)[4*i+1], (*blinded)[4*i+2], (*blinded)[4*i+3])
+                        = (*bvrs)[i].get_blinded_operands();
+                }
+            }, std::move(self));
+
+            yield async_exchange(peer_, asio::buffer(*blinded_), asio::buffer(*blinded2_), std::move(self));
+            bytes_read_ += bytes_just_read;
+            bytes_written_ += bytes_just_written;
+            if (error) asio::detail::throw_error(error, "async_exchange(blinded)");
+
+            yield dpf::asio::async_post(work_executor_, [bvrs = this->bvrs_, blinded2 = this->blinded2_, outputs = this->outputs_]()
+            {
+                for (std::size_t i = 0; i < bvrs->size(); ++i)
+                {
+                    auto & bvr = (*bvrs)[i];
+                    bvr.blinded_sign2 = (*blinded2)[4*i];
+                    bvr.blinded_inner_product02 = (*blinded2)[4*i+1];
+                    bvr.blinded_inner_product12 = (*blinded2)[4*i+2];
+                    bvr.blinded_coefficient2 = (*blinded2)[4*i+3];
+                    (*outputs)[i] = bvr.do_evaluation();
+                }
+            }, std::move(self));
+
+            self.complete(error, *outputs_, bytes_read_, bytes_written_);
+        }
+    }
+
+  private:
+    DealerT & dealer_;
+    PeerT & peer_;
+    ExecutorT work_executor_;
+    std::shared_ptr<std::vector<beaver>> bvrs_;
+    std::shared_ptr<std::vector<dpf::modint<L>>> blinded_, blinded2_;
+    std::shared_ptr<std::vector<output_type>> outputs_;
+    std::size_t bytes_read_, bytes_written_;
+#include <asio/unyield.hpp>
+};
+
+/// multiplies every `(sign, inner_product0, inner_product1, coefficient)`
+/// tuple in `*bvrs` using a single exchange of blinded operands with the peer
+template <std::size_t bits,
+          std::size_t j,
+          std::size_t n,
+          typename DealerT,
+          typename PeerT,
+          typename ExecutorT,
+          typename CompletionToken>
+[[nodiscard]]
+HEDLEY_ALWAYS_INLINE
+auto async_mult_batch(DealerT & dealer, PeerT & peer, ExecutorT work_executor, std::shared_ptr<std::vector<beaver>> bvrs, CompletionToken && token)
+{
+    return asio::async_compose<CompletionToken,
+        void(asio::error_code,
+            std::vector<output_type> outputs,
+            std::size_t,
+            std::size_t)>(mult_batch_coro<bits, j, n, DealerT, PeerT, ExecutorT>{dealer, peer, work_executor, std::move(bvrs)},
+        token, dealer, peer, work_executor);
+}
+
+/// computes the carry/borrow-corrected coefficient for one bior evaluation
+/// into `bvr.coefficient`
+template <std::size_t j,
+          std::size_t n>
+HEDLEY_ALWAYS_INLINE
+void bior_coefficient(bool party, std::size_t shifted_input, dpf::modint<L> rr,
+    const DCFKeyPack & dcf_lo, const DCFKeyPack & dcf_hi, beaver & bvr)
+{
+    /// compute [lsb_j(msb_n(a))
+    GroupElement carry{0};
+    GroupElement borrow{0};
+    evalDCF(party, &carry, GroupElement(shifted_input&(1ul<<(L-n)), L-n), dcf_lo);
+    evalDCF(party, &borrow, GroupElement(shifted_input&(1ul<<(L-(n-j))), L-(n-j)), dcf_hi);
+    bvr.party_ = party;
+    bvr.coefficient = rr - ((shifted_input>>(L-n)&(1ul<<j)))-1+carry.value-borrow.value;
+}
+
+/// adds a (two-tap) masked LUT reduction into the inner products and sign
+HEDLEY_ALWAYS_INLINE
+void bior_accumulate(beaver & bvr, const lut_kernel::masked_sums & sums)
+{
+    bvr.inner_product0 += dpf::modint<L>(sums.sum0);
+    bvr.inner_product1 += dpf::modint<L>(sums.sum1);
+    bvr.sign += dpf::modint<L>(sums.count);
+}
+
+/// computes the carry/borrow-corrected coefficient and both LUT inner
+/// products for one bior evaluation into the multiplicands of `bvr`
+template <std::size_t j,
+          std::size_t n,
+          typename DpfT>
+HEDLEY_ALWAYS_INLINE
+void bior_inner_product(bool party, std::size_t shifted_input, dpf::modint<L> rr,
+    const DCFKeyPack & dcf_lo, const DCFKeyPack & dcf_hi, const DpfT & dpf, beaver & bvr)
+{
+    bior_coefficient<j, n>(party, shifted_input, rr, dcf_lo, dcf_hi, bvr);
+    auto lut = parities::lut_words();
+    bior_accumulate(bvr, parities::fused_masked_sum<n, n-j>(dpf, shifted_input, lut, lut + 1));
+}
+
+/// per-evaluation state for `async_online_bior_pipelined`
+template <std::size_t bits,
+          std::size_t j,
+          std::size_t n>
+struct bior_evaluation
+{
     using dpf_type = DEDUCE_DPF_TYPE_T(dpf::wildcard_value<dpf::modint<bits>>{});
+
+    void blind_input(dpf::modint<L> input_share)
+    {
+        blinded_input = dpf->offset_x.compute_and_get_share(input_share);
+    }
+
+    void compute()
+    {
+        auto shifted_input = dpf->offset_x.reconstruct(blinded_input2);
+        bior_inner_product<j, n>(party, shifted_input.reduced_value(), rr, dcf_lo, dcf_hi, *dpf, bvr);
+        std::tie(operands[0], operands[1], operands[2], operands[3]) = bvr.get_blinded_operands();
+    }
+
+    auto finish()
+    {
+        bvr.blinded_sign2 = operands2[0];
+        bvr.blinded_inner_product02 = operands2[1];
+        bvr.blinded_inner_product12 = operands2[2];
+        bvr.blinded_coefficient2 = operands2[3];
+        return bvr.do_evaluation();
+    }
+
+    template <typename DealerT, typename ExecutorT, typename CompletionToken>
+    static auto async_read(DealerT & dealer, ExecutorT work_executor,
+        std::shared_ptr<bior_evaluation> evaluation, CompletionToken && token);
+
+    template <typename ExecutorT, typename CompletionToken>
+    static auto async_read(prepfile::mapped_file & dealer, ExecutorT,
+        std::shared_ptr<bior_evaluation> evaluation, CompletionToken && token)
+    {
+        return prepfile::async_load(dealer, std::move(evaluation), std::forward<CompletionToken>(token));
+    }
+
+    /// takes this evaluation's dealer values from a mapped record (see
+    /// `read_preprocess_bior_coro` for the layout) and returns its size; the
+    /// DCF keys' blocks point into the mapping
+    std::size_t load(prepfile::record_cursor record)
+    {
+        using dpf_values = std::tuple<typename dpf_type::correction_words_array,
+            typename dpf_type::correction_advice_array,
+            std::tuple<typename dpf_type::interior_node, typename dpf_type::leaf_tuple,
+                typename dpf_type::beaver_tuple, typename dpf_type::input_type>>;
+        if (seeded)
+        {
+            seeded_bior_shares shares{record.next<prg::seed_type>()};
+            r = shares.r;
+            rr = shares.rr;
+            bvr = shares.bvr;
+        }
+        else
+        {
+            auto & mask = record.next<std::array<dpf::modint<L>, 2>>();
+            r = mask[0];
+            rr = mask[1];
+        }
+        auto & [correction_words, correction_advice, priv] = record.next<dpf_values>();
+        auto & [root, leaves, beavers, offset_share] = priv;
+        dpf = make_recycled<dpf_type>(arena, root, correction_words, correction_advice,
+            leaves, beavers, offset_share);
+        dcf_lo = load_dcf(record, bits-n, dcf_lo_buffer);
+        dcf_hi = load_dcf(record, bits-n+j, dcf_hi_buffer);
+        if (!seeded) assign_beaver_bior(bvr, record.next<std::array<dpf::modint<L>, 8>>());
+        return record.bytes_read();
+    }
+
+    bool party;
+    bool seeded = false;  ///< whether the dealer sends a seed for `r`, `rr` and `bvr`
+    std::shared_ptr<recycling_arena> arena;  ///< where `dpf` is allocated (shared by all slots)
+    dpf::modint<L> r, rr;
+    std::shared_ptr<dpf_type> dpf;
+    DCFKeyPack dcf_lo, dcf_hi;
+    dcf_key_buffer dcf_lo_buffer, dcf_hi_buffer;  ///< unpacked storage for `dcf_lo`/`dcf_hi`
+    beaver bvr;
+    dpf::modint<L> blinded_input, blinded_input2;
+    std::array<dpf::modint<L>, 4> operands, operands2;
+};
+
+template <std::size_t bits,
+          std::size_t j,
+          std::size_t n,
+          typename DealerT,
+          typename ExecutorT>
+struct read_bior_evaluation_coro : asio::coroutine
+{
+#include <asio/yield.hpp>
+    using dpf_type = typename bior_evaluation<bits, j, n>::dpf_type;
     using correction_words_array = typename dpf_type::correction_words_array;
     using correction_advice_array = typename dpf_type::correction_advice_array;
     using interior_node = typename dpf_type::interior_node;
@@ -648,13 +967,11 @@ struct online_bior_coro : asio::coroutine
     using dpf_priv_values = std::tuple<interior_node, leaf_tuple, beaver_tuple, input_type>;
     using dpf_values = std::tuple<correction_words_array, correction_advice_array, dpf_priv_values>;
   public:
-    online_bior_coro(DealerT & dealer, PeerT & peer,
-        ExecutorT work_executor, bool party, dpf::modint<L> input_share,
-        std::size_t count)
-      : dealer_{dealer}, peer_{peer}, work_executor_{work_executor},
-        r_{std::make_shared<dpf::modint<L>>(0)}, rr_{std::make_shared<dpf::modint<L>>(0)},
-        party_{party}, input_share_{input_share}, count_{count},
-        dealer_bytes_read_{0}, peer_bytes_read_{0}, bytes_written_{0} { }
+    read_bior_evaluation_coro(DealerT & dealer, ExecutorT work_executor,
+        std::shared_ptr<bior_evaluation<bits, j, n>> evaluation)
+      : dealer_{dealer}, work_executor_{work_executor},
+        evaluation_{std::move(evaluation)}, seed_{std::make_shared<prg::seed_type>()},
+        dcfs_read_{0}, bytes_read_{0} { }
 
     template <typename Self>
     void operator()(Self & self,
@@ -662,10 +979,10 @@ struct online_bior_coro : asio::coroutine
                     std::size_t bytes_just_read,
                     dpf_values dpf)
     {
-        dealer_bytes_read_ += bytes_just_read;
+        bytes_read_ += bytes_just_read;
         auto & [correction_words, correction_advice, priv] = dpf;
         auto & [root, leaves, beavers, offset_share] = priv;
-        dpf_ = std::make_shared<dpf_type>(root, correction_words, correction_advice,
+        evaluation_->dpf = make_recycled<dpf_type>(evaluation_->arena, root, correction_words, correction_advice,
             leaves, beavers, offset_share);
         (*this)(self, error);
     }
@@ -676,9 +993,9 @@ struct online_bior_coro : asio::coroutine
                     DCFKeyPack dcf,
                     std::size_t bytes_just_read)
     {
-        dealer_bytes_read_ += bytes_just_read;
-        if (dcf_lo_) dcf_hi_ = std::make_unique<DCFKeyPack>(dcf);
-        else dcf_lo_ = std::make_unique<DCFKeyPack>(dcf);
+        bytes_read_ += bytes_just_read;
+        if (dcfs_read_++) evaluation_->dcf_hi = dcf;
+        else evaluation_->dcf_lo = dcf;
         (*this)(self, error);
     }
 
@@ -688,11 +1005,107 @@ struct online_bior_coro : asio::coroutine
                     beaver bvr,
                     std::size_t bytes_just_read)
     {
-        dealer_bytes_read_ += bytes_just_read;
-        bvr_ = std::make_shared<beaver>(bvr);
+        bytes_read_ += bytes_just_read;
+        evaluation_->bvr = std::move(bvr);
         (*this)(self, error);
     }
 
+    template <typename Self>
+    void operator()(Self & self,
+                    const asio::error_code & error = {},
+                    std::size_t bytes_just_read = 0)
+    {
+        reenter(*this)
+        {
+            if (evaluation_->seeded)
+            {
+                yield asio::async_read(dealer_, asio::buffer(*seed_), std::move(self));
+            }
+            else
+            {
+                yield asio::async_read(dealer_, std::array<asio::mutable_buffer, 2>{
+                    asio::buffer(&evaluation_->r, sizeof(evaluation_->r)),
+                    asio::buffer(&evaluation_->rr, sizeof(evaluation_->rr))
+                }, std::move(self));
+            }
+            bytes_read_ += bytes_just_read;
+            if (error) asio::detail::throw_error(error, "async_read(r,rr)");
+
+            if (evaluation_->seeded)
+            {
+                seeded_bior_shares shares{*seed_};
+                evaluation_->r = shares.r;
+                evaluation_->rr = shares.rr;
+                evaluation_->bvr = shares.bvr;
+            }
+
+            yield dpf::asio::async_read_dpf_inner<dpf_type>(dealer_, work_executor_, std::move(self));
+            if (error) asio::detail::throw_error(error, "async_read_dpf_inner");
+
+            yield async_read_dcf<bits-n>(dealer_, work_executor_, evaluation_->dcf_lo_buffer, std::move(self));
+            if (error) asio::detail::throw_error(error, "async_read_dcf(lo)");
+
+            yield async_read_dcf<bits-n+j>(dealer_, work_executor_, evaluation_->dcf_hi_buffer, std::move(self));
+            if (error) asio::detail::throw_error(error, "async_read_dcf(hi)");
+
+            if (!evaluation_->seeded)
+            {
+                yield async_read_beaver_bior<bits,j,n>(dealer_, work_executor_, std::move(self));
+                if (error) asio::detail::throw_error(error, "async_read_beaver_bior");
+            }
+
+            self.complete(error, bytes_read_);
+        }
+    }
+
+  private:
+    DealerT & dealer_;
+    ExecutorT work_executor_;
+    std::shared_ptr<bior_evaluation<bits, j, n>> evaluation_;
+    std::shared_ptr<prg::seed_type> seed_;
+    std::size_t dcfs_read_;
+    std::size_t bytes_read_;
+#include <asio/unyield.hpp>
+};
+
+template <std::size_t bits,
+          std::size_t j,
+          std::size_t n>
+template <typename DealerT, typename ExecutorT, typename CompletionToken>
+auto bior_evaluation<bits, j, n>::async_read(DealerT & dealer, ExecutorT work_executor,
+    std::shared_ptr<bior_evaluation> evaluation, CompletionToken && token)
+{
+    return asio::async_compose<CompletionToken,
+        void(asio::error_code,
+             std::size_t)>(read_bior_evaluation_coro<bits, j, n, DealerT, ExecutorT>{dealer, work_executor, std::move(evaluation)},
+        token, dealer, work_executor);
+}
+
+template <std::size_t bits,
+          std::size_t j,
+          std::size_t n,
+          typename DealerT,
+          typename PeerT,
+          typename ExecutorT>
+struct online_bior_coro : asio::coroutine
+{
+#include <asio/yield.hpp>
+    using evaluation_type = bior_evaluation<bits, j, n>;
+    using dpf_type = typename evaluation_type::dpf_type;
+  public:
+    online_bior_coro(DealerT & dealer, PeerT & peer,
+        ExecutorT work_executor, bool party, dpf::modint<L> input_share,
+        std::size_t count, bool seeded)
+      : dealer_{dealer}, peer_{peer}, work_executor_{work_executor},
+        party_{party}, input_share_{input_share}, count_{count},
+        dealer_bytes_read_{0}, peer_bytes_read_{0}, bytes_written_{0},
+        record_{std::make_shared<evaluation_type>()}, bvr_{std::make_shared<beaver>()}
+    {
+        record_->party = party;
+        record_->seeded = seeded;
+        record_->arena = std::make_shared<recycling_arena>();
+    }
+
     template <typename Self>
     void operator()(Self & self,
                     const asio::error_code & error,
@@ -706,6 +1119,15 @@ struct online_bior_coro : asio::coroutine
         (*this)(self, error);
     }
 
+    template <typename Self>
+    void operator()(Self & self,
+                    const asio::error_code & error,
+                    lut_kernel::masked_sums sums)
+    {
+        bior_accumulate(*bvr_, sums);
+        (*this)(self, error);
+    }
+
     template <typename Self>
     void operator()(Self & self,
                     const asio::error_code & error = {},
@@ -722,59 +1144,45 @@ struct online_bior_coro : asio::coroutine
         {
             while (count_--)
             {
-                yield asio::async_read(dealer_, std::array<asio::mutable_buffer, 2>{
-                    asio::buffer(&*r_, sizeof(*r_)),
-                    asio::buffer(&*rr_, sizeof(*rr_))
-                }, std::move(self));
+                // from a stream or a mapped preprocessing file
+                probe_.start(bytes_so_far());
+                yield evaluation_type::async_read(dealer_, work_executor_, record_, std::move(self));
                 dealer_bytes_read_ += bytes_just_written;
-                if (error) asio::detail::throw_error(error, "async_read(r,rr)");
-
-                yield dpf::asio::async_read_dpf_inner<dpf_type>(dealer_, work_executor_, std::move(self));
-                if (error) asio::detail::throw_error(error, "async_read_dpf_inner");
-
-                yield async_read_dcf<bits-n-j>(dealer_, work_executor_, std::move(self));
-                if (error) asio::detail::throw_error(error, "async_read_dcf(lo)");
-
-                yield async_read_dcf<bits-n>(dealer_, work_executor_, std::move(self));
-                if (error) asio::detail::throw_error(error, "async_read_dcf(hi)");
-
-                yield async_read_beaver_bior<bits,j,n>(dealer_, work_executor_, std::move(self));
-                if (error) asio::detail::throw_error(error, "async_make_beaver_Haar");
+                if (error) asio::detail::throw_error(error, "async_read(evaluation)");
+                probe_.stop(stats::stage::dealer_record, bytes_so_far());
+                dpf_ = record_->dpf;
+                *bvr_ = record_->bvr;
 
+                probe_.start(bytes_so_far());
                 yield dpf::asio::async_assign_wildcard_input(peer_, work_executor_, *dpf_, input_share_, std::move(self));
                 if (error) asio::detail::throw_error(error, "async_assign_wildcard_input");
+                probe_.stop(stats::stage::reveal, bytes_so_far(), 1);
 
+                probe_.start();
                 yield dpf::asio::async_post(work_executor_,
                 [
                     // this,
                     party = this->party_,
                     shifted_input = this->shifted_input_.reduced_value(),
-                    dcf_lo = this->dcf_lo_,
-                    dcf_hi = this->dcf_hi_,
-                    dpf = this->dpf_,
-                    bvr = this->bvr_,
-                    rr = this->rr_
+                    record = this->record_,
+                    bvr = this->bvr_
                 ]()
                 {
-                    /// compute [lsb_j(msb_n(a))
-                    GroupElement carry{0};
-                    GroupElement borrow{0};
-                    evalDCF(party, &carry, GroupElement(shifted_input&(1ul<<(L-n)), L-n), *dcf_lo);
-                    evalDCF(party, &borrow, GroupElement(shifted_input&(1ul<<(L-J)), L-J), *dcf_hi);
-                    bvr->coefficient = *rr - ((shifted_input>>(L-n)&(1ul<<j)))-1+carry.value-borrow.value;
-                    auto parities = grotto::segment_parities<n,J>(*dpf);
-                    for (std::size_t i = 0; i < twoJ; ++i)
-                    {
-                        if (!parities[i]) continue;
-                        bvr->inner_product0 += scaled_lut2[i];
-                        bvr->inner_product1 += scaled_lut[i];
-                        bvr->sign++;
-                    }
+                    bior_coefficient<j, n>(party, shifted_input, record->rr, record->dcf_lo, record->dcf_hi, *bvr);
                 }, std::move(self));
                 if (error) asio::detail::throw_error(error, "async_post");
+                probe_.stop(stats::stage::dcf_eval);
 
-                yield async_mult<bits>(dealer_, peer_, work_executor_, bvr_, std::move(self));
+                probe_.start();
+                yield parities::async_fused_masked_sum<n, n-j>(work_executor_, dpf_, shifted_input_.reduced_value(),
+                    parities::lut_words(), parities::lut_words() + 1, parities::default_chunks<n-j>(), std::move(self));
+                if (error) asio::detail::throw_error(error, "async_fused_masked_sum");
+                probe_.stop(stats::stage::lut_eval);
+
+                probe_.start(bytes_so_far());
+                yield async_mult<bits, j, n>(dealer_, peer_, work_executor_, bvr_, std::move(self));
                 if (error) asio::detail::throw_error(error, "async_post");
+                probe_.stop(stats::stage::beaver, bytes_so_far(), 1);
             }
 
             self.complete(error, dealer_bytes_read_, peer_bytes_read_, bytes_written_);
@@ -790,11 +1198,12 @@ struct online_bior_coro : asio::coroutine
     std::size_t count_;
     dpf::modint<L> shifted_input_;
     std::size_t dealer_bytes_read_, peer_bytes_read_, bytes_written_;
-    std::shared_ptr<dpf::modint<L>> r_, rr_;
+    std::shared_ptr<evaluation_type> record_;  ///< reused for every dealer read
     std::shared_ptr<dpf_type> dpf_;
-    std::shared_ptr<DCFKeyPack> dcf_lo_;
-    std::shared_ptr<DCFKeyPack> dcf_hi_;
     std::shared_ptr<beaver> bvr_;
+    stats::probe probe_;
+
+    std::size_t bytes_so_far() const { return dealer_bytes_read_ + peer_bytes_read_ + bytes_written_; }
 #include <asio/unyield.hpp>
 };
 
@@ -807,14 +1216,220 @@ template <std::size_t bits,
           typename CompletionToken>
 [[nodiscard]]
 HEDLEY_ALWAYS_INLINE
-auto async_online_bior(DealerT & dealer, PeerT & peer, ExecutorT work_executor, bool party, dpf::modint<L> input_share, std::size_t count, CompletionToken && token)
+auto async_online_bior(DealerT & dealer, PeerT & peer, ExecutorT work_executor, bool party, dpf::modint<L> input_share, std::size_t count, bool seeded, CompletionToken && token)
 {
     return asio::async_compose<CompletionToken,
         void(asio::error_code,
              std::size_t,
              std::size_t,
-             std::size_t)>(online_bior_coro<bits, j, n, DealerT, PeerT, ExecutorT>{dealer, peer, work_executor, party, input_share, count},
+             std::size_t)>(online_bior_coro<bits, j, n, DealerT, PeerT, ExecutorT>{dealer, peer, work_executor, party, input_share, count, seeded},
               token, dealer, peer, work_executor);
 }
 
+template <std::size_t bits,
+          std::size_t j,
+          std::size_t n,
+          typename DealerT,
+          typename PeerT,
+          typename ExecutorT>
+struct online_bior_batch_coro : asio::coroutine
+{
+#include <asio/yield.hpp>
+    using evaluation_type = bior_evaluation<bits, j, n>;
+    using dpf_type = typename evaluation_type::dpf_type;
+  public:
+    online_bior_batch_coro(DealerT & dealer, PeerT & peer,
+        ExecutorT work_executor, bool party, std::vector<dpf::modint<L>> input_shares, bool seeded)
+      : dealer_{dealer}, peer_{peer}, work_executor_{work_executor},
+        party_{party}, seeded_{seeded},
+        input_shares_{std::make_shared<std::vector<dpf::modint<L>>>(std::move(input_shares))},
+        shifted_inputs_{std::make_shared<std::vector<dpf::modint<L>>>()},
+        records_{std::make_shared<std::vector<std::shared_ptr<evaluation_type>>>()},
+        dpfs_{std::make_shared<std::vector<std::shared_ptr<dpf_type>>>()},
+        bvrs_{std::make_shared<std::vector<beaver>>()},
+        iter_{0},
+        dealer_bytes_read_{0}, peer_bytes_read_{0}, bytes_written_{0}
+    {
+        records_->reserve(input_shares_->size());
+        dpfs_->reserve(input_shares_->size());
+        bvrs_->reserve(input_shares_->size());
+    }
+
+    template <typename Self>
+    void operator()(Self & self,
+                    const asio::error_code & error,
+                    std::vector<output_type> outputs,
+                    std::size_t bytes_just_read,
+                    std::size_t bytes_just_written)
+    {
+        outputs_ = std::move(outputs);
+        (*this)(self, error, bytes_just_read, bytes_just_written);
+    }
+
+    template <typename Self>
+    void operator()(Self & self,
+                    const asio::error_code & error = {},
+                    std::size_t bytes_just_read = 0,
+                    std::size_t bytes_just_written = 0)
+    {
+        reenter(*this)
+        {
+            // one record at a time, from a stream or a mapped preprocessing
+            // file; each record keeps the storage its DCF keys point into
+            for (iter_ = 0; iter_ < input_shares_->size(); ++iter_)
+            {
+                probe_.start(bytes_so_far());
+                records_->push_back(std::make_shared<evaluation_type>());
+                records_->back()->party = party_;
+                records_->back()->seeded = seeded_;
+                yield evaluation_type::async_read(dealer_, work_executor_, records_->back(), std::move(self));
+                dealer_bytes_read_ += bytes_just_read;
+                if (error) asio::detail::throw_error(error, "async_read(evaluation)");
+                probe_.stop(stats::stage::dealer_record, bytes_so_far());
+                dpfs_->push_back(records_->back()->dpf);
+                bvrs_->push_back(records_->back()->bvr);
+            }
+
+            probe_.start(bytes_so_far());
+            yield async_assign_wildcard_inputs(peer_, work_executor_, dpfs_, input_shares_, shifted_inputs_, std::move(self));
+            peer_bytes_read_ += bytes_just_read;
+            bytes_written_ += bytes_just_written;
+            if (error) asio::detail::throw_error(error, "async_assign_wildcard_inputs");
+            probe_.stop(stats::stage::reveal, bytes_so_far(), 1);
+
+            // the batch interleaves each tile's DCF and LUT work, so both are
+            // recorded together as `compute`
+            probe_.start();
+            yield async_post_bulk(work_executor_, parities::batch_tiling{dpfs_->size()}.tiles(),
+            [
+                party = this->party_,
+                shifted_inputs = this->shifted_inputs_,
+                records = this->records_,
+                dpfs = this->dpfs_,
+                bvrs = this->bvrs_
+            ](std::size_t t)
+            {
+                parities::batch_tiling tiling{dpfs->size()};
+                auto first = tiling.first(t), size = tiling.size(t);
+                for (std::size_t i = first; i < first + size; ++i)
+                {
+                    const auto & record = *(*records)[i];
+                    bior_coefficient<j, n>(party, (*shifted_inputs)[i].reduced_value(), record.rr,
+                        record.dcf_lo, record.dcf_hi, (*bvrs)[i]);
+                }
+                std::array<lut_kernel::masked_sums, parities::max_batch_tile> sums{};
+                auto lut = parities::lut_words();
+                parities::fused_masked_sum_batch<n, n-j>(dpfs->data() + first, shifted_inputs->data() + first, size,
+                    lut, lut + 1, sums.data());
+                for (std::size_t i = 0; i < size; ++i) bior_accumulate((*bvrs)[first + i], sums[i]);
+            }, std::move(self));
+            if (error) asio::detail::throw_error(error, "async_post_bulk");
+            probe_.stop(stats::stage::compute);
+
+            probe_.start(bytes_so_far());
+            yield async_mult_batch<bits, j, n>(dealer_, peer_, work_executor_, bvrs_, std::move(self));
+            peer_bytes_read_ += bytes_just_read;
+            bytes_written_ += bytes_just_written;
+            if (error) asio::detail::throw_error(error, "async_mult_batch");
+            probe_.stop(stats::stage::beaver, bytes_so_far(), 1);
+
+            self.complete(error, outputs_, dealer_bytes_read_, peer_bytes_read_, bytes_written_);
+        }
+    }
+
+  private:
+    DealerT & dealer_;
+    PeerT & peer_;
+    ExecutorT work_executor_;
+    bool party_;
+    bool seeded_;
+    std::shared_ptr<std::vector<dpf::modint<L>>> input_shares_;
+    std::shared_ptr<std::vector<dpf::modint<L>>> shifted_inputs_;
+    std::shared_ptr<std::vector<std::shared_ptr<evaluation_type>>> records_;
+    std::shared_ptr<std::vector<std::shared_ptr<dpf_type>>> dpfs_;
+    std::shared_ptr<std::vector<beaver>> bvrs_;
+    std::vector<output_type> outputs_;
+    std::size_t iter_;
+    std::size_t dealer_bytes_read_, peer_bytes_read_, bytes_written_;
+    stats::probe probe_;
+
+    std::size_t bytes_so_far() const { return dealer_bytes_read_ + peer_bytes_read_ + bytes_written_; }
+#include <asio/unyield.hpp>
+};
+
+/// evaluates bior on every share in `input_shares`, reading one set of dealer
+/// values per input and using exactly two peer round trips for the whole
+/// batch (one to reveal the shifted inputs and one for the Beaver products)
+template <std::size_t bits,
+          std::size_t j,
+          std::size_t n,
+          typename DealerT,
+          typename PeerT,
+          typename ExecutorT,
+          typename CompletionToken>
+[[nodiscard]]
+HEDLEY_ALWAYS_INLINE
+auto async_online_bior_batch(DealerT & dealer, PeerT & peer, ExecutorT work_executor, bool party, std::vector<dpf::modint<L>> input_shares, bool seeded, CompletionToken && token)
+{
+    return asio::async_compose<CompletionToken,
+        void(asio::error_code,
+             std::vector<output_type>,
+             std::size_t,
+             std::size_t,
+             std::size_t)>(online_bior_batch_coro<bits, j, n, DealerT, PeerT, ExecutorT>{dealer, peer, work_executor, party, std::move(input_shares), seeded},
+              token, dealer, peer, work_executor);
+}
+
+/// like `async_online_bior`, but keeps up to `window` evaluations in flight
+/// so that dealer reads, DPF/DCF evaluation and peer waits overlap; input
+/// shares come from `inputs` and output shares go to `outputs` (see
+/// `shares.hpp`)
+template <std::size_t bits,
+          std::size_t j,
+          std::size_t n,
+          typename DealerT,
+          typename PeerT,
+          typename ExecutorT,
+          typename InputT,
+          typename OutputT,
+          typename CompletionToken>
+[[nodiscard]]
+HEDLEY_ALWAYS_INLINE
+auto async_online_bior_pipelined(DealerT & dealer, PeerT & peer, ExecutorT work_executor, bool party, InputT && inputs, OutputT && outputs, std::size_t count, std::size_t window, bool seeded, CompletionToken && token)
+{
+    bior_evaluation<bits, j, n> prototype{};
+    prototype.party = party;
+    prototype.seeded = seeded;
+    prototype.arena = std::make_shared<recycling_arena>();
+    return async_online_pipeline(dealer, peer, work_executor, prototype,
+        std::forward<InputT>(inputs), std::forward<OutputT>(outputs), count, window,
+        std::forward<CompletionToken>(token));
+}
+
+
+/// like `async_online_bior_pipelined`, but over a `coalesce::channel`, so
+/// that evaluations exchange with the peer independently and their messages
+/// share packets
+template <std::size_t bits,
+          std::size_t j,
+          std::size_t n,
+          typename DealerT,
+          typename ChannelT,
+          typename ExecutorT,
+          typename InputT,
+          typename OutputT,
+          typename CompletionToken>
+[[nodiscard]]
+HEDLEY_ALWAYS_INLINE
+auto async_online_bior_coalesced(DealerT & dealer, ChannelT & channel, ExecutorT work_executor, bool party, InputT && inputs, OutputT && outputs, std::size_t count, std::size_t window, bool seeded, CompletionToken && token)
+{
+    bior_evaluation<bits, j, n> prototype{};
+    prototype.party = party;
+    prototype.seeded = seeded;
+    prototype.arena = std::make_shared<recycling_arena>();
+    return async_online_coalesced(dealer, channel, work_executor, prototype,
+        std::forward<InputT>(inputs), std::forward<OutputT>(outputs), count, window,
+        std::forward<CompletionToken>(token));
+}
+
 #endif  // BIOR_HPP__
\ No newline at end of file
@@ -0,0 +1,324 @@
+#ifndef COALESCE_HPP__
+#define COALESCE_HPP__
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "batch.hpp"
+#include "wire.hpp"
+
+/// Coalescing many evaluations' peer messages into shared packets.
+///
+/// A `channel` wraps the peer stream and carries tagged messages instead of
+/// raw bytes. Messages sent through it are framed as a header followed by
+/// the payload and queued; the queue is written to the next layer as a
+/// single `async_write` once it holds `max_bytes`, once `delay` has passed
+/// since it became non-empty, or (with a zero `delay`) once the handlers
+/// that are ready to run have had a chance to add to it.
+/// While a write is in flight, further messages accumulate and go out
+/// together when it completes. On the receiving side, a single reader
+/// splits what arrives back into frames and hands each one to whoever asked
+/// for its tag, stashing frames that arrive before they are asked for.
+///
+/// A frame's header is two varints (see `wire.hpp`): the zigzagged
+/// difference between its tag and the previous frame's tag in the same
+/// direction, and its payload size. The pipelines' tags mostly step by one
+/// or two, so a header usually takes two bytes. No payload may exceed
+/// `max_bytes`: a larger outgoing message fails with `message_size`, and a
+/// larger incoming frame fails the channel, so both peers' `max_bytes` must
+/// be at least `min_flush_bytes`.
+///
+/// Tags only have to be unique among the messages in flight, so 32 bits
+/// suffice even when the evaluation indices they are derived from wrap.
+namespace coalesce
+{
+
+using clock = std::chrono::steady_clock;
+
+struct flush_policy
+{
+    std::size_t max_bytes = 64 * 1024;  ///< flush as soon as this much is queued
+    clock::duration delay{0};           ///< longest a queued frame waits otherwise
+};
+
+/// longest frame header
+static constexpr std::size_t max_header_bytes = 2 * wire::max_varint_bytes;
+
+/// smallest usable `flush_policy::max_bytes`; the online protocols' largest
+/// message is bior's four Beaver operands
+static constexpr std::size_t min_flush_bytes = 64;
+
+template <typename NextLayer>
+class channel
+{
+  public:
+    using executor_type = typename NextLayer::executor_type;
+
+    explicit channel(NextLayer & next, const flush_policy & policy = {})
+      : next_{next}, policy_{policy}, flush_timer_{next.get_executor()},
+        flush_scheduled_{false}, writing_{false}, reading_{false},
+        last_sent_tag_{0}, last_received_tag_{0}, begin_{0}, end_{0},
+        bytes_read_{0}, bytes_written_{0}, frames_sent_{0}, flushes_{0} { }
+
+    channel(const channel &) = delete;
+    channel & operator=(const channel &) = delete;
+
+    executor_type get_executor() const noexcept { return next_.get_executor(); }
+    NextLayer & next_layer() { return next_; }
+    const flush_policy & policy() const { return policy_; }
+
+    /// bytes read from and written to the next layer, including framing
+    std::size_t bytes_read() const { return bytes_read_; }
+    std::size_t bytes_written() const { return bytes_written_; }
+
+    /// messages sent, and writes they were sent in
+    std::size_t frames_sent() const { return frames_sent_; }
+    std::size_t flushes() const { return flushes_; }
+
+    /// sends `out` tagged with `tag` and receives the peer's message with
+    /// the same tag into `in`, completing with the payload bytes read and
+    /// written once both are done; `in` must be exactly the size of the
+    /// peer's message
+    template <typename CompletionToken>
+    auto async_exchange(std::uint32_t tag, asio::const_buffer out, asio::mutable_buffer in, CompletionToken && token)
+    {
+        return ::asio::async_initiate<CompletionToken, void(::asio::error_code,  // error status
+                                                            std::size_t,         // bytes_read
+                                                            std::size_t)>(       // bytes_written
+            [this, tag, out, in](auto handler)
+            {
+                using state_type = ::detail::exchange_state<decltype(handler)>;
+                auto st = std::make_shared<state_type>(std::move(handler));
+                send(tag, out, [st](const ::asio::error_code & error, std::size_t bytes_written)
+                {
+                    st->bytes_written = bytes_written;
+                    ::detail::finish_exchange_half(st, error);
+                });
+                receive(tag, in, [st](const ::asio::error_code & error, std::size_t bytes_read)
+                {
+                    st->bytes_read = bytes_read;
+                    ::detail::finish_exchange_half(st, error);
+                });
+            },
+            token);
+    }
+
+  private:
+    using callback = std::function<void(const ::asio::error_code &, std::size_t)>;
+
+    struct waiter
+    {
+        ::asio::mutable_buffer buffer;
+        callback done;
+    };
+
+    static constexpr std::size_t read_chunk = 64 * 1024;
+
+    /// queues one frame; `done` runs once the write carrying it completes
+    void send(std::uint32_t tag, ::asio::const_buffer out, callback done)
+    {
+        if (error_ || out.size() > policy_.max_bytes)
+        {
+            ::asio::error_code error = error_ ? error_ : ::asio::error::message_size;
+            ::asio::post(get_executor(), [done = std::move(done), error]() { done(error, 0); });
+            return;
+        }
+        auto offset = pending_.size();
+        pending_.resize(offset + max_header_bytes + out.size());
+        auto payload = wire::put_varint(pending_.data() + offset,
+            wire::zigzag(std::int32_t(tag - last_sent_tag_)));
+        payload = wire::put_varint(payload, out.size());
+        std::memcpy(payload, out.data(), out.size());
+        pending_.resize(payload + out.size() - pending_.data());
+        last_sent_tag_ = tag;
+        pending_callbacks_.emplace_back(std::move(done), out.size());
+        ++frames_sent_;
+
+        if (pending_.size() >= policy_.max_bytes) flush();
+        else schedule_flush();
+    }
+
+    void schedule_flush()
+    {
+        if (flush_scheduled_) return;
+        flush_scheduled_ = true;
+        if (policy_.delay == clock::duration{0})
+        {
+            ::asio::post(get_executor(), [this]()
+            {
+                flush_scheduled_ = false;
+                flush();
+            });
+            return;
+        }
+        flush_timer_.expires_after(policy_.delay);
+        flush_timer_.async_wait([this](const ::asio::error_code &)
+        {
+            flush_scheduled_ = false;
+            flush();
+        });
+    }
+
+    /// writes everything queued, unless a write is already in flight
+    void flush()
+    {
+        if (writing_ || pending_.empty()) return;
+        if (flush_scheduled_ && policy_.delay != clock::duration{0}) flush_timer_.cancel();
+        writing_ = true;
+        std::swap(pending_, sending_);
+        std::swap(pending_callbacks_, sending_callbacks_);
+        ++flushes_;
+        ::asio::async_write(next_, ::asio::buffer(sending_),
+            [this](const ::asio::error_code & error, std::size_t bytes_written)
+            {
+                bytes_written_ += bytes_written;
+                if (error && !error_) error_ = error;
+                // `writing_` stays set while the callbacks run, so that
+                // messages they send are queued rather than flushed
+                for (auto & [done, size] : sending_callbacks_) done(error, error ? 0 : size);
+                sending_callbacks_.clear();
+                sending_.clear();
+                writing_ = false;
+
+                if (error_)
+                {
+                    auto callbacks = std::move(pending_callbacks_);
+                    pending_callbacks_.clear();
+                    pending_.clear();
+                    for (auto & [done, size] : callbacks) done(error_, 0);
+                    return;
+                }
+                // a frame whose deadline passed during the write goes now
+                if (pending_.size() >= policy_.max_bytes || !flush_scheduled_) flush();
+            });
+    }
+
+    /// completes `done` with the frame tagged `tag` once it has arrived
+    void receive(std::uint32_t tag, ::asio::mutable_buffer in, callback done)
+    {
+        if (auto it = arrived_.find(tag); it != arrived_.end())
+        {
+            auto size = ::asio::buffer_copy(in, ::asio::buffer(it->second));
+            ::asio::error_code error = (size == it->second.size() && size == in.size())
+                ? ::asio::error_code{} : ::asio::error::message_size;
+            spare_.push_back(std::move(it->second));
+            arrived_.erase(it);
+            ::asio::post(get_executor(), [done = std::move(done), error, size]() { done(error, size); });
+            return;
+        }
+        if (error_)
+        {
+            ::asio::post(get_executor(), [done = std::move(done), error = error_]() { done(error, 0); });
+            return;
+        }
+        waiting_.emplace(tag, waiter{in, std::move(done)});
+        if (!reading_) read();
+    }
+
+    /// reads from the next layer for as long as someone is waiting
+    void read()
+    {
+        reading_ = true;
+        if (begin_ == end_) begin_ = end_ = 0;
+        else if (begin_ > 0)
+        {
+            std::memmove(inbound_.data(), inbound_.data() + begin_, end_ - begin_);
+            end_ -= begin_;
+            begin_ = 0;
+        }
+        if (inbound_.size() - end_ < read_chunk) inbound_.resize(end_ + read_chunk);
+
+        next_.async_read_some(::asio::buffer(inbound_.data() + end_, inbound_.size() - end_),
+            [this](const ::asio::error_code & error, std::size_t bytes_read)
+            {
+                bytes_read_ += bytes_read;
+                end_ += bytes_read;
+                auto demultiplexed = demultiplex();
+                if (error || demultiplexed)
+                {
+                    reading_ = false;
+                    fail(error ? error : demultiplexed);
+                    return;
+                }
+                if (waiting_.empty()) reading_ = false;
+                else read();
+            });
+    }
+
+    /// hands every complete frame in `inbound_` to its waiter or stashes it;
+    /// returns `message_size` if the peer sent a frame larger than `max_bytes`
+    ::asio::error_code demultiplex()
+    {
+        auto end = inbound_.data() + end_;
+        while (begin_ < end_)
+        {
+            std::uint64_t delta, size;
+            auto data = wire::get_varint(inbound_.data() + begin_, end, delta);
+            if (data) data = wire::get_varint(data, end, size);
+            if (data && size > policy_.max_bytes) return ::asio::error::message_size;
+            if (!data || std::size_t(end - data) < size) break;
+            auto payload = ::asio::buffer(data, size);
+            begin_ = data + size - inbound_.data();
+            std::uint32_t tag = last_received_tag_ + std::uint32_t(wire::unzigzag(delta));
+            last_received_tag_ = tag;
+
+            auto it = waiting_.find(tag);
+            if (it == waiting_.end())
+            {
+                std::vector<unsigned char> bytes;
+                if (!spare_.empty())
+                {
+                    bytes = std::move(spare_.back());
+                    spare_.pop_back();
+                }
+                bytes.resize(size);
+                ::asio::buffer_copy(::asio::buffer(bytes), payload);
+                arrived_.emplace(tag, std::move(bytes));
+                continue;
+            }
+            auto w = std::move(it->second);
+            waiting_.erase(it);
+            auto copied = ::asio::buffer_copy(w.buffer, payload);
+            w.done((copied == size && copied == w.buffer.size())
+                ? ::asio::error_code{} : ::asio::error::message_size, copied);
+        }
+        return {};
+    }
+
+    void fail(const ::asio::error_code & error)
+    {
+        if (!error_) error_ = error;
+        auto waiting = std::move(waiting_);
+        waiting_.clear();
+        for (auto & [tag, w] : waiting) w.done(error_, 0);
+    }
+
+    NextLayer & next_;
+    flush_policy policy_;
+    asio::steady_timer flush_timer_;
+    bool flush_scheduled_, writing_, reading_;
+    std::uint32_t last_sent_tag_, last_received_tag_;  ///< for the tag deltas
+
+    std::vector<unsigned char> pending_, sending_;  ///< frames queued and being written
+    std::vector<std::pair<callback, std::size_t>> pending_callbacks_, sending_callbacks_;
+
+    std::vector<unsigned char> inbound_;  ///< bytes read; [begin_, end_) is not yet demultiplexed
+    std::size_t begin_, end_;
+    std::unordered_map<std::uint32_t, waiter> waiting_;
+    std::unordered_map<std::uint32_t, std::vector<unsigned char>> arrived_;
+    std::vector<std::vector<unsigned char>> spare_;  ///< recycled frame buffers
+
+    std::size_t bytes_read_, bytes_written_;
+    std::size_t frames_sent_, flushes_;
+    asio::error_code error_;
+};
+
+}  // namespace coalesce
+
+#endif  // COALESCE_HPP__
@@ -1,7 +1,15 @@
 #ifndef DCF_HPP__
 #define DCF_HPP__
 
+#include <array>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
 #include "EzPC/FSS/src/fss.h"
+#include "prepfile.hpp"
+#include "wire.hpp"
 
 namespace osuCrypto
 {
@@ -48,6 +56,131 @@ namespace osuCrypto
     }
 }
 
+/// Packed DCF keys.
+///
+/// A key made by `keyGenDCF(bits, bits, ...)` has `Bin = Bout = bits` and
+/// `groupSize = 1`, and both the dealer and the clients know `bits` from
+/// the protocol, so the packed form leaves those out: it is the `Bin + 1`
+/// seed/correction blocks `k` as they are, followed by the `groupSize`
+/// values of `g` and the `Bin * groupSize` values of `v`, each in exactly
+/// `Bout` bits (see `wire::bit_writer`). The `bitsize` that every in-memory
+/// `GroupElement` carries is restored from `Bout` when unpacking.
+
+/// bytes of a packed `bits`-bit key's blocks
+HEDLEY_ALWAYS_INLINE
+constexpr std::size_t dcf_block_bytes(std::size_t bits)
+{
+    return (bits + 1) * sizeof(osuCrypto::block);
+}
+
+/// bytes of a packed `bits`-bit key's correction values
+HEDLEY_ALWAYS_INLINE
+constexpr std::size_t dcf_value_bytes(std::size_t bits)
+{
+    return wire::packed_bytes(bits + 1, bits);
+}
+
+/// packs `key`'s correction values (`g`, then `v`) at `out`, which must
+/// have room for `dcf_value_bytes(key.Bout)` bytes
+HEDLEY_ALWAYS_INLINE
+void pack_dcf_values(const DCFKeyPack & key, unsigned char * out)
+{
+    wire::bit_writer writer{out};
+    for (int i = 0; i < key.groupSize; ++i) writer.put(key.g[i].value, key.Bout);
+    for (int i = 0; i < key.Bin * key.groupSize; ++i) writer.put(key.v[i].value, key.Bout);
+    writer.finish();
+}
+
+/// Reusable storage for the arrays of one DCF key.
+///
+/// `async_read_dcf` and `load_dcf` unpack a key into one of these rather than
+/// allocating fresh arrays; since the arrays only grow, a buffer that lives
+/// as long as its reader (e.g., one per pipeline slot) allocates for its
+/// first key and never again. The buffer is scratch space, not a value, so
+/// copying one yields an empty buffer (and copy-assigning keeps the target's
+/// arrays).
+class dcf_key_buffer
+{
+  public:
+    dcf_key_buffer() : key_{} { }
+    dcf_key_buffer(const dcf_key_buffer &) : dcf_key_buffer{} { }
+    dcf_key_buffer(dcf_key_buffer &&) = default;
+    dcf_key_buffer & operator=(const dcf_key_buffer &) { return *this; }
+    dcf_key_buffer & operator=(dcf_key_buffer &&) = default;
+
+    /// sizes the buffer for a packed `bits`-bit key and returns where its
+    /// blocks and then its packed values go, for the caller to fill in
+    /// before calling `unpack()`
+    std::array<::asio::mutable_buffer, 2> prepare(std::size_t bits)
+    {
+        k_.resize(bits + 1);
+        packed_.resize(dcf_value_bytes(bits));
+        return { ::asio::buffer(k_.data(), dcf_block_bytes(bits)), ::asio::buffer(packed_) };
+    }
+
+    /// unpacks the key that was read into the buffers from `prepare(bits)`
+    const DCFKeyPack & unpack(std::size_t bits)
+    {
+        return unpack(bits, k_.data(), packed_.data());
+    }
+
+    /// points `key()` at the blocks `k`, which must outlive its use, and
+    /// unpacks the `bits`-bit correction values at `packed`
+    const DCFKeyPack & unpack(std::size_t bits, const osuCrypto::block * k, const unsigned char * packed)
+    {
+        g_.resize(1);
+        v_.resize(bits);
+        key_.Bin = key_.Bout = int(bits);
+        key_.groupSize = 1;
+        key_.k = const_cast<osuCrypto::block *>(k);
+        key_.g = g_.data();
+        key_.v = v_.data();
+        wire::bit_reader reader{packed};
+        g_[0] = GroupElement(reader.get(bits), int(bits));
+        for (auto & v : v_) v = GroupElement(reader.get(bits), int(bits));
+        return key_;
+    }
+
+    const DCFKeyPack & key() const { return key_; }
+
+  private:
+    DCFKeyPack key_;
+    std::vector<osuCrypto::block> k_;
+    std::vector<unsigned char> packed_;
+    std::vector<GroupElement> g_, v_;
+};
+
+/// releases the arrays that `keyGenDCF` allocated for `key`
+HEDLEY_ALWAYS_INLINE
+void free_dcf(DCFKeyPack & key)
+{
+    delete[] key.k;
+    delete[] key.g;
+    delete[] key.v;
+    key.k = nullptr;
+    key.g = key.v = nullptr;
+}
+
+/// the two keys of one `keyGenDCF` call, released with `free_dcf` when
+/// destroyed (so also when writing them to the peers fails)
+struct dcf_key_pair
+{
+    dcf_key_pair()
+    {
+        first.k = second.k = nullptr;
+        first.g = first.v = second.g = second.v = nullptr;
+    }
+    dcf_key_pair(const dcf_key_pair &) = delete;
+    dcf_key_pair & operator=(const dcf_key_pair &) = delete;
+    ~dcf_key_pair()
+    {
+        free_dcf(first);
+        free_dcf(second);
+    }
+
+    DCFKeyPack first, second;
+};
+
 template <std::size_t bits,
           typename PeerT,
           typename ExecutorT,
@@ -66,7 +199,8 @@ auto async_make_dcf(PeerT & peer0, PeerT & peer1, ExecutorT work_executor, dpf::
                 &peer1,
                 work_executor,
                 x,y,
-                keys = std::make_shared<std::pair<DCFKeyPack, DCFKeyPack>>(),
+                keys = std::make_shared<dcf_key_pair>(),
+                packed = std::make_shared<std::array<std::array<unsigned char, dcf_value_bytes(bits)>, 2>>(),
                 bytes_written0 = std::size_t(0),
                 bytes_written1 = std::size_t(0),
                 coro = ::asio::coroutine()
@@ -80,31 +214,32 @@ auto async_make_dcf(PeerT & peer0, PeerT & peer1, ExecutorT work_executor, dpf::
             {
                 reenter (coro)
                 {
-                    yield dpf::asio::async_post(work_executor, [keys,x,y,&self]()
+                    yield dpf::asio::async_post(work_executor, [keys,packed,x,y,&self]()
                     {
-                        *keys = keyGenDCF(bits, bits, GroupElement(x.reduced_value(), bits), GroupElement(y.reduced_value(), bits));
+                        {
+                            // EzPC draws the key seeds from its global PRNG, which
+                            // must not be used from several workers at once
+                            static std::mutex keygen_mutex;
+                            std::lock_guard<std::mutex> lock{keygen_mutex};
+                            std::tie(keys->first, keys->second) = keyGenDCF(bits, bits,
+                                GroupElement(x.reduced_value(), bits), GroupElement(y.reduced_value(), bits));
+                        }
+                        pack_dcf_values(keys->first, (*packed)[0].data());
+                        pack_dcf_values(keys->second, (*packed)[1].data());
                     }, std::move(self));
 
-                    yield ::asio::async_write(peer0, std::array<asio::const_buffer, 6>{
-                        asio::buffer(&keys->first.Bin, sizeof(int)),
-                        asio::buffer(&keys->first.Bout, sizeof(int)),
-                        asio::buffer(&keys->first.groupSize, sizeof(int)),
-                        asio::buffer(keys->first.k, (keys->first.Bin + 1) * sizeof(osuCrypto::block)),
-                        asio::buffer(keys->first.g, keys->first.groupSize * sizeof(GroupElement)),
-                        asio::buffer(keys->first.v, keys->first.Bin * keys->first.groupSize * sizeof(GroupElement))
+                    yield ::asio::async_write(peer0, std::array<asio::const_buffer, 2>{
+                        asio::buffer(keys->first.k, dcf_block_bytes(bits)),
+                        asio::buffer((*packed)[0])
                     }, std::move(self));
 
                     bytes_written0 += bytes_just_written;
 
                     if (error) asio::detail::throw_error(error, "async_write");
 
-                    yield ::asio::async_write(peer1, std::array<asio::const_buffer, 6>{
-                        asio::buffer(&keys->second.Bin, sizeof(int)),
-                        asio::buffer(&keys->second.Bout, sizeof(int)),
-                        asio::buffer(&keys->second.groupSize, sizeof(int)),
-                        asio::buffer(keys->second.k, (keys->second.Bin + 1) * sizeof(osuCrypto::block)),
-                        asio::buffer(keys->second.g, keys->second.groupSize * sizeof(GroupElement)),
-                        asio::buffer(keys->second.v, keys->second.Bin * keys->second.groupSize * sizeof(GroupElement))
+                    yield ::asio::async_write(peer1, std::array<asio::const_buffer, 2>{
+                        asio::buffer(keys->second.k, dcf_block_bytes(bits)),
+                        asio::buffer((*packed)[1])
                     }, std::move(self));
 
                     bytes_written1 += bytes_just_written;
@@ -118,13 +253,16 @@ auto async_make_dcf(PeerT & peer0, PeerT & peer1, ExecutorT work_executor, dpf::
     #include <asio/unyield.hpp>
 }
 
+/// reads one packed `bits`-bit DCF key into `buffer`, which must outlive the
+/// operation; the key it completes with points into `buffer`, so it is only
+/// valid until the next read into the same buffer
 template <std::size_t bits,
           typename DealerT,
           typename ExecutorT,
           typename CompletionToken>
 [[nodiscard]]
 HEDLEY_ALWAYS_INLINE
-auto async_read_dcf(DealerT & dealer, ExecutorT work_executor, CompletionToken && token)
+auto async_read_dcf(DealerT & dealer, ExecutorT work_executor, dcf_key_buffer & buffer, CompletionToken && token)
 {
     #include <asio/yield.hpp>
     return ::asio::async_compose<
@@ -134,7 +272,7 @@ auto async_read_dcf(DealerT & dealer, ExecutorT work_executor, CompletionToken &
             [
                 &dealer,
                 work_executor,
-                key = std::make_shared<DCFKeyPack>(),
+                &buffer,
                 bytes_read = std::size_t(0),
                 coro = ::asio::coroutine()
             ]
@@ -147,40 +285,38 @@ auto async_read_dcf(DealerT & dealer, ExecutorT work_executor, CompletionToken &
             {
                 reenter (coro)
                 {
-                    yield ::asio::async_read(dealer, std::array<asio::mutable_buffer, 3>
-                    {
-                        asio::buffer(&key->Bin, sizeof(int)),
-                        asio::buffer(&key->Bout, sizeof(int)),
-                        asio::buffer(&key->groupSize, sizeof(int))
-                    }, std::move(self));
+                    yield ::asio::async_read(dealer, buffer.prepare(bits), std::move(self));
 
                     bytes_read += bytes_just_read;
 
                     if (error) asio::detail::throw_error(error, "async_read");
 
-                    yield dpf::asio::async_post(work_executor, [key]()
-                    {
-                        key->k = new block[key->Bin + 1];
-                        key->g = new GroupElement[key->groupSize];
-                        key->v = new GroupElement[key->Bin * key->groupSize];
-                    }, std::move(self));
-
-                    yield ::asio::async_read(dealer, std::array<asio::mutable_buffer, 3>
-                    {
-                        asio::buffer(key->k, (key->Bin + 1) * sizeof(osuCrypto::block)),
-                        asio::buffer(key->g, key->groupSize * sizeof(GroupElement)),
-                        asio::buffer(key->v, key->Bin * key->groupSize * sizeof(GroupElement))
-                    }, std::move(self));
-
-                    bytes_read += bytes_just_read;
-
-                    if (error) asio::detail::throw_error(error, "async_read");
-
-                    self.complete(error, *key, bytes_read);
+                    self.complete(error, buffer.unpack(bits), bytes_read);
                 }
             },
         token, dealer, work_executor);
     #include <asio/unyield.hpp>
 }
 
+/// appends `key`, packed, to a preprocessing-file record
+HEDLEY_ALWAYS_INLINE
+void append_dcf(prepfile::record_builder & record, const DCFKeyPack & key)
+{
+    std::array<unsigned char, dcf_value_bytes(64)> packed;
+    pack_dcf_values(key, packed.data());
+    record.append(key.k, dcf_block_bytes(key.Bin));
+    record.append(packed.data(), dcf_value_bytes(key.Bout));
+}
+
+/// unpacks the next `bits`-bit key in a mapped record into `buffer`; its
+/// blocks point into the mapping rather than being copied, so the key must
+/// not outlive the file (or the next load into `buffer`)
+HEDLEY_ALWAYS_INLINE
+const DCFKeyPack & load_dcf(prepfile::record_cursor & record, std::size_t bits, dcf_key_buffer & buffer)
+{
+    auto k = static_cast<const osuCrypto::block *>(record.next(dcf_block_bytes(bits)));
+    auto packed = static_cast<const unsigned char *>(record.next(dcf_value_bytes(bits)));
+    return buffer.unpack(bits, k, packed);
+}
+
 #endif  // DCF_HPP__
\ No newline at end of file
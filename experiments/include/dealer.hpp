@@ -0,0 +1,195 @@
+#ifndef DEALER_HPP__
+#define DEALER_HPP__
+
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <vector>
+
+/// An in-memory `AsyncWriteStream` that appends everything written to it to
+/// `data`. The preprocessing generators are templated on the peer stream, so
+/// pointing them at a pair of these lets a chunk of indices be generated on
+/// the worker pool without touching the real peers.
+template <typename ExecutorT>
+class memory_stream
+{
+  public:
+    using executor_type = ExecutorT;
+
+    explicit memory_stream(ExecutorT executor) : executor_{executor} { }
+
+    executor_type get_executor() const noexcept { return executor_; }
+
+    template <typename ConstBufferSequence,
+              typename CompletionToken>
+    auto async_write_some(const ConstBufferSequence & buffers, CompletionToken && token)
+    {
+        return ::asio::async_initiate<CompletionToken, void(::asio::error_code, std::size_t)>(
+            [this, buffers](auto handler)
+            {
+                std::size_t size = ::asio::buffer_size(buffers);
+                auto offset = data.size();
+                data.resize(offset + size);
+                ::asio::buffer_copy(::asio::buffer(data.data() + offset, size), buffers);
+                ::asio::post(executor_, [h = std::move(handler), size]() mutable
+                {
+                    std::move(h)(::asio::error_code{}, size);
+                });
+            },
+            token);
+    }
+
+    std::vector<unsigned char> data;
+
+  private:
+    ExecutorT executor_;
+};
+
+/// number of indices generated per chunk by `async_make_preprocess_parallel`
+static constexpr std::size_t default_dealer_chunk = 64;
+
+/// Generates `count` indices of preprocessing material using every thread of
+/// the worker pool, and writes it to `peer0` and `peer1` in index order.
+///
+/// The indices are split into chunks of `chunk` indices. Chunk `c` is produced
+/// by `make_chunk(stream0, stream1, strand, size, handler)`, which must
+/// generate `size` indices into the two `memory_stream`s (whose executor is a
+/// strand of `work_executor`) and then invoke `handler(error, ...)`. Up to
+/// `window` chunks are generated concurrently; the sequencer writes chunk `c`
+/// to both peers only after every earlier chunk has been written, so the
+/// streams are byte-for-byte what a sequential dealer would have produced.
+template <typename PeerT,
+          typename ExecutorT,
+          typename MakeChunkT>
+struct make_preprocess_parallel_coro : asio::coroutine
+{
+#include <asio/yield.hpp>
+    using strand_type = ::asio::strand<ExecutorT>;
+    using stream_type = memory_stream<strand_type>;
+
+    struct chunk_slot
+    {
+        explicit chunk_slot(strand_type strand) : stream0{strand}, stream1{strand} { }
+        stream_type stream0, stream1;
+    };
+
+    struct state
+    {
+        template <typename IoExecutorT>
+        state(IoExecutorT io_executor, std::size_t window)
+          : slots(window), ready(window, false), wakeup{io_executor} { }
+
+        std::vector<std::shared_ptr<chunk_slot>> slots;
+        std::vector<bool> ready;
+        ::asio::steady_timer wakeup;  ///< cancelled whenever a chunk completes
+        std::size_t next_launch = 0;
+    };
+
+  public:
+    make_preprocess_parallel_coro(PeerT & peer0, PeerT & peer1,
+        ExecutorT work_executor, std::size_t count, std::size_t chunk,
+        std::size_t window, MakeChunkT make_chunk)
+      : peer0_{peer0}, peer1_{peer1}, work_executor_{work_executor},
+        count_{count}, chunk_{std::max(chunk, std::size_t(1))},
+        chunks_{(count_ + chunk_ - 1) / chunk_},
+        window_{std::max(window, std::size_t(1))},
+        make_chunk_{std::move(make_chunk)},
+        st_{std::make_shared<state>(peer0.get_executor(), window_)},
+        next_write_{0}, idx_{0},
+        bytes_written0_{0}, bytes_written1_{0} { }
+
+    template <typename Self>
+    void operator()(Self & self,
+                    const asio::error_code & error = {},
+                    std::size_t bytes_just_written = 0)
+    {
+        reenter(*this)
+        {
+            for (next_write_ = 0; next_write_ < chunks_; ++next_write_)
+            {
+                launch_chunks();
+
+                idx_ = next_write_ % window_;
+                while (!st_->ready[idx_])
+                {
+                    st_->wakeup.expires_at(::asio::steady_timer::time_point::max());
+                    yield st_->wakeup.async_wait(std::move(self));
+                }
+
+                yield asio::async_write(peer0_, asio::buffer(st_->slots[idx_]->stream0.data), std::move(self));
+                bytes_written0_ += bytes_just_written;
+                if (error) asio::detail::throw_error(error, "async_write(peer0)");
+
+                yield asio::async_write(peer1_, asio::buffer(st_->slots[idx_]->stream1.data), std::move(self));
+                bytes_written1_ += bytes_just_written;
+                if (error) asio::detail::throw_error(error, "async_write(peer1)");
+
+                st_->slots[idx_].reset();
+                st_->ready[idx_] = false;
+            }
+
+            self.complete(asio::error_code{}, bytes_written0_, bytes_written1_);
+        }
+    }
+
+  private:
+    /// starts generating every chunk that fits in the window
+    void launch_chunks()
+    {
+        while (st_->next_launch < chunks_ && st_->next_launch < next_write_ + window_)
+        {
+            auto c = st_->next_launch++;
+            auto idx = c % window_;
+            auto size = std::min(chunk_, count_ - c * chunk_);
+            auto slot = std::make_shared<chunk_slot>(::asio::make_strand(work_executor_));
+            st_->slots[idx] = slot;
+            make_chunk_(slot->stream0, slot->stream1, slot->stream0.get_executor(), size,
+                [st = st_, slot, idx, io_executor = peer0_.get_executor()](const asio::error_code & error, auto && ...)
+                {
+                    if (error) asio::detail::throw_error(error, "make_preprocess(chunk)");
+                    ::asio::post(io_executor, [st, idx]()
+                    {
+                        st->ready[idx] = true;
+                        st->wakeup.cancel();
+                    });
+                });
+        }
+    }
+
+    PeerT & peer0_;
+    PeerT & peer1_;
+    ExecutorT work_executor_;
+    std::size_t count_, chunk_, chunks_, window_;
+    MakeChunkT make_chunk_;
+    std::shared_ptr<state> st_;
+    std::size_t next_write_, idx_;
+    std::size_t bytes_written0_, bytes_written1_;
+#include <asio/unyield.hpp>
+};
+
+/// number of chunks kept in flight by default: enough to keep every worker
+/// busy while the sequencer waits on the oldest one
+HEDLEY_ALWAYS_INLINE
+std::size_t default_dealer_window()
+{
+    return 4 * std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+template <typename PeerT,
+          typename ExecutorT,
+          typename MakeChunkT,
+          typename CompletionToken>
+[[nodiscard]]
+HEDLEY_ALWAYS_INLINE
+auto async_make_preprocess_parallel(PeerT & peer0, PeerT & peer1, ExecutorT work_executor, std::size_t count,
+    std::size_t chunk, std::size_t window, MakeChunkT && make_chunk, CompletionToken && token)
+{
+    using coro_type = make_preprocess_parallel_coro<PeerT, ExecutorT, std::decay_t<MakeChunkT>>;
+    return asio::async_compose<CompletionToken,
+        void(asio::error_code,
+             std::size_t,
+             std::size_t)>(coro_type{peer0, peer1, work_executor, count, chunk, window, std::forward<MakeChunkT>(make_chunk)},
+        token, peer0, peer1);
+}
+
+#endif  // DEALER_HPP__
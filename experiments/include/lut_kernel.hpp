@@ -0,0 +1,185 @@
+#ifndef LUT_KERNEL_HPP__
+#define LUT_KERNEL_HPP__
+
+#include <cstdint>
+#include <cstddef>
+#include <immintrin.h>
+
+/// Branch-free masked LUT reductions for the online phase.
+///
+/// Given a bit-packed mask (bit `i % 64` of word `i / 64` is set iff segment
+/// `i` has odd parity), the kernels return the wrapping 64-bit sum of the
+/// selected LUT entries and the number of selected segments. Since the LUT
+/// holds `dpf::modint<L>` values with `L <= 64`, summing modulo 2^64 and
+/// reducing once at the end gives the same result as summing the `modint`s
+/// directly.
+///
+/// The count is a single popcount per mask word, and the accumulation needs
+/// no branches. The AVX2 and AVX-512 variants are compiled via target
+/// attributes and chosen at runtime by CPU feature detection, independently
+/// of `-march`.
+namespace lut_kernel
+{
+
+struct masked_sums
+{
+    std::uint64_t sum0 = 0;   ///< sum over the first table
+    std::uint64_t sum1 = 0;   ///< sum over the second table (if any)
+    std::uint64_t count = 0;  ///< number of selected entries
+
+    masked_sums & operator+=(const masked_sums & other)
+    {
+        sum0 += other.sum0;
+        sum1 += other.sum1;
+        count += other.count;
+        return *this;
+    }
+};
+
+namespace detail
+{
+
+/// adds the first `len <= 64` entries selected by `word`
+template <bool Dual>
+HEDLEY_ALWAYS_INLINE
+void accumulate_word_portable(std::uint64_t word, const std::uint64_t * lut0,
+    const std::uint64_t * lut1, std::size_t len, masked_sums & out)
+{
+    if (len < 64) word &= (std::uint64_t(1) << len) - 1;
+    for (std::size_t k = 0; k < len; ++k)
+    {
+        auto sel = std::uint64_t(0) - ((word >> k) & 1);
+        out.sum0 += lut0[k] & sel;
+        if constexpr (Dual) out.sum1 += lut1[k] & sel;
+    }
+    out.count += __builtin_popcountll(word);
+}
+
+template <bool Dual>
+masked_sums masked_sum_portable(const std::uint64_t * mask, const std::uint64_t * lut0,
+    const std::uint64_t * lut1, std::size_t len)
+{
+    masked_sums out;
+    for (std::size_t i = 0; i < len; i += 64)
+    {
+        accumulate_word_portable<Dual>(mask[i / 64], lut0 + i, Dual ? lut1 + i : nullptr,
+            len - i < 64 ? len - i : 64, out);
+    }
+    return out;
+}
+
+template <bool Dual>
+__attribute__((target("avx2,popcnt")))
+masked_sums masked_sum_avx2(const std::uint64_t * mask, const std::uint64_t * lut0,
+    const std::uint64_t * lut1, std::size_t len)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i lanes = _mm256_setr_epi64x(1, 2, 4, 8);
+    __m256i acc0a = zero, acc0b = zero, acc1a = zero, acc1b = zero;
+    masked_sums out;
+
+    std::size_t i = 0;
+    for (; i + 64 <= len; i += 64)
+    {
+        std::uint64_t word = mask[i / 64];
+        out.count += _mm_popcnt_u64(word);
+
+        for (std::size_t k = 0; k < 64; k += 8)
+        {
+            auto sel_a = _mm256_cmpeq_epi64(_mm256_and_si256(_mm256_set1_epi64x(word >> k), lanes), lanes);
+            auto sel_b = _mm256_cmpeq_epi64(_mm256_and_si256(_mm256_set1_epi64x(word >> (k + 4)), lanes), lanes);
+            acc0a = _mm256_add_epi64(acc0a, _mm256_and_si256(sel_a,
+                _mm256_loadu_si256(reinterpret_cast<const __m256i *>(lut0 + i + k))));
+            acc0b = _mm256_add_epi64(acc0b, _mm256_and_si256(sel_b,
+                _mm256_loadu_si256(reinterpret_cast<const __m256i *>(lut0 + i + k + 4))));
+            if constexpr (Dual)
+            {
+                acc1a = _mm256_add_epi64(acc1a, _mm256_and_si256(sel_a,
+                    _mm256_loadu_si256(reinterpret_cast<const __m256i *>(lut1 + i + k))));
+                acc1b = _mm256_add_epi64(acc1b, _mm256_and_si256(sel_b,
+                    _mm256_loadu_si256(reinterpret_cast<const __m256i *>(lut1 + i + k + 4))));
+            }
+        }
+    }
+
+    alignas(32) std::uint64_t lanes0[4], lanes1[4];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lanes0), _mm256_add_epi64(acc0a, acc0b));
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lanes1), _mm256_add_epi64(acc1a, acc1b));
+    out.sum0 += lanes0[0] + lanes0[1] + lanes0[2] + lanes0[3];
+    out.sum1 += lanes1[0] + lanes1[1] + lanes1[2] + lanes1[3];
+
+    if (i < len)
+    {
+        accumulate_word_portable<Dual>(mask[i / 64], lut0 + i, Dual ? lut1 + i : nullptr, len - i, out);
+    }
+    return out;
+}
+
+template <bool Dual>
+__attribute__((target("avx512f,popcnt")))
+masked_sums masked_sum_avx512(const std::uint64_t * mask, const std::uint64_t * lut0,
+    const std::uint64_t * lut1, std::size_t len)
+{
+    __m512i acc0 = _mm512_setzero_si512(), acc1 = _mm512_setzero_si512();
+    masked_sums out;
+
+    std::size_t i = 0;
+    for (; i + 64 <= len; i += 64)
+    {
+        std::uint64_t word = mask[i / 64];
+        out.count += _mm_popcnt_u64(word);
+
+        for (std::size_t k = 0; k < 64; k += 8)
+        {
+            auto sel = __mmask8(word >> k);
+            acc0 = _mm512_mask_add_epi64(acc0, sel, acc0, _mm512_loadu_si512(lut0 + i + k));
+            if constexpr (Dual)
+            {
+                acc1 = _mm512_mask_add_epi64(acc1, sel, acc1, _mm512_loadu_si512(lut1 + i + k));
+            }
+        }
+    }
+    out.sum0 += _mm512_reduce_add_epi64(acc0);
+    out.sum1 += _mm512_reduce_add_epi64(acc1);
+
+    if (i < len)
+    {
+        accumulate_word_portable<Dual>(mask[i / 64], lut0 + i, Dual ? lut1 + i : nullptr, len - i, out);
+    }
+    return out;
+}
+
+using kernel_type = masked_sums (*)(const std::uint64_t *, const std::uint64_t *,
+    const std::uint64_t *, std::size_t);
+
+template <bool Dual>
+kernel_type select_kernel()
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return &masked_sum_avx512<Dual>;
+    if (__builtin_cpu_supports("avx2")) return &masked_sum_avx2<Dual>;
+    return &masked_sum_portable<Dual>;
+}
+
+}  // namespace detail
+
+/// sums `lut[i]` over all `i < len` whose bit is set in `mask`
+HEDLEY_ALWAYS_INLINE
+masked_sums masked_sum(const std::uint64_t * mask, const std::uint64_t * lut, std::size_t len)
+{
+    static const detail::kernel_type kernel = detail::select_kernel<false>();
+    return kernel(mask, lut, nullptr, len);
+}
+
+/// sums `lut0[i]` and `lut1[i]` over all `i < len` whose bit is set in `mask`
+HEDLEY_ALWAYS_INLINE
+masked_sums masked_sum(const std::uint64_t * mask, const std::uint64_t * lut0,
+    const std::uint64_t * lut1, std::size_t len)
+{
+    static const detail::kernel_type kernel = detail::select_kernel<true>();
+    return kernel(mask, lut0, lut1, len);
+}
+
+}  // namespace lut_kernel
+
+#endif  // LUT_KERNEL_HPP__
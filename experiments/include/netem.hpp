@@ -0,0 +1,272 @@
+#ifndef NETEM_HPP__
+#define NETEM_HPP__
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/// User-space network emulation, as a stand-in for `tc netem` in benchmarks.
+///
+/// An `emulated_stream` wraps any stream and shapes what is written to it the
+/// way a netem qdisc shapes a link's egress: writes are cut into segments,
+/// each segment leaves at the link's `rate` (after the ones queued before
+/// it), and arrives at the next layer `delay` (plus uniform `jitter`) after
+/// it has left. Reads pass straight through, so wrapping both ends of a
+/// connection emulates both directions. As with netem's `rate`, segments
+/// are never reordered: jitter that would make one overtake its predecessor
+/// is clamped.
+namespace netem
+{
+
+using clock = std::chrono::steady_clock;
+
+struct link_profile
+{
+    double rate = 0;                            ///< bits per second (0 for unlimited)
+    clock::duration delay{0};                   ///< one-way delay
+    clock::duration jitter{0};                  ///< delay varies uniformly by up to this much
+    std::size_t segment_bytes = 64 * 1024;      ///< largest unit that is paced and delayed
+    std::size_t queue_bytes = 16 * 1024 * 1024; ///< writes wait once this much is in flight
+
+    /// the LAN used in our benchmarks (5 Gbit, 0.2 ms)
+    static link_profile lan() { return {5e9, std::chrono::microseconds(200)}; }
+
+    /// the WAN used in our benchmarks (300 Mbit, 70 ms)
+    static link_profile wan() { return {300e6, std::chrono::milliseconds(70)}; }
+
+    /// time it takes to put `bytes` on the link
+    clock::duration serialization(std::size_t bytes) const
+    {
+        if (rate <= 0) return clock::duration{0};
+        return std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(8.0 * bytes / rate));
+    }
+};
+
+/// parses a `tc`-style rate such as "300mbit", "5gbit" or "1gbps"
+/// (returned in bits per second)
+inline double parse_rate(const std::string & text)
+{
+    std::size_t end;
+    double value = std::stod(text, &end);
+    auto unit = text.substr(end);
+    std::transform(unit.begin(), unit.end(), unit.begin(), ::tolower);
+    if (unit.empty() || unit == "bit") return value;
+    if (unit == "kbit") return value * 1e3;
+    if (unit == "mbit") return value * 1e6;
+    if (unit == "gbit") return value * 1e9;
+    if (unit == "tbit") return value * 1e12;
+    if (unit == "bps") return value * 8;
+    if (unit == "kbps") return value * 8e3;
+    if (unit == "mbps") return value * 8e6;
+    if (unit == "gbps") return value * 8e9;
+    throw std::invalid_argument("unrecognized rate: " + text);
+}
+
+/// parses a `tc`-style time such as "70ms", "200us" or "0.2ms"
+inline clock::duration parse_time(const std::string & text)
+{
+    std::size_t end;
+    double value = std::stod(text, &end);
+    auto unit = text.substr(end);
+    std::transform(unit.begin(), unit.end(), unit.begin(), ::tolower);
+    double seconds;
+    if (unit == "s" || unit == "sec" || unit == "secs") seconds = value;
+    else if (unit == "ms" || unit == "msec" || unit == "msecs") seconds = value * 1e-3;
+    else if (unit.empty() || unit == "us" || unit == "usec" || unit == "usecs") seconds = value * 1e-6;
+    else if (unit == "ns" || unit == "nsec" || unit == "nsecs") seconds = value * 1e-9;
+    else throw std::invalid_argument("unrecognized time: " + text);
+    return std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(seconds));
+}
+
+template <typename NextLayer>
+class emulated_stream
+{
+  public:
+    using executor_type = typename NextLayer::executor_type;
+
+    emulated_stream(NextLayer & next, const link_profile & profile,
+        std::uint64_t seed = std::random_device{}())
+      : next_{next}, profile_{profile}, rng_{seed},
+        pump_timer_{next.get_executor()}, space_timer_{next.get_executor()},
+        link_free_{clock::now()}, last_arrival_{clock::now()},
+        queued_bytes_{0}, pumping_{false} { }
+
+    emulated_stream(const emulated_stream &) = delete;
+    emulated_stream & operator=(const emulated_stream &) = delete;
+
+    executor_type get_executor() const noexcept { return next_.get_executor(); }
+    NextLayer & next_layer() { return next_; }
+    const link_profile & profile() const { return profile_; }
+
+    template <typename MutableBufferSequence,
+              typename CompletionToken>
+    auto async_read_some(const MutableBufferSequence & buffers, CompletionToken && token)
+    {
+        return next_.async_read_some(buffers, std::forward<CompletionToken>(token));
+    }
+
+    /// queues (a prefix of) `buffers` for delivery and completes as soon as
+    /// it is queued, i.e., before it has "arrived"
+    template <typename ConstBufferSequence,
+              typename CompletionToken>
+    auto async_write_some(const ConstBufferSequence & buffers, CompletionToken && token)
+    {
+        #include <asio/yield.hpp>
+        return asio::async_compose<CompletionToken, void(asio::error_code, std::size_t)>(
+            [
+                this,
+                buffers,
+                coro = asio::coroutine()
+            ]
+            (
+                auto & self,
+                const asio::error_code & = {}
+            )
+            mutable
+            {
+                reenter (coro)
+                {
+                    yield asio::post(get_executor(), std::move(self));
+                    while (!error_ && queued_bytes_ >= profile_.queue_bytes)
+                    {
+                        space_timer_.expires_at(clock::time_point::max());
+                        yield space_timer_.async_wait(std::move(self));
+                    }
+                    if (error_)
+                    {
+                        self.complete(error_, 0);
+                        return;
+                    }
+                    self.complete(asio::error_code{}, enqueue(buffers));
+                }
+            },
+            token, *this);
+        #include <asio/unyield.hpp>
+    }
+
+  private:
+    struct segment
+    {
+        clock::time_point arrival;
+        std::vector<unsigned char> bytes;
+    };
+
+    /// cuts as much of `buffers` as the queue has room for into segments
+    /// and schedules them; returns the number of bytes taken
+    template <typename ConstBufferSequence>
+    std::size_t enqueue(const ConstBufferSequence & buffers)
+    {
+        auto room = profile_.queue_bytes - queued_bytes_;
+        auto total = std::min(asio::buffer_size(buffers), room);
+        auto now = clock::now();
+        std::size_t taken = 0;
+        while (taken < total)
+        {
+            auto size = std::min(total - taken, profile_.segment_bytes);
+            segment seg;
+            if (!spare_.empty())
+            {
+                seg.bytes = std::move(spare_.back());
+                spare_.pop_back();
+            }
+            seg.bytes.resize(size);
+            asio::buffer_copy(asio::buffer(seg.bytes), buffers_from(buffers, taken));
+
+            link_free_ = std::max(link_free_, now) + profile_.serialization(size);
+            seg.arrival = std::max(last_arrival_, link_free_ + sample_delay());
+            last_arrival_ = seg.arrival;
+
+            queue_.push_back(std::move(seg));
+            queued_bytes_ += size;
+            taken += size;
+        }
+        if (!pumping_ && !queue_.empty())
+        {
+            pumping_ = true;
+            pump();
+        }
+        return taken;
+    }
+
+    /// `buffers` with its first `offset` bytes skipped
+    template <typename ConstBufferSequence>
+    static std::vector<asio::const_buffer> buffers_from(const ConstBufferSequence & buffers, std::size_t offset)
+    {
+        std::vector<asio::const_buffer> out;
+        for (auto it = asio::buffer_sequence_begin(buffers); it != asio::buffer_sequence_end(buffers); ++it)
+        {
+            asio::const_buffer buffer{*it};
+            if (offset >= buffer.size())
+            {
+                offset -= buffer.size();
+                continue;
+            }
+            out.push_back(buffer + offset);
+            offset = 0;
+        }
+        return out;
+    }
+
+    clock::duration sample_delay()
+    {
+        if (profile_.jitter == clock::duration{0}) return profile_.delay;
+        std::uniform_int_distribution<clock::rep> jitter{-profile_.jitter.count(), profile_.jitter.count()};
+        return std::max(clock::duration{0}, profile_.delay + clock::duration{jitter(rng_)});
+    }
+
+    /// delivers the queued segments to the next layer, each at its arrival
+    /// time; an aborted wait or write means the stream (or the next layer)
+    /// is being torn down, so its handler returns without touching `this`
+    void pump()
+    {
+        if (queue_.empty())
+        {
+            pumping_ = false;
+            return;
+        }
+        pump_timer_.expires_at(queue_.front().arrival);
+        pump_timer_.async_wait([this](const asio::error_code & error)
+        {
+            if (error == asio::error::operation_aborted) return;
+            asio::async_write(next_, asio::buffer(queue_.front().bytes),
+                [this](const asio::error_code & error, std::size_t bytes_written)
+                {
+                    if (error == asio::error::operation_aborted) return;
+                    if (error) error_ = error;
+                    queued_bytes_ -= queue_.front().bytes.size();
+                    spare_.push_back(std::move(queue_.front().bytes));
+                    queue_.pop_front();
+                    space_timer_.cancel();
+                    if (error)
+                    {
+                        queue_.clear();
+                        queued_bytes_ = 0;
+                    }
+                    pump();
+                });
+        });
+    }
+
+    NextLayer & next_;
+    link_profile profile_;
+    std::mt19937_64 rng_;
+    asio::steady_timer pump_timer_;   ///< waits for the front segment's arrival time
+    asio::steady_timer space_timer_;  ///< cancelled whenever the queue drains a segment
+    clock::time_point link_free_;     ///< when the link finishes sending what is queued
+    clock::time_point last_arrival_;
+    std::deque<segment> queue_;
+    std::vector<std::vector<unsigned char>> spare_;  ///< recycled segment buffers
+    std::size_t queued_bytes_;
+    bool pumping_;
+    asio::error_code error_;
+};
+
+}  // namespace netem
+
+#endif  // NETEM_HPP__
@@ -0,0 +1,382 @@
+#ifndef PARITIES_HPP__
+#define PARITIES_HPP__
+
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "batch.hpp"
+#include "lut_kernel.hpp"
+
+/// Bit-packed segment parities.
+///
+/// `grotto::segment_parities<n,J>` returns one byte per segment, which at
+/// large `J` is far bigger than the LUT sweep it feeds. The walker below
+/// produces the same parities 64 segments at a time, directly from the DPF
+/// tree, as words in the layout `lut_kernel::masked_sum` consumes. Every
+/// kernel takes the key's reconstructed (shifted) input, as returned by
+/// `offset_x.reconstruct`, along with the key.
+///
+/// It relies on the Grotto invariant that the parity of the leaves below an
+/// interior node equals that node's control bit. Segment `k` covers the
+/// `2^(n-J)` leaves starting at `k * 2^(n-J) + x`, where `x` is the key's
+/// reconstructed (shifted) input. Writing `x = q * 2^(n-J) + r`, the segment
+/// is the tail of depth-`J` node `m = k + q` from leaf `r` on, followed by the
+/// head of node `m + 1` up to leaf `r` (indices mod `2^J`), so its parity is
+/// `ctl(m) ^ head(m) ^ head(m+1)`, where `head(m)` is the parity of the first
+/// `r` leaves below `m`.
+///
+/// This needs the depth-`n` nodes to be interior nodes. When the tree is
+/// shallower than `n`, a segment can start part way into a leaf, and its
+/// parity depends on leaf values that the walk never reaches. In that case
+/// the walker packs `grotto::segment_parities<n,J>` instead. `test-parities`
+/// checks both cases against grotto.
+namespace parities
+{
+
+using packed_parities = std::vector<std::uint64_t>;
+
+namespace detail
+{
+
+/// the only place that depends on libdpf's tree representation: the child
+/// of `node` (at depth `level`) in direction `dir`, and a node's control bit
+template <typename DpfT>
+HEDLEY_ALWAYS_INLINE
+auto child(const DpfT & dpf, const typename DpfT::interior_node & node, std::size_t level, bool dir)
+{
+    auto cw = dpf::set_lo_bit(dpf.correction_words[level], (dpf.correction_advice[level] >> dir) & 1);
+    return DpfT::traverse_interior(node, cw, dir);
+}
+
+template <typename NodeT>
+HEDLEY_ALWAYS_INLINE
+bool control_bit(const NodeT & node)
+{
+    return dpf::get_lo_bit(node);
+}
+
+}  // namespace detail
+
+/// visits the depth-`J` nodes of a DPF tree in (rotated) segment order,
+/// yielding each segment's parity packed 64 at a time
+template <std::size_t n,
+          std::size_t J,
+          typename DpfT>
+class segment_parity_walker
+{
+  public:
+    using node_type = typename DpfT::interior_node;
+    static constexpr std::size_t segments = std::size_t(1) << J;
+    static constexpr std::size_t words = (segments + 63) / 64;
+
+    /// whether the tree is deep enough to walk (see above)
+    static constexpr bool walkable = n <= DpfT::depth;
+    static constexpr std::size_t below = n - J;
+
+    segment_parity_walker(const DpfT & dpf, std::uint64_t shifted_input)
+      : dpf_{dpf}
+    {
+        if constexpr (walkable)
+        {
+            auto x = shifted_input >> (L - n);
+            q_ = (x >> (n - J)) & (segments - 1);
+            r_ = x & ((std::size_t(1) << (n - J)) - 1);
+        }
+        else
+        {
+            auto bytes = grotto::segment_parities<n,J>(dpf);
+            packed_.assign(words, 0);
+            for (std::size_t i = 0; i < segments; ++i)
+            {
+                packed_[i / 64] |= std::uint64_t(bool(bytes[i])) << (i % 64);
+            }
+        }
+    }
+
+    /// calls `f(w, word)` for `w = first_word, ..., last_word - 1`, where bit
+    /// `b` of `word` is the parity of segment `64*w + b`
+    template <typename Function>
+    void for_each_word(std::size_t first_word, std::size_t last_word, Function && f)
+    {
+        if constexpr (!walkable)
+        {
+            for (auto w = first_word; w < std::min(last_word, words); ++w) f(w, packed_[w]);
+            return;
+        }
+        auto end = std::min(last_word * 64, segments);
+        seek((q_ + first_word * 64) & (segments - 1));
+        bool head = head_parity(path_[J]);
+        std::uint64_t word = 0;
+        for (std::size_t k = first_word * 64; k < end; ++k)
+        {
+            bool ctl = detail::control_bit(path_[J]);
+            advance();
+            bool next_head = head_parity(path_[J]);
+            word |= std::uint64_t(ctl ^ head ^ next_head) << (k % 64);
+            head = next_head;
+            if (k % 64 == 63 || k + 1 == end)
+            {
+                f(k / 64, word);
+                word = 0;
+            }
+        }
+    }
+
+    template <typename Function>
+    void for_each_word(Function && f)
+    {
+        for_each_word(0, words, std::forward<Function>(f));
+    }
+
+  private:
+    /// points `path_` at depth-`J` node `m`
+    void seek(std::size_t m)
+    {
+        m_ = m;
+        path_[0] = dpf_.root;
+        for (std::size_t level = 0; level < J; ++level)
+        {
+            path_[level+1] = detail::child(dpf_, path_[level], level, (m >> (J - 1 - level)) & 1);
+        }
+    }
+
+    /// moves `path_` to the next depth-`J` node, recomputing only the levels
+    /// below the lowest common ancestor (amortized O(1) PRG calls per node)
+    void advance()
+    {
+        auto next = (m_ + 1) & (segments - 1);
+        auto diff = m_ ^ next;
+        std::size_t level = diff ? J - (64 - __builtin_clzll(diff)) : 0;
+        m_ = next;
+        for (; level < J; ++level)
+        {
+            path_[level+1] = detail::child(dpf_, path_[level], level, (m_ >> (J - 1 - level)) & 1);
+        }
+    }
+
+    /// parity of the first `r_` leaves below the depth-`J` node `node`
+    bool head_parity(node_type node) const
+    {
+        if (!r_) return false;
+        bool parity = false;
+        for (std::size_t level = J; level < J + below; ++level)
+        {
+            bool dir = (r_ >> (J + below - 1 - level)) & 1;
+            if (dir) parity ^= detail::control_bit(detail::child(dpf_, node, level, false));
+            node = detail::child(dpf_, node, level, dir);
+        }
+        return parity;
+    }
+
+    const DpfT & dpf_;
+    std::size_t q_ = 0, r_ = 0, m_ = 0;
+    std::array<node_type, J+1> path_;
+    packed_parities packed_;  ///< the parities, if not `walkable`
+};
+
+/// bit-packed counterpart of `grotto::segment_parities<n,J>`
+template <std::size_t n,
+          std::size_t J,
+          typename DpfT>
+packed_parities segment_parities_packed(const DpfT & dpf, std::uint64_t shifted_input)
+{
+    packed_parities words(segment_parity_walker<n, J, DpfT>::words);
+    segment_parity_walker<n, J, DpfT>{dpf, shifted_input}.for_each_word([&words](std::size_t w, std::uint64_t word)
+    {
+        words[w] = word;
+    });
+    return words;
+}
+
+/// number of parity words buffered per block by `fused_masked_sum`; the
+/// block's LUT slice (2048 entries, 16 KiB per table) stays hot in L1/L2
+static constexpr std::size_t fused_block_words = 32;
+
+/// fused counterpart of `segment_parities_packed` followed by
+/// `lut_kernel::masked_sum` over parity words `[first_word, last_word)`:
+/// walks the DPF tree and folds each block of parity words into the running
+/// sums while the block is still in cache, so the parity vector is never
+/// stored
+template <std::size_t n,
+          std::size_t J,
+          typename DpfT>
+lut_kernel::masked_sums fused_masked_sum(const DpfT & dpf, std::uint64_t shifted_input,
+    const std::uint64_t * lut0, const std::uint64_t * lut1, std::size_t first_word, std::size_t last_word)
+{
+    static constexpr std::size_t segments = segment_parity_walker<n, J, DpfT>::segments;
+    std::array<std::uint64_t, fused_block_words> block;
+    lut_kernel::masked_sums sums;
+    auto flush = [&](std::size_t first, std::size_t count)
+    {
+        auto offset = first * 64;
+        auto len = std::min(count * 64, segments - offset);
+        sums += lut1 ? lut_kernel::masked_sum(block.data(), lut0 + offset, lut1 + offset, len)
+                     : lut_kernel::masked_sum(block.data(), lut0 + offset, len);
+    };
+    last_word = std::min(last_word, segment_parity_walker<n, J, DpfT>::words);
+    std::size_t pending = 0;
+    segment_parity_walker<n, J, DpfT>{dpf, shifted_input}.for_each_word(first_word, last_word,
+        [&](std::size_t w, std::uint64_t word)
+        {
+            block[pending++] = word;
+            if (pending == fused_block_words || w + 1 == last_word)
+            {
+                flush(w + 1 - pending, pending);
+                pending = 0;
+            }
+        });
+    return sums;
+}
+
+template <std::size_t n,
+          std::size_t J,
+          typename DpfT>
+lut_kernel::masked_sums fused_masked_sum(const DpfT & dpf, std::uint64_t shifted_input,
+    const std::uint64_t * lut0, const std::uint64_t * lut1 = nullptr)
+{
+    return fused_masked_sum<n, J>(dpf, shifted_input, lut0, lut1, 0, segment_parity_walker<n, J, DpfT>::words);
+}
+
+/// most evaluations `fused_masked_sum_batch` applies one LUT block to
+static constexpr std::size_t max_batch_tile = 8;
+
+/// batched `fused_masked_sum` over `count <= max_batch_tile` keys: for each
+/// block of `fused_block_words` parity words, walks every key's tree over
+/// that block and then applies the block's LUT slice to all of them while it
+/// is still in cache, so the LUT is streamed from memory once per tile
+/// rather than once per evaluation; adds the results into `out[0..count)`
+template <std::size_t n,
+          std::size_t J,
+          typename DpfT>
+void fused_masked_sum_batch(const std::shared_ptr<DpfT> * dpfs, const dpf::modint<L> * shifted_inputs,
+    std::size_t count, const std::uint64_t * lut0, const std::uint64_t * lut1, lut_kernel::masked_sums * out)
+{
+    using walker_type = segment_parity_walker<n, J, DpfT>;
+    std::array<std::array<std::uint64_t, fused_block_words>, max_batch_tile> blocks;
+    std::vector<walker_type> walkers;
+    walkers.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) walkers.emplace_back(*dpfs[i], shifted_inputs[i].reduced_value());
+
+    for (std::size_t first = 0; first < walker_type::words; first += fused_block_words)
+    {
+        auto last = std::min(first + fused_block_words, walker_type::words);
+        auto offset = first * 64;
+        auto len = std::min((last - first) * 64, walker_type::segments - offset);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            walkers[i].for_each_word(first, last, [&block = blocks[i], first](std::size_t w, std::uint64_t word)
+            {
+                block[w - first] = word;
+            });
+        }
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            out[i] += lut1 ? lut_kernel::masked_sum(blocks[i].data(), lut0 + offset, lut1 + offset, len)
+                           : lut_kernel::masked_sum(blocks[i].data(), lut0 + offset, len);
+        }
+    }
+}
+
+/// splits `count` evaluations into tiles for `fused_masked_sum_batch`: at
+/// most `max_batch_tile` per tile, but small enough that every hardware
+/// thread gets a tile when there are few evaluations
+struct batch_tiling
+{
+    explicit batch_tiling(std::size_t count)
+      : count{count},
+        tile{std::clamp<std::size_t>(count / std::max(1u, std::thread::hardware_concurrency()), 1, max_batch_tile)} { }
+
+    std::size_t tiles() const { return (count + tile - 1) / tile; }
+    std::size_t first(std::size_t t) const { return t * tile; }
+    std::size_t size(std::size_t t) const { return std::min(tile, count - t * tile); }
+
+    std::size_t count, tile;
+};
+
+/// `scaled_lut` viewed as the raw 64-bit words the kernels consume
+HEDLEY_ALWAYS_INLINE
+const std::uint64_t * lut_words()
+{
+    static_assert(sizeof(output_type) == sizeof(std::uint64_t));
+    return reinterpret_cast<const std::uint64_t *>(scaled_lut);
+}
+
+/// smallest number of segments worth handing to a separate worker
+static constexpr std::size_t min_chunk_segments = std::size_t(1) << 16;
+
+/// number of chunks `async_fused_masked_sum` splits a `2^J`-segment
+/// reduction into: one per hardware thread, but never chunks smaller than
+/// `min_chunk_segments` (so small `J` stays a single task)
+template <std::size_t J>
+std::size_t default_chunks()
+{
+    static const std::size_t chunks = std::clamp<std::size_t>((std::size_t(1) << J) / min_chunk_segments,
+        1, std::max(1u, std::thread::hardware_concurrency()));
+    return chunks;
+}
+
+/// splits `fused_masked_sum` into `chunks` contiguous ranges of parity words,
+/// evaluates them concurrently on `work_executor`, and completes with their
+/// total; the partial sums are combined by a fixed pairwise tree, so the
+/// reduction order does not depend on scheduling
+template <std::size_t n,
+          std::size_t J,
+          typename DpfT,
+          typename ExecutorT,
+          typename CompletionToken>
+[[nodiscard]]
+HEDLEY_ALWAYS_INLINE
+auto async_fused_masked_sum(ExecutorT work_executor, std::shared_ptr<DpfT> dpf, std::uint64_t shifted_input,
+    const std::uint64_t * lut0, const std::uint64_t * lut1, std::size_t chunks,
+    CompletionToken && token)
+{
+    static constexpr std::size_t words = segment_parity_walker<n, J, DpfT>::words;
+    chunks = std::clamp<std::size_t>(chunks, 1, words);
+    auto partials = std::make_shared<std::vector<lut_kernel::masked_sums>>(chunks);
+    return ::asio::async_compose<
+        CompletionToken, void(::asio::error_code, lut_kernel::masked_sums)>(
+            [
+                work_executor,
+                dpf,
+                shifted_input,
+                lut0,
+                lut1,
+                partials,
+                started = false
+            ]
+            (
+                auto & self,
+                const ::asio::error_code & error = {}
+            )
+            mutable
+            {
+                if (!started)
+                {
+                    started = true;
+                    auto chunks = partials->size();
+                    return (void)async_post_bulk(work_executor, chunks,
+                        [dpf, shifted_input, lut0, lut1, partials, chunks](std::size_t i)
+                        {
+                            (*partials)[i] = fused_masked_sum<n, J>(*dpf, shifted_input, lut0, lut1,
+                                words * i / chunks, words * (i + 1) / chunks);
+                        }, std::move(self));
+                }
+                for (std::size_t stride = 1; stride < partials->size(); stride *= 2)
+                {
+                    for (std::size_t i = 0; i + stride < partials->size(); i += 2 * stride)
+                    {
+                        (*partials)[i] += (*partials)[i + stride];
+                    }
+                }
+                self.complete(error, partials->front());
+            },
+        token, work_executor);
+}
+
+}  // namespace parities
+
+#endif  // PARITIES_HPP__
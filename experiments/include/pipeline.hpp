@@ -0,0 +1,462 @@
+#ifndef PIPELINE_HPP__
+#define PIPELINE_HPP__
+
+#include <algorithm>
+#include <exception>
+#include <vector>
+
+#include "batch.hpp"
+#include "shares.hpp"
+#include "stats.hpp"
+
+/// Runs `count` online evaluations with up to `window` of them in flight.
+///
+/// Evaluation `i` goes through four stages: its dealer values are read into
+/// a slot, its shifted input is revealed, its DPF/LUT work runs on the worker
+/// pool, and finally its Beaver operands are exchanged. Dealer reads and
+/// worker-pool computations proceed in the background, whereas the peer
+/// channel follows a fixed schedule: reveal `i` is sent as soon as fewer than
+/// `window` evaluations are awaiting their Beaver exchange, and otherwise the
+/// oldest outstanding Beaver exchange is sent. Since the schedule depends only
+/// on `count` and `window`, both peers must use the same `window`. With
+/// `window == 1` it is identical to the sequential protocol.
+///
+/// Each evaluation's DPF/LUT work is posted on its own as soon as its reveal
+/// completes. Reveals complete one at a time on the schedule above, so
+/// gathering several for `parities::fused_masked_sum_batch` would hold each
+/// back until the others arrive and run them on one worker instead of
+/// spreading them over the pool; that kernel is used by the batched mode
+/// (`batch.hpp`), where every input is revealed at once.
+///
+/// Evaluation `i` takes its input share from `inputs` right after its dealer
+/// values are read, and its output share goes to `outputs` with index `i`
+/// (see `shares.hpp`). If `inputs` runs out first, the run ends early, after
+/// the evaluations that already have an input; both peers' inputs must
+/// hold the same number of shares.
+///
+/// `EvaluationT` supplies the protocol-specific pieces:
+///   - `EvaluationT::async_read(dealer, work_executor, slot, token)`, which
+///     reads one evaluation's dealer values and completes with
+///     `(error, bytes_read)`;
+///   - `blinded_input`/`blinded_input2` and `blind_input(input_share)`, which
+///     hold and produce the (local and peer) reveal messages;
+///   - `compute()`, which runs on the worker pool after the reveal and leaves
+///     the Beaver operands in `operands` (anything it throws is rethrown on
+///     the I/O thread, like the protocol's own errors); and
+///   - `operands2` and `finish()`, which hold the peer's Beaver operands and
+///     produce the output share.
+template <typename EvaluationT,
+          typename DealerT,
+          typename PeerT,
+          typename ExecutorT,
+          typename InputT,
+          typename OutputT>
+struct online_pipeline_coro : asio::coroutine
+{
+#include <asio/yield.hpp>
+    enum class stage : psnip_uint8_t { empty = 0, reading, loaded, computing, computed };
+
+    struct state
+    {
+        template <typename IoExecutorT>
+        state(IoExecutorT io_executor, const EvaluationT & prototype,
+            InputT inputs, OutputT outputs, std::size_t count, std::size_t window)
+          : prototype{prototype}, inputs{std::forward<InputT>(inputs)},
+            outputs{std::forward<OutputT>(outputs)}, count{count}, window{window},
+            slots(window), stages(window, stage::empty), input_shares(window),
+            wakeup{io_executor}
+        {
+            for (auto & slot : slots) slot = std::make_shared<EvaluationT>(prototype);
+        }
+
+        EvaluationT prototype;
+        InputT inputs;
+        OutputT outputs;
+        std::size_t count, window;  ///< `count` drops if `inputs` runs out
+        std::vector<std::shared_ptr<EvaluationT>> slots;
+        std::vector<stage> stages;
+        std::vector<dpf::modint<L>> input_shares;
+        ::asio::steady_timer wakeup;  ///< cancelled whenever a stage completes
+        std::size_t next_read = 0, next_mult = 0;
+        bool read_in_flight = false;
+        std::size_t dealer_bytes_read = 0;
+    };
+
+  public:
+    online_pipeline_coro(DealerT & dealer, PeerT & peer,
+        ExecutorT work_executor, const EvaluationT & prototype,
+        InputT inputs, OutputT outputs, std::size_t count, std::size_t window)
+      : dealer_{dealer}, peer_{peer}, work_executor_{work_executor},
+        window_{std::max(window, std::size_t(1))},
+        st_{std::make_shared<state>(peer.get_executor(), prototype,
+            std::forward<InputT>(inputs), std::forward<OutputT>(outputs), count, window_)},
+        next_reveal_{0}, idx_{0},
+        peer_bytes_read_{0}, bytes_written_{0} { }
+
+    template <typename Self>
+    void operator()(Self & self,
+                    const asio::error_code & error = {},
+                    std::size_t bytes_just_read = 0,
+                    std::size_t bytes_just_written = 0)
+    {
+        reenter(*this)
+        {
+            issue_reads(st_, dealer_, work_executor_);
+            while (st_->next_mult < st_->count)
+            {
+                if (next_reveal_ < st_->count && next_reveal_ < st_->next_mult + window_)
+                {
+                    idx_ = next_reveal_ % window_;
+                    if (st_->stages[idx_] != stage::loaded) probe_.start();
+                    while (st_->stages[idx_] != stage::loaded && next_reveal_ < st_->count)
+                    {
+                        st_->wakeup.expires_at(::asio::steady_timer::time_point::max());
+                        yield st_->wakeup.async_wait(std::move(self));
+                        if (st_->stages[idx_] == stage::loaded) probe_.stop(stats::stage::wait);
+                    }
+                    if (next_reveal_ >= st_->count) continue;  // `inputs` ran out
+
+                    st_->slots[idx_]->blind_input(st_->input_shares[idx_]);
+                    probe_.start(peer_bytes_read_ + bytes_written_);
+                    yield async_exchange(peer_,
+                        asio::buffer(&st_->slots[idx_]->blinded_input, sizeof(st_->slots[idx_]->blinded_input)),
+                        asio::buffer(&st_->slots[idx_]->blinded_input2, sizeof(st_->slots[idx_]->blinded_input2)),
+                        std::move(self));
+                    peer_bytes_read_ += bytes_just_read;
+                    bytes_written_ += bytes_just_written;
+                    if (error) asio::detail::throw_error(error, "async_exchange(reveal)");
+                    probe_.stop(stats::stage::reveal, peer_bytes_read_ + bytes_written_, 1);
+
+                    st_->stages[idx_] = stage::computing;
+                    asio::post(work_executor_, [st = st_, idx = idx_, io_executor = peer_.get_executor()]()
+                    {
+                        stats::probe probe;
+                        probe.start();
+                        std::exception_ptr failure;
+                        try
+                        {
+                            st->slots[idx]->compute();
+                        }
+                        catch (...)
+                        {
+                            failure = std::current_exception();
+                        }
+                        probe.stop(stats::stage::compute);
+                        asio::post(io_executor, [st, idx, failure]()
+                        {
+                            if (failure) std::rethrow_exception(failure);
+                            st->stages[idx] = stage::computed;
+                            st->wakeup.cancel();
+                        });
+                    });
+                    ++next_reveal_;
+                }
+                else
+                {
+                    idx_ = st_->next_mult % window_;
+                    if (st_->stages[idx_] != stage::computed) probe_.start();
+                    while (st_->stages[idx_] != stage::computed)
+                    {
+                        st_->wakeup.expires_at(::asio::steady_timer::time_point::max());
+                        yield st_->wakeup.async_wait(std::move(self));
+                        if (st_->stages[idx_] == stage::computed) probe_.stop(stats::stage::wait);
+                    }
+
+                    probe_.start(peer_bytes_read_ + bytes_written_);
+                    yield async_exchange(peer_,
+                        asio::buffer(st_->slots[idx_]->operands),
+                        asio::buffer(st_->slots[idx_]->operands2),
+                        std::move(self));
+                    peer_bytes_read_ += bytes_just_read;
+                    bytes_written_ += bytes_just_written;
+                    if (error) asio::detail::throw_error(error, "async_exchange(blinded)");
+                    probe_.stop(stats::stage::beaver, peer_bytes_read_ + bytes_written_, 1);
+
+                    shares::put_output(st_->outputs, st_->next_mult, st_->slots[idx_]->finish());
+                    st_->stages[idx_] = stage::empty;
+                    ++st_->next_mult;
+                    issue_reads(st_, dealer_, work_executor_);
+                }
+            }
+
+            shares::stop_input(st_->inputs);
+            self.complete(asio::error_code{}, st_->dealer_bytes_read, peer_bytes_read_, bytes_written_);
+        }
+    }
+
+  private:
+    /// starts reading the next evaluation's dealer values if its slot is free
+    static void issue_reads(std::shared_ptr<state> st, DealerT & dealer, ExecutorT work_executor)
+    {
+        if (st->read_in_flight
+            || st->next_read >= st->count
+            || st->next_read >= st->next_mult + st->window) return;
+
+        auto idx = st->next_read % st->window;
+        st->read_in_flight = true;
+        st->stages[idx] = stage::reading;
+        *st->slots[idx] = st->prototype;
+        stats::probe probe;
+        probe.start();
+        EvaluationT::async_read(dealer, work_executor, st->slots[idx],
+            [st, &dealer, work_executor, idx, probe](const asio::error_code & error, std::size_t bytes_read) mutable
+            {
+                if (error) asio::detail::throw_error(error, "async_read(evaluation)");
+                probe.stop(stats::stage::dealer_record, bytes_read);
+                st->dealer_bytes_read += bytes_read;
+                shares::next_input(st->inputs, [st, &dealer, work_executor, idx](const asio::error_code & error, dpf::modint<L> input_share)
+                {
+                    st->read_in_flight = false;
+                    st->wakeup.cancel();
+                    if (error == asio::error::eof)
+                    {
+                        st->count = st->next_read;
+                        st->stages[idx] = stage::empty;
+                        return;
+                    }
+                    if (error) asio::detail::throw_error(error, "next_input");
+                    st->input_shares[idx] = input_share;
+                    st->stages[idx] = stage::loaded;
+                    ++st->next_read;
+                    issue_reads(st, dealer, work_executor);
+                });
+            });
+    }
+
+    DealerT & dealer_;
+    PeerT & peer_;
+    ExecutorT work_executor_;
+    std::size_t window_;
+    std::shared_ptr<state> st_;
+    std::size_t next_reveal_, idx_;
+    std::size_t peer_bytes_read_, bytes_written_;
+    stats::probe probe_;
+#include <asio/unyield.hpp>
+};
+
+/// `inputs` and `outputs` are kept by reference if they are lvalues, and
+/// moved in otherwise
+template <typename EvaluationT,
+          typename DealerT,
+          typename PeerT,
+          typename ExecutorT,
+          typename InputT,
+          typename OutputT,
+          typename CompletionToken>
+[[nodiscard]]
+HEDLEY_ALWAYS_INLINE
+auto async_online_pipeline(DealerT & dealer, PeerT & peer, ExecutorT work_executor, const EvaluationT & prototype,
+    InputT && inputs, OutputT && outputs, std::size_t count, std::size_t window, CompletionToken && token)
+{
+    return asio::async_compose<CompletionToken,
+        void(asio::error_code,
+             std::size_t,
+             std::size_t,
+             std::size_t)>(online_pipeline_coro<EvaluationT, DealerT, PeerT, ExecutorT, InputT, OutputT>{dealer, peer, work_executor, prototype,
+                 std::forward<InputT>(inputs), std::forward<OutputT>(outputs), count, window},
+              token, dealer, peer, work_executor);
+}
+
+/// Runs `count` online evaluations over a tagged `ChannelT` (see
+/// `coalesce::channel`), with up to `window` of them in flight.
+///
+/// The stages are those of `online_pipeline_coro`, and `EvaluationT` is the
+/// same, but no evaluation waits for another's peer exchange: each one
+/// reveals its input as soon as its dealer values are loaded and exchanges
+/// its Beaver operands as soon as its computation is done. Its messages are
+/// tagged `2*i` (reveal) and `2*i+1` (Beaver), so that the channel can pack
+/// those of all ready evaluations into shared writes and route the peer's
+/// replies back. Since nothing depends on the order of exchanges, the peers
+/// need not use the same `window`. Inputs and outputs are handled as in
+/// `online_pipeline_coro`.
+template <typename EvaluationT,
+          typename DealerT,
+          typename ChannelT,
+          typename ExecutorT,
+          typename InputT,
+          typename OutputT>
+struct online_coalesced_coro : asio::coroutine
+{
+#include <asio/yield.hpp>
+    struct state
+    {
+        state(DealerT & dealer, ChannelT & channel, ExecutorT work_executor,
+            const EvaluationT & prototype, InputT inputs, OutputT outputs,
+            std::size_t count, std::size_t window)
+          : dealer{dealer}, channel{channel}, work_executor{work_executor},
+            prototype{prototype}, inputs{std::forward<InputT>(inputs)},
+            outputs{std::forward<OutputT>(outputs)}, count{count},
+            window{window}, slots(window), busy(window, false),
+            input_shares(window), done{channel.get_executor()}
+        {
+            for (auto & slot : slots) slot = std::make_shared<EvaluationT>(prototype);
+        }
+
+        DealerT & dealer;
+        ChannelT & channel;
+        ExecutorT work_executor;
+        EvaluationT prototype;
+        InputT inputs;
+        OutputT outputs;
+        std::size_t count, window;  ///< `count` drops if `inputs` runs out
+        std::vector<std::shared_ptr<EvaluationT>> slots;
+        std::vector<bool> busy;
+        std::vector<dpf::modint<L>> input_shares;
+        ::asio::steady_timer done;  ///< cancelled once the last evaluation finishes
+        std::size_t next_read = 0, finished = 0;
+        bool read_in_flight = false;
+        std::size_t dealer_bytes_read = 0, peer_bytes_read = 0, bytes_written = 0;
+    };
+
+  public:
+    online_coalesced_coro(DealerT & dealer, ChannelT & channel,
+        ExecutorT work_executor, const EvaluationT & prototype,
+        InputT inputs, OutputT outputs, std::size_t count, std::size_t window)
+      : st_{std::make_shared<state>(dealer, channel, work_executor, prototype,
+            std::forward<InputT>(inputs), std::forward<OutputT>(outputs),
+            count, std::max(window, std::size_t(1)))} { }
+
+    template <typename Self>
+    void operator()(Self & self, const asio::error_code & = {})
+    {
+        reenter(*this)
+        {
+            issue_reads(st_);
+            while (st_->finished < st_->count)
+            {
+                st_->done.expires_at(::asio::steady_timer::time_point::max());
+                yield st_->done.async_wait(std::move(self));
+            }
+
+            shares::stop_input(st_->inputs);
+            self.complete(asio::error_code{}, st_->dealer_bytes_read, st_->peer_bytes_read, st_->bytes_written);
+        }
+    }
+
+  private:
+    static std::uint32_t tag(std::size_t i, bool beaver) { return std::uint32_t(2 * i + beaver); }
+
+    /// starts reading the next evaluation's dealer values if its slot is free
+    static void issue_reads(std::shared_ptr<state> st)
+    {
+        if (st->read_in_flight || st->next_read >= st->count) return;
+
+        auto i = st->next_read, idx = i % st->window;
+        if (st->busy[idx]) return;
+        st->read_in_flight = true;
+        st->busy[idx] = true;
+        *st->slots[idx] = st->prototype;
+        stats::probe probe;
+        probe.start();
+        EvaluationT::async_read(st->dealer, st->work_executor, st->slots[idx],
+            [st, i, idx, probe](const asio::error_code & error, std::size_t bytes_read) mutable
+            {
+                if (error) asio::detail::throw_error(error, "async_read(evaluation)");
+                probe.stop(stats::stage::dealer_record, bytes_read);
+                st->dealer_bytes_read += bytes_read;
+                shares::next_input(st->inputs, [st, i, idx](const asio::error_code & error, dpf::modint<L> input_share)
+                {
+                    st->read_in_flight = false;
+                    if (error == asio::error::eof)
+                    {
+                        st->count = i;
+                        st->busy[idx] = false;
+                        if (st->finished == st->count) st->done.cancel();
+                        return;
+                    }
+                    if (error) asio::detail::throw_error(error, "next_input");
+                    st->input_shares[idx] = input_share;
+                    ++st->next_read;
+                    reveal(st, i, idx);
+                    issue_reads(st);
+                });
+            });
+    }
+
+    /// reveals evaluation `i`'s masked input, then computes on the worker pool
+    static void reveal(std::shared_ptr<state> st, std::size_t i, std::size_t idx)
+    {
+        auto & slot = *st->slots[idx];
+        slot.blind_input(st->input_shares[idx]);
+        stats::probe probe;
+        probe.start();
+        st->channel.async_exchange(tag(i, false),
+            asio::buffer(&slot.blinded_input, sizeof(slot.blinded_input)),
+            asio::buffer(&slot.blinded_input2, sizeof(slot.blinded_input2)),
+            [st, i, idx, probe](const asio::error_code & error, std::size_t bytes_read, std::size_t bytes_written) mutable
+            {
+                if (error) asio::detail::throw_error(error, "async_exchange(reveal)");
+                probe.stop(stats::stage::reveal, bytes_read + bytes_written, 1);
+                st->peer_bytes_read += bytes_read;
+                st->bytes_written += bytes_written;
+                asio::post(st->work_executor, [st, i, idx]()
+                {
+                    stats::probe probe;
+                    probe.start();
+                    std::exception_ptr failure;
+                    try
+                    {
+                        st->slots[idx]->compute();
+                    }
+                    catch (...)
+                    {
+                        failure = std::current_exception();
+                    }
+                    probe.stop(stats::stage::compute);
+                    asio::post(st->channel.get_executor(), [st, i, idx, failure]()
+                    {
+                        if (failure) std::rethrow_exception(failure);
+                        multiply(st, i, idx);
+                    });
+                });
+            });
+    }
+
+    /// exchanges evaluation `i`'s Beaver operands and finishes it
+    static void multiply(std::shared_ptr<state> st, std::size_t i, std::size_t idx)
+    {
+        auto & slot = *st->slots[idx];
+        stats::probe probe;
+        probe.start();
+        st->channel.async_exchange(tag(i, true),
+            asio::buffer(slot.operands),
+            asio::buffer(slot.operands2),
+            [st, i, idx, probe](const asio::error_code & error, std::size_t bytes_read, std::size_t bytes_written) mutable
+            {
+                if (error) asio::detail::throw_error(error, "async_exchange(blinded)");
+                probe.stop(stats::stage::beaver, bytes_read + bytes_written, 1);
+                st->peer_bytes_read += bytes_read;
+                st->bytes_written += bytes_written;
+                shares::put_output(st->outputs, i, st->slots[idx]->finish());
+                st->busy[idx] = false;
+                if (++st->finished == st->count) st->done.cancel();
+                issue_reads(st);
+            });
+    }
+
+    std::shared_ptr<state> st_;
+#include <asio/unyield.hpp>
+};
+
+template <typename EvaluationT,
+          typename DealerT,
+          typename ChannelT,
+          typename ExecutorT,
+          typename InputT,
+          typename OutputT,
+          typename CompletionToken>
+[[nodiscard]]
+HEDLEY_ALWAYS_INLINE
+auto async_online_coalesced(DealerT & dealer, ChannelT & channel, ExecutorT work_executor, const EvaluationT & prototype,
+    InputT && inputs, OutputT && outputs, std::size_t count, std::size_t window, CompletionToken && token)
+{
+    return asio::async_compose<CompletionToken,
+        void(asio::error_code,
+             std::size_t,
+             std::size_t,
+             std::size_t)>(online_coalesced_coro<EvaluationT, DealerT, ChannelT, ExecutorT, InputT, OutputT>{dealer, channel, work_executor, prototype,
+                 std::forward<InputT>(inputs), std::forward<OutputT>(outputs), count, window},
+              token, dealer, channel, work_executor);
+}
+
+#endif  // PIPELINE_HPP__
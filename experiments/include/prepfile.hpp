@@ -0,0 +1,310 @@
+#ifndef PREPFILE_HPP__
+#define PREPFILE_HPP__
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/// Container format for a client's preprocessed dealer values.
+///
+/// A file starts with a fixed-size `header`, followed by an index of `count`
+/// absolute record offsets and then the records themselves. Each record holds
+/// one evaluation's dealer values, with every field starting on a 16-byte
+/// boundary so that the online phase can use them in place (in particular,
+/// DPF keys and DCF key blocks are never copied out of the mapping; only the
+/// bit-packed DCF correction values are unpacked). Records themselves
+/// start on `record_alignment` boundaries; when all records have the same
+/// size, `record_stride` is that size and record `i` is at
+/// `data_offset + i * record_stride`.
+///
+/// Haar's dealer values do not depend on `(n, J)`, so Haar files record both
+/// as zero and are accepted for any configuration.
+namespace prepfile
+{
+
+static constexpr std::array<char, 8> magic = {'W', 'A', 'V', 'E', 'P', 'R', 'E', 'P'};
+static constexpr std::uint32_t version = 2;  ///< 2: packed DCF keys (see `dcf.hpp`)
+static constexpr std::size_t field_alignment = 16;
+static constexpr std::size_t record_alignment = 64;
+
+enum class transform_t : std::uint8_t { Haar = 0, bior = 1 };
+
+struct header
+{
+    std::array<char, 8> magic = prepfile::magic;
+    std::uint32_t version = prepfile::version;
+    std::uint32_t header_bytes = sizeof(header);
+    std::uint8_t L = 0, n = 0, J = 0;
+    transform_t transform = transform_t::Haar;
+    std::uint8_t seeded = 0;                 ///< records hold seeds (see `prg.hpp`)
+    std::array<std::uint8_t, 3> reserved{};
+    std::uint64_t count = 0;                 ///< number of records
+    std::uint64_t record_stride = 0;         ///< record size if uniform, else 0
+    std::uint64_t index_offset = 0;          ///< offset of the record index
+    std::uint64_t data_offset = 0;           ///< offset of the first record
+    std::uint64_t file_bytes = 0;            ///< total size of the file
+};
+static_assert(sizeof(header) == 64, "prepfile::header must stay 64 bytes");
+
+HEDLEY_ALWAYS_INLINE
+constexpr std::size_t align_up(std::size_t offset, std::size_t alignment)
+{
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+/// returns a header for `count` records, with the index and data offsets filled in
+HEDLEY_ALWAYS_INLINE
+header make_header(transform_t transform, std::size_t L, std::size_t n, std::size_t J,
+    bool seeded, std::size_t count)
+{
+    header info;
+    info.L = L;
+    info.n = n;
+    info.J = J;
+    info.transform = transform;
+    info.seeded = seeded;
+    info.count = count;
+    info.index_offset = sizeof(header);
+    info.data_offset = align_up(info.index_offset + count * sizeof(std::uint64_t), record_alignment);
+    info.file_bytes = info.data_offset;
+    return info;
+}
+
+/// serializes one record, padding each field to `field_alignment`
+class record_builder
+{
+  public:
+    void clear() { bytes_.clear(); }
+
+    void append(const void * data, std::size_t size)
+    {
+        auto offset = bytes_.size();
+        bytes_.resize(align_up(offset + size, field_alignment), 0);
+        std::memcpy(bytes_.data() + offset, data, size);
+    }
+
+    /// appends the bytes of `value`, which must be safe to copy bitwise
+    template <typename T>
+    void append(const T & value)
+    {
+        append(&value, sizeof(value));
+    }
+
+    /// pads the record so that the next one starts on a `record_alignment` boundary
+    void finish() { bytes_.resize(align_up(bytes_.size(), record_alignment), 0); }
+
+    const std::vector<unsigned char> & bytes() const { return bytes_; }
+
+  private:
+    std::vector<unsigned char> bytes_;
+};
+
+/// walks the fields of one record, `[record, end)`, inside a mapping
+class record_cursor
+{
+  public:
+    record_cursor(const unsigned char * record, const unsigned char * end)
+      : begin_{record}, pos_{record}, end_{end} { }
+
+    /// returns the next field; throws if it would run past the record
+    const void * next(std::size_t size)
+    {
+        if (HEDLEY_UNLIKELY(size > std::size_t(end_ - pos_)))
+        {
+            throw std::out_of_range("prepfile::record_cursor: field runs past the end of its record");
+        }
+        auto field = pos_;
+        pos_ += std::min(align_up(size, field_alignment), std::size_t(end_ - pos_));
+        return field;
+    }
+
+    /// returns the next field, which `record_builder::append` wrote from a `T`
+    template <typename T>
+    const T & next()
+    {
+        return *reinterpret_cast<const T *>(next(sizeof(T)));
+    }
+
+    std::size_t bytes_read() const { return align_up(pos_ - begin_, record_alignment); }
+
+  private:
+    const unsigned char * begin_;
+    const unsigned char * pos_;
+    const unsigned char * end_;
+};
+
+/// writes `count` records to `outfile` and then goes back to fill in the
+/// header and index; used by the preprocessing clients
+class writer
+{
+  public:
+    explicit writer(const header & info)
+      : info_{info}, offsets_{}, stride_{0}, uniform_{true}
+    {
+        offsets_.reserve(info.count);
+    }
+
+    /// offset at which the record data starts (i.e., where to seek first)
+    std::uint64_t data_offset() const { return info_.data_offset; }
+
+    /// records that a record of `size` bytes was appended
+    void add_record(std::size_t size)
+    {
+        offsets_.push_back(info_.file_bytes);
+        info_.file_bytes += size;
+        if (offsets_.size() == 1) stride_ = size;
+        else if (size != stride_) uniform_ = false;
+    }
+
+    /// finalizes the header and returns the buffers to write at offset 0
+    std::array<asio::const_buffer, 2> finish()
+    {
+        if (offsets_.size() != info_.count) throw std::logic_error("prepfile::writer: record count mismatch");
+        info_.record_stride = uniform_ ? stride_ : 0;
+        return {asio::buffer(&info_, sizeof(info_)), asio::buffer(offsets_)};
+    }
+
+  private:
+    header info_;
+    std::vector<std::uint64_t> offsets_;
+    std::size_t stride_;
+    bool uniform_;
+};
+
+/// returns true if `path` starts with the container's magic bytes
+inline bool is_container(const std::string & path)
+{
+    std::array<char, 8> buf{};
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    bool ok = ::read(fd, buf.data(), buf.size()) == ssize_t(buf.size()) && buf == magic;
+    ::close(fd);
+    return ok;
+}
+
+/// A read-only mapping of a container file. The online phase reads records
+/// through this instead of a stream; it hands out records in order (like a
+/// stream would) but also allows random access via `record(i)`. The header
+/// and every index entry are checked against the file's size when it is
+/// opened, and each record's fields against the record's extent (up to the
+/// next record) as they are read.
+class mapped_file
+{
+  public:
+    using executor_type = asio::any_io_executor;
+
+    /// maps `path` and checks its header against the expected parameters
+    template <typename ExecutorT>
+    mapped_file(ExecutorT executor, const std::string & path, transform_t transform,
+        std::size_t L, std::size_t n, std::size_t J, bool seeded)
+      : executor_{executor}, next_{0}
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw std::system_error(errno, std::generic_category(), "open(" + path + ")");
+        struct stat st;
+        if (fstat(fd, &st) < 0 || std::size_t(st.st_size) < sizeof(header))
+        {
+            ::close(fd);
+            throw std::runtime_error(path + " is too short to be a preprocessing file");
+        }
+        size_ = st.st_size;
+        auto base = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE|MAP_POPULATE, fd, off_t(0));
+        ::close(fd);
+        if (base == MAP_FAILED) throw std::system_error(errno, std::generic_category(), "mmap(" + path + ")");
+        base_ = static_cast<const unsigned char *>(base);
+        info_ = reinterpret_cast<const header *>(base_);
+
+        auto fail = [&](const std::string & what)
+        {
+            munmap(const_cast<unsigned char *>(base_), size_);
+            throw std::runtime_error(path + ": " + what);
+        };
+        if (info_->magic != magic) fail("not a preprocessing file");
+        if (info_->version != version) fail("unsupported version " + std::to_string(info_->version));
+        if (info_->file_bytes > size_) fail("truncated");
+        if (info_->index_offset < sizeof(header) || info_->index_offset > info_->file_bytes
+            || info_->count > (info_->file_bytes - info_->index_offset) / sizeof(std::uint64_t)
+            || info_->data_offset < info_->index_offset + info_->count * sizeof(std::uint64_t)
+            || info_->data_offset > info_->file_bytes)
+        {
+            fail("index runs past the end of the file");
+        }
+        if (info_->transform != transform) fail("wrong transform");
+        if (info_->L != L) fail("wrong L");
+        if (transform == transform_t::bior && (info_->n != n || info_->J != J)) fail("wrong (n, J)");
+        if (bool(info_->seeded) != seeded) fail(seeded ? "not seed-compressed" : "seed-compressed");
+        index_ = reinterpret_cast<const std::uint64_t *>(base_ + info_->index_offset);
+        for (std::size_t i = 0, previous = info_->data_offset; i < info_->count; previous = index_[i++])
+        {
+            if (index_[i] < previous || index_[i] > info_->file_bytes)
+            {
+                fail("record " + std::to_string(i) + " is outside the file");
+            }
+        }
+    }
+
+    mapped_file(const mapped_file &) = delete;
+    mapped_file & operator=(const mapped_file &) = delete;
+
+    ~mapped_file() { munmap(const_cast<unsigned char *>(base_), size_); }
+
+    executor_type get_executor() const noexcept { return executor_; }
+
+    const header & info() const { return *info_; }
+    std::size_t count() const { return info_->count; }
+
+    record_cursor record(std::size_t i) const
+    {
+        if (HEDLEY_UNLIKELY(i >= info_->count)) throw std::out_of_range("prepfile::mapped_file::record");
+        auto end = (i + 1 < info_->count) ? index_[i + 1] : info_->file_bytes;
+        return record_cursor{base_ + index_[i], base_ + end};
+    }
+
+    /// returns the next record in file order
+    record_cursor next_record() { return record(next_++); }
+
+  private:
+    executor_type executor_;
+    const unsigned char * base_;
+    std::size_t size_;
+    const header * info_;
+    const std::uint64_t * index_;
+    std::size_t next_;
+};
+
+/// loads the next record of `dealer` into `*evaluation` (via its `load`
+/// member) and completes with the record's size, mirroring the signature of
+/// the stream-based `EvaluationT::async_read`s used by `online_pipeline_coro`
+template <typename EvaluationT,
+          typename CompletionToken>
+[[nodiscard]]
+HEDLEY_ALWAYS_INLINE
+auto async_load(mapped_file & dealer, std::shared_ptr<EvaluationT> evaluation, CompletionToken && token)
+{
+    return ::asio::async_initiate<CompletionToken, void(::asio::error_code, std::size_t)>(
+        [&dealer, evaluation](auto handler)
+        {
+            auto bytes_read = evaluation->load(dealer.next_record());
+            auto ex = ::asio::get_associated_executor(handler, dealer.get_executor());
+            ::asio::post(ex, [h = std::move(handler), bytes_read]() mutable
+            {
+                std::move(h)(::asio::error_code{}, bytes_read);
+            });
+        },
+        token);
+}
+
+}  // namespace prepfile
+
+#endif  // PREPFILE_HPP__
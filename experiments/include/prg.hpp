@@ -0,0 +1,89 @@
+#ifndef PRG_HPP__
+#define PRG_HPP__
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <immintrin.h>
+
+/// Seed expansion for compressed preprocessing.
+///
+/// In compressed mode the dealer sends party 0 a 16-byte seed in place of its
+/// Beaver/mask shares; both the dealer and party 0 expand it with AES-128 in
+/// counter mode (keyed by the seed) to obtain the same pseudorandom shares,
+/// and only party 1 receives explicit values, chosen so that the two shares
+/// still add up to the secret.
+namespace prg
+{
+
+using seed_type = std::array<std::uint64_t, 2>;
+
+namespace detail
+{
+
+template <int Rcon>
+HEDLEY_ALWAYS_INLINE
+__m128i expand_round_key(__m128i key)
+{
+    auto assist = _mm_shuffle_epi32(_mm_aeskeygenassist_si128(key, Rcon), _MM_SHUFFLE(3, 3, 3, 3));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    return _mm_xor_si128(key, assist);
+}
+
+}  // namespace detail
+
+/// samples a fresh seed
+HEDLEY_ALWAYS_INLINE
+seed_type make_seed()
+{
+    return seed_type{dpf::uniform_sample<dpf::modint<64>>().reduced_value(),
+                     dpf::uniform_sample<dpf::modint<64>>().reduced_value()};
+}
+
+/// expands `seed` into `N` pseudorandom 64-bit words
+template <std::size_t N>
+std::array<std::uint64_t, N> expand(const seed_type & seed)
+{
+    std::array<__m128i, 11> rk;
+    rk[0] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(seed.data()));
+    rk[1] = detail::expand_round_key<0x01>(rk[0]);
+    rk[2] = detail::expand_round_key<0x02>(rk[1]);
+    rk[3] = detail::expand_round_key<0x04>(rk[2]);
+    rk[4] = detail::expand_round_key<0x08>(rk[3]);
+    rk[5] = detail::expand_round_key<0x10>(rk[4]);
+    rk[6] = detail::expand_round_key<0x20>(rk[5]);
+    rk[7] = detail::expand_round_key<0x40>(rk[6]);
+    rk[8] = detail::expand_round_key<0x80>(rk[7]);
+    rk[9] = detail::expand_round_key<0x1B>(rk[8]);
+    rk[10] = detail::expand_round_key<0x36>(rk[9]);
+
+    std::array<std::uint64_t, (N + 1) & ~std::size_t(1)> words;
+    for (std::size_t i = 0; i < words.size() / 2; ++i)
+    {
+        auto block = _mm_xor_si128(_mm_set_epi64x(0, i), rk[0]);
+        for (std::size_t r = 1; r < 10; ++r) block = _mm_aesenc_si128(block, rk[r]);
+        block = _mm_aesenclast_si128(block, rk[10]);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&words[2 * i]), block);
+    }
+
+    std::array<std::uint64_t, N> out;
+    for (std::size_t i = 0; i < N; ++i) out[i] = words[i];
+    return out;
+}
+
+/// expands `seed` into `N` pseudorandom shares
+template <typename T, std::size_t N>
+HEDLEY_ALWAYS_INLINE
+std::array<T, N> expand_shares(const seed_type & seed)
+{
+    auto words = expand<N>(seed);
+    std::array<T, N> out;
+    for (std::size_t i = 0; i < N; ++i) out[i] = T(words[i]);
+    return out;
+}
+
+}  // namespace prg
+
+#endif  // PRG_HPP__
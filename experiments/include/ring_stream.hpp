@@ -0,0 +1,534 @@
+#ifndef RING_STREAM_HPP__
+#define RING_STREAM_HPP__
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/// Shared-memory transport for co-located parties.
+///
+/// A `ring_region` holds two single-producer/single-consumer byte rings, one
+/// per direction; a `ring_stream` is one end of it and models asio's
+/// `AsyncReadStream` and `AsyncWriteStream`, so it can stand in for a
+/// `tcp::socket` as the `PeerT`/`DealerT` of any protocol. Side 0 writes to
+/// ring 0 and reads from ring 1; side 1 does the opposite.
+///
+/// A region lives either in anonymous shared memory (`ring_region::create`,
+/// for two ends in the same process) or in a `memfd` whose descriptor is
+/// handed to the other process over a Unix-domain socket (`ring_listener` /
+/// `ring::connect`). The rings themselves are lock-free: each end only ever
+/// stores its own position, so the only synchronization is an acquire/release
+/// pair per operation. A reader or writer that cannot make progress polls,
+/// first by re-posting itself and then with a short, growing timer.
+namespace ring
+{
+
+static constexpr std::uint64_t magic = 0x474e495245564157;  // "WAVERING"
+static constexpr std::size_t default_capacity = std::size_t(1) << 22;
+static constexpr unsigned spin_polls = 64;  ///< re-posts before falling back to the timer
+static constexpr auto max_backoff = std::chrono::microseconds(64);
+
+struct ring_control
+{
+    alignas(64) std::atomic<std::uint64_t> head;  ///< bytes written; stored by the writer
+    alignas(64) std::atomic<std::uint64_t> tail;  ///< bytes read; stored by the reader
+    alignas(64) std::atomic<std::uint32_t> closed;  ///< set once the writer's end is gone
+};
+
+struct region_header
+{
+    std::uint64_t magic;
+    std::uint64_t capacity;  ///< bytes per ring (a power of two)
+    std::array<ring_control, 2> rings;
+};
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free,
+    "ring_stream needs address-free 64-bit atomics to share them between processes");
+
+namespace detail
+{
+
+HEDLEY_ALWAYS_INLINE
+std::size_t data_offset()
+{
+    return (sizeof(region_header) + 4095) & ~std::size_t(4095);
+}
+
+HEDLEY_ALWAYS_INLINE
+sockaddr_un unix_address(const std::string & path)
+{
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) throw std::invalid_argument("socket path too long: " + path);
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return addr;
+}
+
+HEDLEY_ALWAYS_INLINE
+void send_fd(int socket, int fd)
+{
+    char byte = 0;
+    iovec iov{&byte, 1};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    auto cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    std::memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    if (sendmsg(socket, &msg, 0) < 0) throw std::system_error(errno, std::generic_category(), "sendmsg");
+}
+
+HEDLEY_ALWAYS_INLINE
+int receive_fd(int socket)
+{
+    char byte;
+    iovec iov{&byte, 1};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (recvmsg(socket, &msg, 0) <= 0) throw std::system_error(errno, std::generic_category(), "recvmsg");
+    auto cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_type != SCM_RIGHTS) throw std::runtime_error("ring_connect: no descriptor received");
+    int fd;
+    std::memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+    return fd;
+}
+
+}  // namespace detail
+
+/// a mapping that holds the two rings shared by the ends of a `ring_stream`
+class ring_region
+{
+  public:
+    /// creates a region of two `capacity`-byte rings; with `shareable`, it is
+    /// backed by a `memfd` that can be passed to another process
+    static std::shared_ptr<ring_region> create(std::size_t capacity = default_capacity, bool shareable = false)
+    {
+        if (capacity & (capacity - 1)) throw std::invalid_argument("ring capacity must be a power of two");
+        int fd = -1;
+        std::size_t size = detail::data_offset() + 2 * capacity;
+        if (shareable)
+        {
+            fd = memfd_create("wave-ring", MFD_CLOEXEC);
+            if (fd < 0) throw std::system_error(errno, std::generic_category(), "memfd_create");
+            if (ftruncate(fd, size) < 0)
+            {
+                ::close(fd);
+                throw std::system_error(errno, std::generic_category(), "ftruncate");
+            }
+        }
+        auto region = std::shared_ptr<ring_region>(new ring_region{fd, size});
+        auto header = region->header();
+        header->capacity = capacity;
+        for (auto & control : header->rings)
+        {
+            control.head.store(0, std::memory_order_relaxed);
+            control.tail.store(0, std::memory_order_relaxed);
+            control.closed.store(0, std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+        header->magic = magic;
+        return region;
+    }
+
+    /// maps a region that another process created and sent us `fd` for
+    static std::shared_ptr<ring_region> attach(int fd)
+    {
+        region_header probe;
+        if (pread(fd, &probe, sizeof(probe), 0) != ssize_t(sizeof(probe)) || probe.magic != magic)
+        {
+            ::close(fd);
+            throw std::runtime_error("ring_region: not a ring region");
+        }
+        return std::shared_ptr<ring_region>(new ring_region{fd, detail::data_offset() + 2 * probe.capacity});
+    }
+
+    ring_region(const ring_region &) = delete;
+    ring_region & operator=(const ring_region &) = delete;
+
+    ~ring_region()
+    {
+        munmap(base_, size_);
+        if (fd_ >= 0) ::close(fd_);
+    }
+
+    int native_handle() const { return fd_; }
+    region_header * header() const { return static_cast<region_header *>(base_); }
+    std::size_t capacity() const { return header()->capacity; }
+    ring_control & control(int ring) const { return header()->rings[ring]; }
+    unsigned char * data(int ring) const
+    {
+        return static_cast<unsigned char *>(base_) + detail::data_offset() + ring * capacity();
+    }
+
+  private:
+    ring_region(int fd, std::size_t size) : fd_{fd}, size_{size}
+    {
+        base_ = (fd < 0) ? mmap(nullptr, size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, off_t(0))
+                         : mmap(nullptr, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, off_t(0));
+        if (base_ == MAP_FAILED)
+        {
+            if (fd >= 0) ::close(fd);
+            throw std::system_error(errno, std::generic_category(), "mmap(ring_region)");
+        }
+    }
+
+    int fd_;
+    std::size_t size_;
+    void * base_;
+};
+
+/// one end of a `ring_region`
+class ring_stream
+{
+  public:
+    using executor_type = asio::any_io_executor;
+
+    template <typename ExecutorT>
+    ring_stream(ExecutorT executor, std::shared_ptr<ring_region> region, int side)
+      : executor_{executor}, region_{std::move(region)},
+        tx_{side}, rx_{1 - side},
+        read_timer_{executor}, write_timer_{executor} { }
+
+    ring_stream(const ring_stream &) = delete;
+    ring_stream & operator=(const ring_stream &) = delete;
+
+    ~ring_stream() { close(); }
+
+    executor_type get_executor() const noexcept { return executor_; }
+
+    /// marks this end's outgoing ring as closed; the other end reads `eof`
+    /// once it has drained it
+    void close() { if (region_) region_->control(tx_).closed.store(1, std::memory_order_release); }
+
+    /// copies as much of `buffers` as fits into the outgoing ring
+    template <typename ConstBufferSequence>
+    std::size_t write_some_nonblocking(const ConstBufferSequence & buffers)
+    {
+        auto & control = region_->control(tx_);
+        auto capacity = region_->capacity();
+        auto head = control.head.load(std::memory_order_relaxed);
+        auto space = capacity - (head - control.tail.load(std::memory_order_acquire));
+        auto data = region_->data(tx_);
+        std::size_t written = 0;
+        for (auto it = asio::buffer_sequence_begin(buffers); it != asio::buffer_sequence_end(buffers) && space; ++it)
+        {
+            asio::const_buffer buffer{*it};
+            auto size = std::min(buffer.size(), space);
+            copy_in(data, capacity, head + written, static_cast<const unsigned char *>(buffer.data()), size);
+            written += size;
+            space -= size;
+        }
+        if (written) control.head.store(head + written, std::memory_order_release);
+        return written;
+    }
+
+    /// copies as much of the incoming ring as fits into `buffers`
+    template <typename MutableBufferSequence>
+    std::size_t read_some_nonblocking(const MutableBufferSequence & buffers)
+    {
+        auto & control = region_->control(rx_);
+        auto capacity = region_->capacity();
+        auto tail = control.tail.load(std::memory_order_relaxed);
+        auto available = control.head.load(std::memory_order_acquire) - tail;
+        auto data = region_->data(rx_);
+        std::size_t read = 0;
+        for (auto it = asio::buffer_sequence_begin(buffers); it != asio::buffer_sequence_end(buffers) && available; ++it)
+        {
+            asio::mutable_buffer buffer{*it};
+            auto size = std::min(buffer.size(), available);
+            copy_out(data, capacity, tail + read, static_cast<unsigned char *>(buffer.data()), size);
+            read += size;
+            available -= size;
+        }
+        if (read) control.tail.store(tail + read, std::memory_order_release);
+        return read;
+    }
+
+    /// blocking counterparts of `async_read_some`/`async_write_some`, which
+    /// spin (yielding the thread) until they can make progress
+    template <typename MutableBufferSequence>
+    std::size_t read_some(const MutableBufferSequence & buffers, asio::error_code & error)
+    {
+        error = {};
+        if (!asio::buffer_size(buffers)) return 0;
+        for (;;)
+        {
+            if (auto read = read_some_nonblocking(buffers)) return read;
+            if (region_->control(rx_).closed.load(std::memory_order_acquire))
+            {
+                if (auto read = read_some_nonblocking(buffers)) return read;
+                error = asio::error::eof;
+                return 0;
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    template <typename ConstBufferSequence>
+    std::size_t write_some(const ConstBufferSequence & buffers, asio::error_code & error)
+    {
+        error = {};
+        if (!asio::buffer_size(buffers)) return 0;
+        for (;;)
+        {
+            if (region_->control(rx_).closed.load(std::memory_order_acquire))
+            {
+                error = asio::error::broken_pipe;
+                return 0;
+            }
+            if (auto written = write_some_nonblocking(buffers)) return written;
+            std::this_thread::yield();
+        }
+    }
+
+    template <typename MutableBufferSequence>
+    std::size_t read_some(const MutableBufferSequence & buffers)
+    {
+        asio::error_code error;
+        auto read = read_some(buffers, error);
+        if (error) asio::detail::throw_error(error, "ring_stream::read_some");
+        return read;
+    }
+
+    template <typename ConstBufferSequence>
+    std::size_t write_some(const ConstBufferSequence & buffers)
+    {
+        asio::error_code error;
+        auto written = write_some(buffers, error);
+        if (error) asio::detail::throw_error(error, "ring_stream::write_some");
+        return written;
+    }
+
+    template <typename MutableBufferSequence,
+              typename CompletionToken>
+    auto async_read_some(const MutableBufferSequence & buffers, CompletionToken && token)
+    {
+        return async_poll(read_timer_, std::forward<CompletionToken>(token),
+            [this, buffers](asio::error_code & error)
+            {
+                auto read = read_some_nonblocking(buffers);
+                if (!read && asio::buffer_size(buffers)
+                    && region_->control(rx_).closed.load(std::memory_order_acquire))
+                {
+                    // the writer may have finished just before closing
+                    read = read_some_nonblocking(buffers);
+                    if (!read) error = asio::error::eof;
+                }
+                return std::make_pair(read, read || error || !asio::buffer_size(buffers));
+            });
+    }
+
+    template <typename ConstBufferSequence,
+              typename CompletionToken>
+    auto async_write_some(const ConstBufferSequence & buffers, CompletionToken && token)
+    {
+        return async_poll(write_timer_, std::forward<CompletionToken>(token),
+            [this, buffers](asio::error_code & error)
+            {
+                if (region_->control(rx_).closed.load(std::memory_order_acquire))
+                {
+                    error = asio::error::broken_pipe;
+                    return std::make_pair(std::size_t(0), true);
+                }
+                auto written = write_some_nonblocking(buffers);
+                return std::make_pair(written, written || !asio::buffer_size(buffers));
+            });
+    }
+
+  private:
+    static void copy_in(unsigned char * data, std::size_t capacity, std::uint64_t position,
+        const unsigned char * from, std::size_t size)
+    {
+        auto offset = position & (capacity - 1);
+        auto first = std::min(size, capacity - offset);
+        std::memcpy(data + offset, from, first);
+        std::memcpy(data, from + first, size - first);
+    }
+
+    static void copy_out(const unsigned char * data, std::size_t capacity, std::uint64_t position,
+        unsigned char * to, std::size_t size)
+    {
+        auto offset = position & (capacity - 1);
+        auto first = std::min(size, capacity - offset);
+        std::memcpy(to, data + offset, first);
+        std::memcpy(to + first, data, size - first);
+    }
+
+    /// runs `attempt` until it reports that the operation is done, polling in
+    /// between; the first attempt is made from the executor, never inline
+    template <typename CompletionToken, typename AttemptT>
+    auto async_poll(asio::steady_timer & timer, CompletionToken && token, AttemptT attempt)
+    {
+        #include <asio/yield.hpp>
+        return asio::async_compose<CompletionToken, void(asio::error_code, std::size_t)>(
+            [
+                this,
+                &timer,
+                attempt = std::move(attempt),
+                polls = 0u,
+                backoff = std::chrono::microseconds(1),
+                coro = asio::coroutine()
+            ]
+            (
+                auto & self,
+                const asio::error_code & = {}
+            )
+            mutable
+            {
+                reenter (coro)
+                {
+                    yield asio::post(executor_, std::move(self));
+                    for (;;)
+                    {
+                        {
+                            asio::error_code error;
+                            auto [transferred, done] = attempt(error);
+                            if (done)
+                            {
+                                self.complete(error, transferred);
+                                return;
+                            }
+                        }
+                        if (polls < spin_polls)
+                        {
+                            ++polls;
+                            yield asio::post(executor_, std::move(self));
+                        }
+                        else
+                        {
+                            timer.expires_after(backoff);
+                            backoff = std::min(2 * backoff, max_backoff);
+                            yield timer.async_wait(std::move(self));
+                        }
+                    }
+                }
+            },
+            token, *this);
+        #include <asio/unyield.hpp>
+    }
+
+    executor_type executor_;
+    std::shared_ptr<ring_region> region_;
+    int tx_, rx_;
+    asio::steady_timer read_timer_, write_timer_;
+};
+
+/// returns two connected ends of a fresh in-process region
+template <typename ExecutorT>
+std::pair<std::unique_ptr<ring_stream>, std::unique_ptr<ring_stream>>
+make_local_pair(ExecutorT executor0, ExecutorT executor1, std::size_t capacity = default_capacity)
+{
+    auto region = ring_region::create(capacity);
+    return {std::make_unique<ring_stream>(executor0, region, 0),
+            std::make_unique<ring_stream>(executor1, region, 1)};
+}
+
+/// Listens on a Unix-domain socket at `path` and, for each process that
+/// connects, creates a `memfd`-backed region and sends it the descriptor.
+/// The listener's end of each region is side 0.
+class ring_listener
+{
+  public:
+    explicit ring_listener(const std::string & path, std::size_t capacity = default_capacity)
+      : path_{path}, capacity_{capacity}
+    {
+        socket_ = ::socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+        if (socket_ < 0) throw std::system_error(errno, std::generic_category(), "socket");
+        auto addr = detail::unix_address(path);
+        ::unlink(path.c_str());
+        if (::bind(socket_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0
+            || ::listen(socket_, 2) < 0)
+        {
+            auto error = errno;
+            ::close(socket_);
+            throw std::system_error(error, std::generic_category(), "bind(" + path + ")");
+        }
+    }
+
+    ring_listener(const ring_listener &) = delete;
+    ring_listener & operator=(const ring_listener &) = delete;
+
+    ~ring_listener()
+    {
+        ::close(socket_);
+        ::unlink(path_.c_str());
+    }
+
+    /// blocks until a process connects and returns the region shared with it
+    std::shared_ptr<ring_region> accept()
+    {
+        int connection = ::accept4(socket_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (connection < 0) throw std::system_error(errno, std::generic_category(), "accept");
+        auto region = ring_region::create(capacity_, true);
+        try
+        {
+            detail::send_fd(connection, region->native_handle());
+        }
+        catch (...)
+        {
+            ::close(connection);
+            throw;
+        }
+        ::close(connection);
+        return region;
+    }
+
+  private:
+    std::string path_;
+    std::size_t capacity_;
+    int socket_;
+};
+
+/// connects to a `ring_listener` at `path` and maps the region it sends;
+/// the caller's end is side 1
+inline std::shared_ptr<ring_region> connect(const std::string & path)
+{
+    int socket = ::socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+    if (socket < 0) throw std::system_error(errno, std::generic_category(), "socket");
+    auto addr = detail::unix_address(path);
+    if (::connect(socket, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0)
+    {
+        auto error = errno;
+        ::close(socket);
+        throw std::system_error(error, std::generic_category(), "connect(" + path + ")");
+    }
+    int fd;
+    try
+    {
+        fd = detail::receive_fd(socket);
+    }
+    catch (...)
+    {
+        ::close(socket);
+        throw;
+    }
+    ::close(socket);
+    return ring_region::attach(fd);
+}
+
+}  // namespace ring
+
+#endif  // RING_STREAM_HPP__
@@ -0,0 +1,319 @@
+#ifndef SESSION_HPP__
+#define SESSION_HPP__
+
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <future>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Haar.hpp"
+#include "bior.hpp"
+#include "shares.hpp"
+
+/// An embeddable handle on one party's online phase.
+///
+/// A `session` owns everything that the standalone programs set up per run:
+/// an `io_context` and the thread that runs it, the worker pool, the dealer
+/// stream and peer transport (both built on the session's `io_context` by
+/// factories passed to the constructor), and the mapping of the LUT. Each
+/// call to `evaluate` then only queues a batch of input shares; batches are
+/// run one after another over the same connections, through the pipeline
+/// (`async_online_{Haar,bior}_pipelined`) or, with `options::batch`, in two
+/// peer round trips (`async_online_{Haar,bior}_batch`).
+///
+/// The peer's session must evaluate batches of the same sizes in the same
+/// order, with the same `options::batch` (and `window` unless batching).
+/// The protocol code reads the LUT through the global `scaled_lut`, so a
+/// process may hold several sessions only if they all use the same LUT.
+///
+///     wave::options opts;
+///     opts.party = 1;
+///     opts.window = 16;
+///     wave::session<wave::transform::Haar, j, n, tcp::socket, tcp::socket> session{
+///         [&](asio::io_context & io) { tcp::socket s{io}; asio::connect(s, dealer_endpoints); return s; },
+///         [&](asio::io_context & io) { tcp::socket s{io}; asio::connect(s, peer_endpoints); return s; },
+///         "lut", opts};
+///     std::vector<wave::share> outputs = session.evaluate(inputs).get();
+namespace wave
+{
+
+namespace detail
+{
+
+/// closes `stream`, or the lowest layer of a layered stream, if it can be
+/// closed at all (a `prepfile::mapped_file` cannot, nor need it be)
+template <typename StreamT>
+auto close_stream(StreamT & stream, int) -> decltype(stream.close(std::declval<asio::error_code &>()), void())
+{
+    asio::error_code ignored;
+    stream.close(ignored);
+}
+
+template <typename StreamT>
+auto close_stream(StreamT & stream, long) -> decltype(stream.next_layer(), void())
+{
+    close_stream(stream.next_layer(), 0);
+}
+
+template <typename StreamT>
+void close_stream(StreamT &, ...) { }
+
+}  // namespace detail
+
+using share = dpf::modint<L>;
+
+enum class transform { Haar, bior };
+
+struct options
+{
+    bool party = false;           ///< which of the two online parties this is
+    bool compressed = false;      ///< party 0's dealer values come from seeds
+    bool batch = false;           ///< evaluate each batch in two peer round trips
+    std::size_t window = 1;       ///< pipelined evaluations in flight otherwise
+    std::size_t threads = 1;      ///< size of the worker pool
+};
+
+template <transform T,
+          std::size_t j,
+          std::size_t n,
+          typename DealerT,
+          typename PeerT>
+class session
+{
+  public:
+    static constexpr std::size_t J = n - j;  ///< LUT has `2^J` entries
+    static constexpr std::size_t lut_bytes = (T == transform::Haar)
+        ? (1ul << J) * sizeof(output_type) : bior_lut_bytes<J>;
+
+    /// maps `lut_file`, then builds the dealer and peer streams by calling
+    /// `make_dealer(io_context)` and `make_peer(io_context)`
+    template <typename MakeDealer, typename MakePeer>
+    session(MakeDealer && make_dealer, MakePeer && make_peer,
+        const std::string & lut_file, const options & opts = {})
+      : opts_{opts}, lut_{lut_file}, work_{opts.threads},
+        dealer_{make_dealer(io_context_)}, peer_{make_peer(io_context_)},
+        guard_{io_context_.get_executor()}, running_{false},
+        evaluations_{0}, dealer_bytes_read_{0}, peer_bytes_read_{0}, peer_bytes_written_{0}
+    {
+        scaled_lut = lut_.data;
+        thread_ = std::thread([this]()
+        {
+            for (;;)
+            {
+                try
+                {
+                    io_context_.run();
+                    return;
+                }
+                catch (...)
+                {
+                    fail(std::current_exception());
+                }
+            }
+        });
+    }
+
+    session(const session &) = delete;
+    session & operator=(const session &) = delete;
+
+    /// stops at once; the futures of batches not yet evaluated report
+    /// `std::future_errc::broken_promise`
+    ~session()
+    {
+        guard_.reset();
+        io_context_.stop();
+        thread_.join();
+        work_.join();
+        queue_.clear();
+        current_.reset();
+        if (scaled_lut == lut_.data) scaled_lut = nullptr;
+    }
+
+    /// queues the evaluation of `size` input shares starting at `inputs`,
+    /// which are copied; the future holds their output shares, in order, or
+    /// the exception that ended the session (after which every batch fails)
+    std::future<std::vector<share>> evaluate(const share * inputs, std::size_t size)
+    {
+        auto next = std::make_shared<job>();
+        next->inputs.assign(inputs, inputs + size);
+        auto future = next->promise.get_future();
+        asio::post(io_context_, [this, next]()
+        {
+            queue_.push_back(next);
+            if (!running_) start_next();
+        });
+        return future;
+    }
+
+    std::future<std::vector<share>> evaluate(const std::vector<share> & inputs)
+    {
+        return evaluate(inputs.data(), inputs.size());
+    }
+
+    const options & get_options() const { return opts_; }
+
+    /// totals over every batch evaluated so far
+    std::size_t evaluations() const { return evaluations_; }
+    std::size_t dealer_bytes_read() const { return dealer_bytes_read_; }
+    std::size_t peer_bytes_read() const { return peer_bytes_read_; }
+    std::size_t peer_bytes_written() const { return peer_bytes_written_; }
+
+  private:
+    struct job
+    {
+        std::vector<share> inputs, outputs;
+        std::promise<std::vector<share>> promise;
+    };
+
+    /// the first `lut_bytes` of a LUT file, mapped read-only
+    struct mapped_lut
+    {
+        explicit mapped_lut(const std::string & lut_file)
+        {
+            int fd = ::open(lut_file.c_str(), O_RDONLY);
+            if (fd < 0) throw std::system_error(errno, std::generic_category(), lut_file);
+            struct stat st;
+            if (::fstat(fd, &st) < 0 || std::size_t(st.st_size) < lut_bytes)
+            {
+                ::close(fd);
+                throw std::runtime_error(lut_file + " is shorter than " + std::to_string(lut_bytes) + " bytes");
+            }
+            auto lut = ::mmap(nullptr, lut_bytes, PROT_READ, MAP_PRIVATE|MAP_NORESERVE, fd, off_t(0));
+            ::close(fd);
+            if (lut == MAP_FAILED) throw std::system_error(errno, std::generic_category(), "mmap(" + lut_file + ")");
+            data = reinterpret_cast<output_type *>(lut);
+        }
+
+        mapped_lut(const mapped_lut &) = delete;
+        mapped_lut & operator=(const mapped_lut &) = delete;
+
+        ~mapped_lut() { ::munmap(data, lut_bytes); }
+
+        output_type * data;
+    };
+
+    /// runs the next queued batch, if any (on the `io_context`'s thread)
+    void start_next()
+    {
+        if (failed_)
+        {
+            for (auto & next : queue_) next->promise.set_exception(failed_);
+            queue_.clear();
+            return;
+        }
+        running_ = !queue_.empty();
+        if (!running_) return;
+        current_ = std::move(queue_.front());
+        queue_.pop_front();
+
+        const bool seeded = opts_.compressed && !opts_.party;
+        auto count = current_->inputs.size();
+        if (!count) return finish({}, 0, 0, 0);
+        if (opts_.batch)
+        {
+            auto done = [this](const asio::error_code & error, std::vector<share> outputs,
+                std::size_t dealer_bytes, std::size_t peer_bytes_read, std::size_t peer_bytes_written)
+            {
+                if (failed_) return;
+                if (error) asio::detail::throw_error(error, "session::evaluate");
+                finish(std::move(outputs), dealer_bytes, peer_bytes_read, peer_bytes_written);
+            };
+            if constexpr (T == transform::Haar)
+            {
+                async_online_Haar_batch<L,j,n>(dealer_, peer_, work_.executor(),
+                    std::move(current_->inputs), seeded, std::move(done));
+            }
+            else
+            {
+                async_online_bior_batch<L,j,n>(dealer_, peer_, work_.executor(),
+                    opts_.party, std::move(current_->inputs), seeded, std::move(done));
+            }
+            return;
+        }
+
+        current_->outputs.resize(count);
+        auto done = [this](const asio::error_code & error,
+            std::size_t dealer_bytes, std::size_t peer_bytes_read, std::size_t peer_bytes_written)
+        {
+            if (failed_) return;
+            if (error) asio::detail::throw_error(error, "session::evaluate");
+            finish(std::move(current_->outputs), dealer_bytes, peer_bytes_read, peer_bytes_written);
+        };
+        shares::array_input inputs{current_->inputs.data(), count};
+        if constexpr (T == transform::Haar)
+        {
+            async_online_Haar_pipelined<L,j,n>(dealer_, peer_, work_.executor(),
+                std::move(inputs), current_->outputs, count, opts_.window, seeded, std::move(done));
+        }
+        else
+        {
+            async_online_bior_pipelined<L,j,n>(dealer_, peer_, work_.executor(), opts_.party,
+                std::move(inputs), current_->outputs, count, opts_.window, seeded, std::move(done));
+        }
+    }
+
+    void finish(std::vector<share> outputs, std::size_t dealer_bytes,
+        std::size_t peer_bytes_read, std::size_t peer_bytes_written)
+    {
+        if (failed_ || !current_) return;
+        evaluations_ += outputs.size();
+        dealer_bytes_read_ += dealer_bytes;
+        peer_bytes_read_ += peer_bytes_read;
+        peer_bytes_written_ += peer_bytes_written;
+        current_->promise.set_value(std::move(outputs));
+        current_.reset();
+        start_next();
+    }
+
+    /// after an exception escaped a handler, the streams are in an unknown
+    /// state, so the batch in progress and all later ones fail with it. The
+    /// streams are closed, which aborts whatever the failed batch still has
+    /// outstanding on them; its job stays in `current_` until the session is
+    /// destroyed, since the worker pool may still be writing its outputs,
+    /// and the handlers that complete afterwards see `failed_` and return.
+    /// Only the first exception is reported; later ones are its fallout.
+    void fail(std::exception_ptr error)
+    {
+        if (failed_) return;
+        failed_ = error;
+        detail::close_stream(dealer_, 0);
+        detail::close_stream(peer_, 0);
+        if (current_) current_->promise.set_exception(failed_);
+        for (auto & next : queue_) next->promise.set_exception(failed_);
+        queue_.clear();
+        running_ = false;
+    }
+
+    options opts_;
+    mapped_lut lut_;
+    asio::io_context io_context_;
+    asio::thread_pool work_;
+    DealerT dealer_;
+    PeerT peer_;
+    asio::executor_work_guard<asio::io_context::executor_type> guard_;
+    std::thread thread_;
+
+    // only touched on the `io_context`'s thread
+    std::deque<std::shared_ptr<job>> queue_;
+    std::shared_ptr<job> current_;
+    bool running_;
+    std::exception_ptr failed_;
+
+    std::atomic<std::size_t> evaluations_;
+    std::atomic<std::size_t> dealer_bytes_read_, peer_bytes_read_, peer_bytes_written_;
+};
+
+}  // namespace wave
+
+#endif  // SESSION_HPP__
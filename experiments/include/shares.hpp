@@ -0,0 +1,307 @@
+#ifndef SHARES_HPP__
+#define SHARES_HPP__
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/// Where the online phase gets its input shares and puts its output shares.
+///
+/// The pipelined engines (see `pipeline.hpp`) ask their `InputT` for one
+/// input share per evaluation, in order, through `next_input`, and hand each
+/// output share, tagged with its evaluation index, to their `OutputT` through
+/// `put_output`. An input is only asked for once that evaluation's dealer
+/// values have been read, so a stream of inputs is consumed no faster than
+/// the dealer material to evaluate it arrives. When they are done, they call
+/// `stop_input`, so that a reader's read-ahead does not keep the
+/// `io_context` busy.
+///
+/// Besides the types here, a plain `dpf::modint<L>` is an input that repeats
+/// forever, and `discard_output` drops the outputs; that is what benchmarks
+/// without `--input`/`--output` use. An `array_input` and a presized
+/// `std::vector` serve inputs and outputs held in memory.
+///
+/// Shares are stored as consecutive native 8-byte `dpf::modint<L>` values,
+/// so an input file is simply an array of shares and the output file is
+/// another, in evaluation order.
+namespace shares
+{
+
+/// an output that drops everything
+struct discard_output { };
+
+/// an input that yields the shares in `[data, data + size)`, then ends
+struct array_input
+{
+    const dpf::modint<L> * data;
+    std::size_t size;
+    std::size_t next = 0;
+};
+
+/// reads input shares from a file, FIFO, or connected socket
+class input_reader
+{
+  public:
+    static constexpr std::size_t share_bytes = sizeof(dpf::modint<L>);
+
+    /// reads from `path`, or from standard input if `path` is `-`; a regular
+    /// file is mapped, and anything else is read `chunk` shares at a time
+    template <typename ExecutorT>
+    input_reader(ExecutorT executor, const std::string & path, std::size_t chunk = 4096)
+      : input_reader{executor, path == "-" ? ::dup(STDIN_FILENO) : ::open(path.c_str(), O_RDONLY), chunk, path} { }
+
+    /// reads from `fd`, which it takes ownership of
+    template <typename ExecutorT>
+    input_reader(ExecutorT executor, int fd, std::size_t chunk = 4096, const std::string & name = "input")
+      : executor_{executor}, stream_{executor}, mapped_{nullptr}, mapped_bytes_{0},
+        chunk_{std::max(chunk, std::size_t(1))}, begin_{0}, end_{0},
+        reading_{false}, eof_{false}, shares_read_{0}
+    {
+        if (fd < 0) throw std::system_error(errno, std::generic_category(), "open(" + name + ")");
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+        {
+            // `epoll` cannot wait on regular files, so map them instead
+            mapped_bytes_ = st.st_size - st.st_size % share_bytes;
+            if (mapped_bytes_)
+            {
+                mapped_ = ::mmap(nullptr, mapped_bytes_, PROT_READ, MAP_PRIVATE, fd, off_t(0));
+                if (mapped_ == MAP_FAILED)
+                {
+                    ::close(fd);
+                    throw std::system_error(errno, std::generic_category(), "mmap(" + name + ")");
+                }
+                ::madvise(mapped_, mapped_bytes_, MADV_SEQUENTIAL);
+            }
+            ::close(fd);
+            return;
+        }
+        stream_.assign(fd);
+        buffer_.resize(2 * chunk_ * share_bytes);
+    }
+
+    input_reader(const input_reader &) = delete;
+    input_reader & operator=(const input_reader &) = delete;
+
+    ~input_reader()
+    {
+        if (mapped_) ::munmap(mapped_, mapped_bytes_);
+    }
+
+    std::size_t shares_read() const { return shares_read_; }
+
+    /// stops reading ahead; buffered shares are kept, and the next
+    /// `async_next` resumes reading
+    void cancel()
+    {
+        if (stream_.is_open()) stream_.cancel();
+    }
+
+    /// calls `callback(error, share)` on the executor with the next share,
+    /// or with `asio::error::eof` once the input is exhausted; at most one
+    /// call may be outstanding
+    template <typename Callback>
+    void async_next(Callback && callback)
+    {
+        if (!stream_.is_open())
+        {
+            auto offset = shares_read_ * share_bytes;
+            dpf::modint<L> share{0};
+            ::asio::error_code error = ::asio::error::eof;
+            if (offset < mapped_bytes_)
+            {
+                std::memcpy(&share, static_cast<const unsigned char *>(mapped_) + offset, share_bytes);
+                error = {};
+                ++shares_read_;
+            }
+            ::asio::post(executor_, [callback = std::forward<Callback>(callback), error, share]() mutable
+            {
+                callback(error, share);
+            });
+            return;
+        }
+        pending_ = std::forward<Callback>(callback);
+        serve();
+    }
+
+  private:
+    /// answers `pending_` if a whole share is buffered, and keeps a chunk
+    /// read ahead of the pipeline
+    void serve()
+    {
+        if (pending_ && (end_ - begin_ >= share_bytes || eof_))
+        {
+            dpf::modint<L> share{0};
+            ::asio::error_code error = error_ ? error_ : ::asio::error::eof;
+            if (end_ - begin_ >= share_bytes)
+            {
+                std::memcpy(&share, buffer_.data() + begin_, share_bytes);
+                begin_ += share_bytes;
+                error = {};
+                ++shares_read_;
+            }
+            ::asio::post(executor_, [callback = std::move(pending_), error, share]() mutable
+            {
+                callback(error, share);
+            });
+            pending_ = nullptr;
+        }
+        if (reading_ || eof_ || end_ - begin_ >= chunk_ * share_bytes) return;
+
+        // move the partial chunk to the front and read up to another chunk
+        std::memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+        end_ -= begin_;
+        begin_ = 0;
+        reading_ = true;
+        stream_.async_read_some(::asio::buffer(buffer_.data() + end_, buffer_.size() - end_),
+            [this](const ::asio::error_code & error, std::size_t bytes_read)
+            {
+                reading_ = false;
+                end_ += bytes_read;
+                if (error == ::asio::error::operation_aborted)
+                {
+                    if (pending_) serve();
+                    return;
+                }
+                if (error)
+                {
+                    eof_ = true;
+                    if (error != ::asio::error::eof) error_ = error;
+                }
+                serve();
+            });
+    }
+
+    ::asio::any_io_executor executor_;
+    ::asio::posix::stream_descriptor stream_;
+    void * mapped_;
+    std::size_t mapped_bytes_;
+    std::size_t chunk_;
+    std::vector<unsigned char> buffer_;
+    std::size_t begin_, end_;
+    bool reading_, eof_;
+    ::asio::error_code error_;
+    std::function<void(const ::asio::error_code &, dpf::modint<L>)> pending_;
+    std::size_t shares_read_;
+};
+
+/// writes output shares, by evaluation index, into a memory-mapped file that
+/// grows as needed and is trimmed to the highest index written when closed
+class output_file
+{
+  public:
+    static constexpr std::size_t share_bytes = sizeof(dpf::modint<L>);
+
+    explicit output_file(const std::string & path, std::size_t expected = 0)
+      : path_{path}, fd_{::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644)},
+        mapped_{nullptr}, capacity_{0}, count_{0}
+    {
+        if (fd_ < 0) throw std::system_error(errno, std::generic_category(), "open(" + path + ")");
+        reserve(std::max(expected, std::size_t(4096)));
+    }
+
+    output_file(const output_file &) = delete;
+    output_file & operator=(const output_file &) = delete;
+
+    ~output_file()
+    {
+        if (mapped_) ::munmap(mapped_, capacity_ * share_bytes);
+        // best effort: if this fails, the file keeps its zero padding
+        if (::ftruncate(fd_, count_ * share_bytes) != 0) { }
+        ::close(fd_);
+    }
+
+    /// number of shares in the file (one past the highest index written)
+    std::size_t size() const { return count_; }
+
+    void put(std::size_t i, dpf::modint<L> share)
+    {
+        if (HEDLEY_UNLIKELY(i >= capacity_)) reserve(std::max(i + 1, 2 * capacity_));
+        std::memcpy(static_cast<unsigned char *>(mapped_) + i * share_bytes, &share, share_bytes);
+        count_ = std::max(count_, i + 1);
+    }
+
+  private:
+    void reserve(std::size_t capacity)
+    {
+        if (::ftruncate(fd_, capacity * share_bytes) != 0)
+        {
+            throw std::system_error(errno, std::generic_category(), "ftruncate(" + path_ + ")");
+        }
+        auto mapped = mapped_
+            ? ::mremap(mapped_, capacity_ * share_bytes, capacity * share_bytes, MREMAP_MAYMOVE)
+            : ::mmap(nullptr, capacity * share_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, off_t(0));
+        if (mapped == MAP_FAILED) throw std::system_error(errno, std::generic_category(), "mmap(" + path_ + ")");
+        mapped_ = mapped;
+        capacity_ = capacity;
+    }
+
+    std::string path_;
+    int fd_;
+    void * mapped_;
+    std::size_t capacity_;  ///< shares the mapping has room for
+    std::size_t count_;
+};
+
+/// calls `callback(error, share)` with `input_share` right away, every time
+template <typename Callback>
+void next_input(const dpf::modint<L> & input_share, Callback && callback)
+{
+    callback(::asio::error_code{}, input_share);
+}
+
+template <typename Callback>
+void next_input(array_input & inputs, Callback && callback)
+{
+    if (inputs.next == inputs.size) callback(::asio::error_code{::asio::error::eof}, dpf::modint<L>{0});
+    else callback(::asio::error_code{}, inputs.data[inputs.next++]);
+}
+
+template <typename Callback>
+void next_input(input_reader & inputs, Callback && callback)
+{
+    inputs.async_next(std::forward<Callback>(callback));
+}
+
+HEDLEY_ALWAYS_INLINE
+void stop_input(const dpf::modint<L> &) { }
+
+HEDLEY_ALWAYS_INLINE
+void stop_input(const array_input &) { }
+
+HEDLEY_ALWAYS_INLINE
+void stop_input(input_reader & inputs)
+{
+    inputs.cancel();
+}
+
+HEDLEY_ALWAYS_INLINE
+void put_output(discard_output, std::size_t, dpf::modint<L>) { }
+
+/// `outputs` must already hold an element for every evaluation
+HEDLEY_ALWAYS_INLINE
+void put_output(std::vector<dpf::modint<L>> & outputs, std::size_t i, dpf::modint<L> share)
+{
+    outputs[i] = share;
+}
+
+HEDLEY_ALWAYS_INLINE
+void put_output(output_file & outputs, std::size_t i, dpf::modint<L> share)
+{
+    outputs.put(i, share);
+}
+
+}  // namespace shares
+
+#endif  // SHARES_HPP__
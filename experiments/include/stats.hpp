@@ -0,0 +1,206 @@
+#ifndef STATS_HPP__
+#define STATS_HPP__
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+/// Per-stage instrumentation for the online phase.
+///
+/// Each online coroutine brackets its stages (the `yield`s) with a `probe`,
+/// which records how long the stage took in that stage's latency histogram,
+/// along with the bytes it moved and the peer round trips it made. Recording
+/// costs two clock reads and a handful of relaxed atomic increments, and is
+/// skipped altogether unless `stats::enable()` was called.
+///
+/// Histograms are log-linear, as in HdrHistogram: values below 64 ns get a
+/// bucket each, and above that each power of two is split into 32 buckets,
+/// so a reported quantile is within ~3% of the true one.
+///
+/// The counters are process-wide, so in a `simulate` run they aggregate both
+/// parties.
+namespace stats
+{
+
+using clock = std::chrono::steady_clock;
+
+enum class stage : std::uint8_t
+{
+    dealer_record,  ///< one evaluation's dealer values
+    reveal,         ///< exchanging the masked input with the peer
+    dcf_eval,       ///< bior's coefficient (`evalDCF`)
+    lut_eval,       ///< DPF evaluation and LUT accumulation
+    compute,        ///< `dcf_eval` and `lut_eval` of a pipelined evaluation
+    beaver,         ///< Beaver multiplication, incl. the peer exchange
+    wait,           ///< pipeline idle, waiting for a read or computation
+    count_
+};
+
+static constexpr std::size_t num_stages = std::size_t(stage::count_);
+
+inline const char * name(stage s)
+{
+    static constexpr const char * names[num_stages] = {
+        "dealer_record",
+        "reveal", "dcf_eval", "lut_eval", "compute", "beaver", "wait" };
+    return names[std::size_t(s)];
+}
+
+/// log-linear latency histogram (in nanoseconds)
+class histogram
+{
+  public:
+    static constexpr unsigned sub_bits = 5;
+    static constexpr std::size_t linear = std::size_t(2) << sub_bits;  ///< exact buckets
+    static constexpr std::size_t sub_buckets = std::size_t(1) << sub_bits;
+    static constexpr std::size_t num_buckets = linear + (64 - sub_bits - 1) * sub_buckets;
+
+    static std::size_t bucket(std::uint64_t value)
+    {
+        if (value < linear) return value;
+        unsigned shift = 64 - __builtin_clzll(value) - (sub_bits + 1);
+        return linear + (shift - 1) * sub_buckets + ((value >> shift) - sub_buckets);
+    }
+
+    /// smallest value that falls in `bucket`
+    static std::uint64_t lower_bound(std::size_t bucket)
+    {
+        if (bucket < linear) return bucket;
+        unsigned shift = (bucket - linear) / sub_buckets + 1;
+        return std::uint64_t((bucket - linear) % sub_buckets + sub_buckets) << shift;
+    }
+
+    void record(std::uint64_t value)
+    {
+        buckets_[bucket(value)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(value, std::memory_order_relaxed);
+        auto max = max_.load(std::memory_order_relaxed);
+        while (value > max && !max_.compare_exchange_weak(max, value, std::memory_order_relaxed)) { }
+    }
+
+    std::uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    std::uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+    double mean() const { return count() ? double(sum_.load(std::memory_order_relaxed)) / count() : 0; }
+
+    /// value below which a fraction `q` of the recorded values fall
+    std::uint64_t quantile(double q) const
+    {
+        auto total = count();
+        if (!total) return 0;
+        auto rank = std::uint64_t(q * (total - 1)) + 1;
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < num_buckets; ++i)
+        {
+            seen += buckets_[i].load(std::memory_order_relaxed);
+            if (seen >= rank) return std::min(lower_bound(i), max());
+        }
+        return max();
+    }
+
+  private:
+    std::array<std::atomic<std::uint64_t>, num_buckets> buckets_{};
+    std::atomic<std::uint64_t> count_{0}, sum_{0}, max_{0};
+};
+
+struct stage_counters
+{
+    histogram latency;
+    std::atomic<std::uint64_t> bytes{0};
+    std::atomic<std::uint64_t> rounds{0};
+};
+
+inline std::atomic<bool> & enabled_flag()
+{
+    static std::atomic<bool> flag{false};
+    return flag;
+}
+
+inline bool enabled() { return enabled_flag().load(std::memory_order_relaxed); }
+inline void enable(bool on = true) { enabled_flag().store(on, std::memory_order_relaxed); }
+
+inline std::array<stage_counters, num_stages> & counters()
+{
+    static std::array<stage_counters, num_stages> all;
+    return all;
+}
+
+inline void record(stage s, clock::duration elapsed, std::size_t bytes, std::size_t rounds)
+{
+    auto & c = counters()[std::size_t(s)];
+    c.latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    if (bytes) c.bytes.fetch_add(bytes, std::memory_order_relaxed);
+    if (rounds) c.rounds.fetch_add(rounds, std::memory_order_relaxed);
+}
+
+/// times one stage at a time of a coroutine; `start` before the `yield` and
+/// `stop` after it, passing the coroutine's running byte total both times
+class probe
+{
+  public:
+    void start(std::size_t bytes_so_far = 0)
+    {
+        if (!enabled()) return;
+        bytes_ = bytes_so_far;
+        start_ = clock::now();
+    }
+
+    void stop(stage s, std::size_t bytes_so_far = 0, std::size_t rounds = 0)
+    {
+        if (!enabled()) return;
+        record(s, clock::now() - start_, bytes_so_far - bytes_, rounds);
+    }
+
+  private:
+    clock::time_point start_;
+    std::size_t bytes_ = 0;
+};
+
+/// whether no stage has been recorded yet
+inline bool empty()
+{
+    for (const auto & c : counters()) if (c.latency.count()) return false;
+    return true;
+}
+
+/// writes one row per stage that was recorded (latencies in microseconds)
+inline void write_csv(std::ostream & os)
+{
+    os << "stage,count,bytes,rounds,mean_us,p50_us,p90_us,p99_us,p999_us,max_us\n";
+    for (std::size_t i = 0; i < num_stages; ++i)
+    {
+        const auto & c = counters()[i];
+        const auto & h = c.latency;
+        if (!h.count()) continue;
+        os << name(stage(i)) << ',' << h.count() << ',' << c.bytes << ',' << c.rounds
+           << ',' << h.mean() / 1e3 << ',' << h.quantile(0.5) / 1e3 << ',' << h.quantile(0.9) / 1e3
+           << ',' << h.quantile(0.99) / 1e3 << ',' << h.quantile(0.999) / 1e3 << ',' << h.max() / 1e3 << '\n';
+    }
+}
+
+/// writes the same data as `write_csv`, as a JSON object keyed by stage
+inline void write_json(std::ostream & os)
+{
+    os << "{";
+    const char * sep = "\n";
+    for (std::size_t i = 0; i < num_stages; ++i)
+    {
+        const auto & c = counters()[i];
+        const auto & h = c.latency;
+        if (!h.count()) continue;
+        os << sep << "  \"" << name(stage(i)) << "\": {\"count\": " << h.count()
+           << ", \"bytes\": " << c.bytes << ", \"rounds\": " << c.rounds
+           << ", \"mean_us\": " << h.mean() / 1e3 << ", \"p50_us\": " << h.quantile(0.5) / 1e3
+           << ", \"p90_us\": " << h.quantile(0.9) / 1e3 << ", \"p99_us\": " << h.quantile(0.99) / 1e3
+           << ", \"p999_us\": " << h.quantile(0.999) / 1e3 << ", \"max_us\": " << h.max() / 1e3 << "}";
+        sep = ",\n";
+    }
+    os << "\n}\n";
+}
+
+}  // namespace stats
+
+#endif  // STATS_HPP__
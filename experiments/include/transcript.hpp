@@ -0,0 +1,266 @@
+#ifndef TRANSCRIPT_HPP__
+#define TRANSCRIPT_HPP__
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+/// Recording and replaying a party's conversation with its peer.
+///
+/// A `recording_stream` wraps the peer stream of an online run and appends
+/// every chunk it reads or writes, with a timestamp, to a transcript file. A
+/// `replay_stream` later plays the same party's side of that run back: reads
+/// are served from the recorded incoming bytes as soon as they are asked
+/// for, and writes are compared against the recorded outgoing bytes (the
+/// online phase is deterministic given the dealer values and inputs, so a
+/// mismatch means the computation changed). This lets the compute path be
+/// profiled or A/B tested in a single process, without waiting on a peer.
+///
+/// Only the plain pipelined and batched runs, which evaluate `count` copies
+/// of a constant input, are recorded. The header therefore has no room for a
+/// coalescing policy or an input source, and nillion rejects `--record`
+/// together with `--coalesce` (whose frame boundaries depend on flush timing,
+/// so the writes could not be compared byte for byte) or `--input`.
+///
+/// The file is a `header` followed by records, each a `record_header` and
+/// then `size` bytes.
+namespace transcript
+{
+
+static constexpr std::array<char, 8> magic = {'W', 'A', 'V', 'E', 'T', 'R', 'N', 'S'};
+static constexpr std::uint32_t version = 1;
+
+enum class direction_t : std::uint8_t { read = 0, write = 1 };
+
+/// the run's parameters, so that `replay` can repeat it exactly
+struct header
+{
+    std::array<char, 8> magic = transcript::magic;
+    std::uint32_t version = transcript::version;
+    std::uint8_t transform = 0;
+    std::uint8_t signal_bits = 0;
+    std::uint8_t level = 0;
+    std::uint8_t party = 0;
+    std::uint8_t compressed = 0;
+    std::uint8_t batch = 0;
+    std::array<std::uint8_t, 6> reserved{};
+    std::uint64_t count = 0;
+    std::uint64_t window = 0;
+};
+static_assert(sizeof(header) == 40, "transcript::header must stay 40 bytes");
+
+struct record_header
+{
+    direction_t direction;
+    std::array<std::uint8_t, 7> reserved;
+    std::uint64_t nanoseconds;  ///< since the transcript was opened
+    std::uint64_t size;
+};
+static_assert(sizeof(record_header) == 24, "transcript::record_header must stay 24 bytes");
+
+/// appends records to a transcript file
+class writer
+{
+  public:
+    writer(const std::string & path, const header & info)
+      : file_{std::fopen(path.c_str(), "wb")}, start_{std::chrono::steady_clock::now()}
+    {
+        if (!file_) throw std::system_error(errno, std::generic_category(), "fopen(" + path + ")");
+        std::setvbuf(file_, nullptr, _IOFBF, 1 << 20);
+        write(&info, sizeof(info));
+    }
+
+    writer(const writer &) = delete;
+    writer & operator=(const writer &) = delete;
+
+    ~writer() { std::fclose(file_); }
+
+    template <typename BufferSequence>
+    void append(direction_t direction, const BufferSequence & buffers, std::size_t size)
+    {
+        record_header record{direction, {}, std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start_).count()), size};
+        write(&record, sizeof(record));
+        for (auto it = asio::buffer_sequence_begin(buffers); it != asio::buffer_sequence_end(buffers) && size; ++it)
+        {
+            asio::const_buffer buffer{*it};
+            auto n = std::min(buffer.size(), size);
+            write(buffer.data(), n);
+            size -= n;
+        }
+    }
+
+  private:
+    void write(const void * data, std::size_t size)
+    {
+        if (std::fwrite(data, 1, size, file_) != size) throw std::system_error(errno, std::generic_category(), "fwrite(transcript)");
+    }
+
+    std::FILE * file_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+/// wraps a peer stream and records everything that passes through it
+template <typename NextLayer>
+class recording_stream
+{
+  public:
+    using executor_type = typename NextLayer::executor_type;
+
+    recording_stream(NextLayer & next, std::shared_ptr<writer> transcript)
+      : next_{next}, transcript_{std::move(transcript)} { }
+
+    executor_type get_executor() const noexcept { return next_.get_executor(); }
+    NextLayer & next_layer() { return next_; }
+
+    template <typename MutableBufferSequence,
+              typename CompletionToken>
+    auto async_read_some(const MutableBufferSequence & buffers, CompletionToken && token)
+    {
+        return ::asio::async_initiate<CompletionToken, void(::asio::error_code, std::size_t)>(
+            [this, buffers](auto handler)
+            {
+                next_.async_read_some(buffers,
+                    [transcript = transcript_, buffers, h = std::move(handler)](const ::asio::error_code & error, std::size_t bytes_read) mutable
+                    {
+                        if (bytes_read) transcript->append(direction_t::read, buffers, bytes_read);
+                        std::move(h)(error, bytes_read);
+                    });
+            },
+            token);
+    }
+
+    template <typename ConstBufferSequence,
+              typename CompletionToken>
+    auto async_write_some(const ConstBufferSequence & buffers, CompletionToken && token)
+    {
+        return ::asio::async_initiate<CompletionToken, void(::asio::error_code, std::size_t)>(
+            [this, buffers](auto handler)
+            {
+                next_.async_write_some(buffers,
+                    [transcript = transcript_, buffers, h = std::move(handler)](const ::asio::error_code & error, std::size_t bytes_written) mutable
+                    {
+                        if (bytes_written) transcript->append(direction_t::write, buffers, bytes_written);
+                        std::move(h)(error, bytes_written);
+                    });
+            },
+            token);
+    }
+
+  private:
+    NextLayer & next_;
+    std::shared_ptr<writer> transcript_;
+};
+
+/// Plays back one party's side of a recorded transcript. Reads complete
+/// immediately (on the handler's executor) with the recorded incoming bytes;
+/// writes complete immediately and are checked against the recorded
+/// outgoing bytes.
+class replay_stream
+{
+  public:
+    using executor_type = asio::any_io_executor;
+
+    template <typename ExecutorT>
+    replay_stream(ExecutorT executor, const std::string & path)
+      : executor_{executor}, read_position_{0}, write_position_{0}, mismatched_bytes_{0}
+    {
+        std::unique_ptr<std::FILE, int(*)(std::FILE *)> file{std::fopen(path.c_str(), "rb"), &std::fclose};
+        if (!file) throw std::system_error(errno, std::generic_category(), "fopen(" + path + ")");
+        if (std::fread(&info_, sizeof(info_), 1, file.get()) != 1 || info_.magic != magic)
+        {
+            throw std::runtime_error(path + " is not a transcript");
+        }
+        if (info_.version != version) throw std::runtime_error(path + ": unsupported transcript version");
+        record_header record;
+        while (std::fread(&record, sizeof(record), 1, file.get()) == 1)
+        {
+            auto & bytes = (record.direction == direction_t::read) ? reads_ : writes_;
+            auto offset = bytes.size();
+            bytes.resize(offset + record.size);
+            if (std::fread(bytes.data() + offset, 1, record.size, file.get()) != record.size)
+            {
+                throw std::runtime_error(path + " is truncated");
+            }
+        }
+    }
+
+    executor_type get_executor() const noexcept { return executor_; }
+
+    const header & info() const { return info_; }
+
+    /// recorded outgoing bytes that this run wrote differently
+    std::size_t mismatched_bytes() const { return mismatched_bytes_; }
+
+    /// whether this run wrote exactly as many bytes as the recorded one
+    bool complete() const { return write_position_ == writes_.size() && read_position_ == reads_.size(); }
+
+    template <typename MutableBufferSequence,
+              typename CompletionToken>
+    auto async_read_some(const MutableBufferSequence & buffers, CompletionToken && token)
+    {
+        return ::asio::async_initiate<CompletionToken, void(::asio::error_code, std::size_t)>(
+            [this, buffers](auto handler)
+            {
+                auto remaining = reads_.size() - read_position_;
+                auto size = ::asio::buffer_copy(buffers, ::asio::buffer(reads_.data() + read_position_, remaining));
+                read_position_ += size;
+                ::asio::error_code error = (!size && ::asio::buffer_size(buffers)) ? ::asio::error::eof : ::asio::error_code{};
+                auto ex = ::asio::get_associated_executor(handler, executor_);
+                ::asio::post(ex, [h = std::move(handler), error, size]() mutable
+                {
+                    std::move(h)(error, size);
+                });
+            },
+            token);
+    }
+
+    template <typename ConstBufferSequence,
+              typename CompletionToken>
+    auto async_write_some(const ConstBufferSequence & buffers, CompletionToken && token)
+    {
+        return ::asio::async_initiate<CompletionToken, void(::asio::error_code, std::size_t)>(
+            [this, buffers](auto handler)
+            {
+                std::size_t size = 0;
+                for (auto it = ::asio::buffer_sequence_begin(buffers); it != ::asio::buffer_sequence_end(buffers); ++it)
+                {
+                    ::asio::const_buffer buffer{*it};
+                    auto expected = std::min(buffer.size(), writes_.size() - std::min(writes_.size(), write_position_ + size));
+                    auto data = static_cast<const unsigned char *>(buffer.data());
+                    for (std::size_t i = 0; i < expected; ++i)
+                    {
+                        mismatched_bytes_ += (data[i] != writes_[write_position_ + size + i]);
+                    }
+                    mismatched_bytes_ += buffer.size() - expected;
+                    size += buffer.size();
+                }
+                write_position_ += size;
+                auto ex = ::asio::get_associated_executor(handler, executor_);
+                ::asio::post(ex, [h = std::move(handler), size]() mutable
+                {
+                    std::move(h)(::asio::error_code{}, size);
+                });
+            },
+            token);
+    }
+
+  private:
+    executor_type executor_;
+    header info_;
+    std::vector<unsigned char> reads_, writes_;
+    std::size_t read_position_, write_position_;
+    std::size_t mismatched_bytes_;
+};
+
+}  // namespace transcript
+
+#endif  // TRANSCRIPT_HPP__
@@ -0,0 +1,156 @@
+#ifndef WIRE_HPP__
+#define WIRE_HPP__
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+/// Compact encodings for what goes over the wire or into files.
+///
+/// Integers are written as LEB128 varints (seven bits per byte, least
+/// significant group first, high bit set on every byte but the last), and
+/// signed deltas are zigzag-mapped first so that small magnitudes of either
+/// sign stay short. Values known to fit in a fixed number of bits are packed
+/// back to back with `bit_writer`, least significant bit first.
+namespace wire
+{
+
+/// longest encoding of a 64-bit varint
+static constexpr std::size_t max_varint_bytes = 10;
+
+HEDLEY_ALWAYS_INLINE
+constexpr std::uint64_t zigzag(std::int64_t value)
+{
+    return (std::uint64_t(value) << 1) ^ std::uint64_t(value >> 63);
+}
+
+HEDLEY_ALWAYS_INLINE
+constexpr std::int64_t unzigzag(std::uint64_t value)
+{
+    return std::int64_t(value >> 1) ^ -std::int64_t(value & 1);
+}
+
+/// number of bytes `put_varint` writes for `value`
+HEDLEY_ALWAYS_INLINE
+constexpr std::size_t varint_size(std::uint64_t value)
+{
+    std::size_t size = 1;
+    while (value >= 0x80)
+    {
+        value >>= 7;
+        ++size;
+    }
+    return size;
+}
+
+/// writes `value` at `out` and returns the end of its encoding
+HEDLEY_ALWAYS_INLINE
+unsigned char * put_varint(unsigned char * out, std::uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        *out++ = static_cast<unsigned char>(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = static_cast<unsigned char>(value);
+    return out;
+}
+
+/// reads a varint from `[in, end)` into `value` and returns the end of its
+/// encoding, or `nullptr` if `[in, end)` holds only part of one; throws if
+/// the encoding is longer than `max_varint_bytes`
+HEDLEY_ALWAYS_INLINE
+const unsigned char * get_varint(const unsigned char * in, const unsigned char * end, std::uint64_t & value)
+{
+    value = 0;
+    for (unsigned shift = 0; in != end; shift += 7)
+    {
+        if (HEDLEY_UNLIKELY(shift >= 7 * max_varint_bytes)) throw std::runtime_error("wire: varint too long");
+        auto byte = *in++;
+        value |= std::uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return in;
+    }
+    return nullptr;
+}
+
+/// bytes that `count` values of `width` bits each take when packed
+HEDLEY_ALWAYS_INLINE
+constexpr std::size_t packed_bytes(std::size_t count, std::size_t width)
+{
+    return (count * width + 7) / 8;
+}
+
+/// packs fixed-width values into consecutive bits, starting at `out`
+class bit_writer
+{
+  public:
+    explicit bit_writer(unsigned char * out) : out_{out}, byte_{0}, used_{0} { }
+
+    /// appends the low `width` (at most 64) bits of `value`
+    void put(std::uint64_t value, unsigned width)
+    {
+        while (width)
+        {
+            unsigned take = std::min(width, 8 - used_);
+            byte_ |= (value & ((1u << take) - 1)) << used_;
+            value >>= take;
+            width -= take;
+            used_ += take;
+            if (used_ == 8)
+            {
+                *out_++ = static_cast<unsigned char>(byte_);
+                byte_ = used_ = 0;
+            }
+        }
+    }
+
+    /// writes out a partial last byte and returns the end of the output
+    unsigned char * finish()
+    {
+        if (used_)
+        {
+            *out_++ = static_cast<unsigned char>(byte_);
+            byte_ = used_ = 0;
+        }
+        return out_;
+    }
+
+  private:
+    unsigned char * out_;
+    unsigned byte_, used_;
+};
+
+/// reads back what a `bit_writer` packed, starting at `in`
+class bit_reader
+{
+  public:
+    explicit bit_reader(const unsigned char * in) : in_{in}, used_{0} { }
+
+    /// returns the next `width` (at most 64) bits
+    std::uint64_t get(unsigned width)
+    {
+        std::uint64_t value = 0;
+        for (unsigned got = 0; got < width; )
+        {
+            unsigned take = std::min(width - got, 8 - used_);
+            value |= std::uint64_t((*in_ >> used_) & ((1u << take) - 1)) << got;
+            got += take;
+            used_ += take;
+            if (used_ == 8)
+            {
+                ++in_;
+                used_ = 0;
+            }
+        }
+        return value;
+    }
+
+  private:
+    const unsigned char * in_;
+    unsigned used_;
+};
+
+}  // namespace wire
+
+#endif  // WIRE_HPP__
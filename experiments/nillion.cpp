@@ -1,6 +1,15 @@
 #include <sys/mman.h>
 #include <cstdarg>
 #include <chrono>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <system_error>
+#include <utility>
+#include <fcntl.h>
+#include <sys/stat.h>
 
 #include "CLI11.hpp"
     #include "LeapFormatter.hpp"
@@ -11,10 +20,6 @@
 using asio::ip::tcp;
 
 static constexpr std::size_t L = 64;
-static constexpr std::size_t n = 32;
-static constexpr std::size_t J = 22, j=n-J;
-static constexpr auto twoj = (1ul << j);
-static constexpr auto twoJ = (1ul << J);
 int32_t bitlength = L;
 
 static constexpr std::size_t num_threads = 1;
@@ -22,12 +27,33 @@ static constexpr std::size_t num_threads = 1;
 using input_type = dpf::modint<L>;
 // using share_type = grotto::fixedpoint<fracbits, integral_type>;
 using output_type = dpf::modint<L>;
-std::size_t interval_bytes = twoJ * sizeof(output_type);
 
 output_type * scaled_lut;
 
+// range of signal bits (n) and LUT sizes (J) instantiated in this binary;
+// each (n, J) pair costs a full set of online/preprocessing instantiations,
+// so the defaults cover exactly the run_all.sh sweep (build with, e.g.,
+// WAVE_CONFIG_FLAGS="-DWAVE_MIN_N=32 -DWAVE_MIN_J=16" to narrow it)
+#ifndef WAVE_MIN_N
+#define WAVE_MIN_N 28
+#endif
+#ifndef WAVE_MAX_N
+#define WAVE_MAX_N 32
+#endif
+#ifndef WAVE_MIN_J
+#define WAVE_MIN_J 10
+#endif
+#ifndef WAVE_MAX_J
+#define WAVE_MAX_J 24
+#endif
+
 #include "Haar.hpp"
 #include "bior.hpp"
+#include "coalesce.hpp"
+#include "netem.hpp"
+#include "ring_stream.hpp"
+#include "stats.hpp"
+#include "transcript.hpp"
 
 static constexpr auto program_friendly_name = "Wave Hello to Privacy artifact";
 static constexpr auto program_version       = "1.0";
@@ -42,7 +68,14 @@ static constexpr const char * default_peer_port   = "31338";
 
 tcp::no_delay disable_nagle{false};  ///< disable Nagle's algorithm
 bool do_quickack{false};  ///< enable TCP_QUICKACK
-bool print_stats{true};  ///< emit costs metrics
+bool print_stats{false};  ///< emit costs metrics (`--stats`)
+std::string stats_format{"csv"};  ///< format of the per-stage metrics
+std::string stats_file;  ///< where to write the per-stage metrics (stdout if empty)
+bool coalesce_peer{false};  ///< share peer packets across evaluations
+coalesce::flush_policy flush_policy;  ///< when coalesced messages are written
+std::string input_path;  ///< where `online` reads input shares (constant if empty)
+std::string output_path;  ///< where `online` writes output shares
+std::size_t input_chunk{4096};  ///< input shares to read ahead at a time
 
 // struct InputBitsBase
 // {};
@@ -145,12 +178,268 @@ struct parameter_set
 {
     enum transform_t { Haar, bior } transform;
     // enum method_t { Pika, Grotto} method;
-    std::size_t input_bits = 64;                 ///< input bitlength (`N` in `dpf::modint<N>`)
+    std::size_t input_bits = L;                  ///< input bitlength (`N` in `dpf::modint<N>`); only `L` is built
     std::size_t fractional_bits = 16;            ///< fractional precision (`F` in `grotto::fixedpoint<F, dpf::modint<N>>`)
-    std::size_t signal_bits = 32;                ///< pre-DWT quantization granularity
-    std::size_t level = 1;                       ///< DWT multi-resolution analysis level
+    std::size_t signal_bits = 32;                ///< pre-DWT quantization granularity (`n`)
+    std::size_t level = 10;                      ///< DWT multi-resolution analysis level (`j`)
+    bool compressed = false;                     ///< client0's Beaver/mask shares come from seeds
 };
 
+/// compile-time counterpart of a `parameter_set`'s `(signal_bits, level)`
+template <std::size_t N, std::size_t Level>
+struct configuration
+{
+    static constexpr std::size_t n = N;
+    static constexpr std::size_t j = Level;
+    static constexpr std::size_t J = N - Level;  ///< LUT has `2^J` entries
+};
+
+namespace detail
+{
+
+template <std::size_t N, typename Result, typename Function, std::size_t... Js>
+bool dispatch_J(std::size_t J, std::optional<Result> & result, Function & f, std::index_sequence<Js...>)
+{
+    return ((J == WAVE_MIN_J + Js && J <= N
+        && (result.emplace(f(configuration<N, N - (WAVE_MIN_J + Js)>{})), true)) || ...);
+}
+
+template <typename Result, typename Function, std::size_t... Ns>
+bool dispatch_n(std::size_t n, std::size_t J, std::optional<Result> & result, Function & f, std::index_sequence<Ns...>)
+{
+    return ((n == WAVE_MIN_N + Ns && dispatch_J<WAVE_MIN_N + Ns>(J, result, f,
+        std::make_index_sequence<WAVE_MAX_J - WAVE_MIN_J + 1>{})) || ...);
+}
+
+}  // namespace detail
+
+/// returns `f(configuration<n, j>{})` for the runtime `params.signal_bits`
+/// and `params.level`, selected from the instantiated range of (n, J)
+template <typename Function>
+auto with_configuration(const parameter_set & params, Function && f)
+{
+    using result_type = decltype(f(configuration<WAVE_MAX_N, WAVE_MAX_N - WAVE_MIN_J>{}));
+    std::optional<result_type> result;
+    if (params.level > params.signal_bits
+        || !detail::dispatch_n(params.signal_bits, params.signal_bits - params.level, result, f,
+            std::make_index_sequence<WAVE_MAX_N - WAVE_MIN_N + 1>{}))
+    {
+        std::stringstream ss;
+        ss << "unsupported configuration: n=" << params.signal_bits << ", J=" << params.signal_bits - params.level
+           << " (this binary supports n in [" << WAVE_MIN_N << "," << WAVE_MAX_N << "]"
+           << " and J in [" << WAVE_MIN_J << "," << WAVE_MAX_J << "])";
+        throw std::runtime_error(ss.str());
+    }
+    return std::move(*result);
+}
+
+/// the first `bytes` of a LUT file, mapped read-only until destroyed
+class mapped_lut
+{
+  public:
+    mapped_lut(const std::string & lut_file, std::size_t bytes)
+      : lut_file_{lut_file}, bytes_{bytes}
+    {
+        int fd = open(lut_file.c_str(), O_RDONLY);
+        if (fd < 0) throw std::system_error(errno, std::generic_category(), lut_file);
+        struct stat st;
+        if (fstat(fd, &st) < 0 || std::size_t(st.st_size) < bytes)
+        {
+            close(fd);
+            throw std::runtime_error(lut_file + " is shorter than " + std::to_string(bytes) + " bytes");
+        }
+        auto lut = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE|MAP_NORESERVE, fd, off_t(0));
+        close(fd);
+        if (lut == MAP_FAILED) throw std::system_error(errno, std::generic_category(), "mmap(" + lut_file + ")");
+        data_ = reinterpret_cast<output_type *>(lut);
+    }
+
+    mapped_lut(const mapped_lut &) = delete;
+    mapped_lut & operator=(const mapped_lut &) = delete;
+
+    ~mapped_lut() { munmap(data_, bytes_); }
+
+    output_type * data() const { return data_; }
+    bool maps(const std::string & lut_file, std::size_t bytes) const
+    {
+        return lut_file_ == lut_file && bytes_ == bytes;
+    }
+
+  private:
+    std::string lut_file_;
+    std::size_t bytes_;
+    output_type * data_;
+};
+
+/// maps the first `bytes` of `lut_file` into `scaled_lut` (once, even if
+/// both parties of a `simulate` run ask for it), unmapping whatever LUT was
+/// mapped before
+void map_lut(const std::string & lut_file, std::size_t bytes)
+{
+    static std::mutex mutex;
+    static std::unique_ptr<mapped_lut> mapped;
+    std::lock_guard<std::mutex> lock{mutex};
+    if (mapped && mapped->maps(lut_file, bytes)) return;
+
+    auto next = std::make_unique<mapped_lut>(lut_file, bytes);
+    scaled_lut = next->data();
+    mapped = std::move(next);
+}
+
+/// opens the input shares named by `--input`: `-` for standard input,
+/// `tcp:HOST:PORT` for a socket, or else the path of a file or FIFO
+shares::input_reader open_inputs(asio::io_context & io_context, const std::string & path)
+{
+    if (path.rfind("tcp:", 0) == 0)
+    {
+        auto colon = path.rfind(':');
+        if (colon <= 4) throw std::invalid_argument("--input expects tcp:HOST:PORT");
+        tcp::resolver resolver{io_context};
+        tcp::socket socket{io_context};
+        asio::connect(socket, resolver.resolve(path.substr(4, colon - 4), path.substr(colon + 1)));
+        return shares::input_reader{io_context.get_executor(), socket.release(), input_chunk, path};
+    }
+    return shares::input_reader{io_context.get_executor(), path, input_chunk};
+}
+
+/// runs the online phase for `count` evaluations with the LUT in `lut_file`,
+/// returning the elapsed time along with the bytes read from `dealer`, read
+/// from `peer`, and written to `peer`; with `batch`, all `count` evaluations
+/// share their peer rounds, and otherwise up to `window` evaluations are
+/// pipelined (over a `coalesce::channel` if `coalesce_peer` is set, in which
+/// case the peer byte counts include framing); with an `input_path`, up to
+/// `count` input shares are streamed from it through the pipeline, and their
+/// output shares are written to `output_path`
+template <typename DealerT, typename PeerT, typename ExecutorT>
+auto run_online(asio::io_context & io_context, DealerT & dealer, PeerT & peer,
+    ExecutorT work_executor, const parameter_set & params, const std::string & lut_file,
+    bool party, std::size_t count, bool batch, std::size_t window = 1)
+{
+    return with_configuration(params, [&](auto config)
+    {
+        static constexpr std::size_t j = decltype(config)::j, n = decltype(config)::n, J = decltype(config)::J;
+        std::size_t dealer_read_bytes, peer_read_bytes, peer_write_bytes;
+
+        map_lut(lut_file, (params.transform == parameter_set::Haar) ? (1ul << J) * sizeof(output_type) : bior_lut_bytes<J>);
+
+        const bool seeded = params.compressed && !party;
+
+        // runs the pipeline (coalesced if `coalesce_peer`), which also covers
+        // the sequential case when `window == 1`
+        auto run_pipelined = [&](auto && inputs, auto && outputs)
+        {
+            if (coalesce_peer)
+            {
+                coalesce::channel<PeerT> channel{peer, flush_policy};
+                auto ret = (params.transform == parameter_set::Haar)
+                         ? async_online_Haar_coalesced<L,j,n>(dealer, channel, work_executor, inputs, outputs, count, window, seeded, asio::use_future)
+                         : async_online_bior_coalesced<L,j,n>(dealer, channel, work_executor, party, inputs, outputs, count, window, seeded, asio::use_future);
+                io_context.run();
+                std::tie(dealer_read_bytes, std::ignore, std::ignore) = ret.get();
+                peer_read_bytes = channel.bytes_read();
+                peer_write_bytes = channel.bytes_written();
+                return;
+            }
+            auto ret = (params.transform == parameter_set::Haar)
+                     ? async_online_Haar_pipelined<L,j,n>(dealer, peer, work_executor, inputs, outputs, count, window, seeded, asio::use_future)
+                     : async_online_bior_pipelined<L,j,n>(dealer, peer, work_executor, party, inputs, outputs, count, window, seeded, asio::use_future);
+            io_context.run();
+            std::tie(dealer_read_bytes, peer_read_bytes, peer_write_bytes) = ret.get();
+        };
+
+        auto before = std::chrono::high_resolution_clock::now();
+        if (!input_path.empty())
+        {
+            if (batch) throw std::invalid_argument("--input does not support --batch");
+            auto inputs = open_inputs(io_context, input_path);
+            shares::output_file outputs{output_path, count};
+            run_pipelined(inputs, outputs);
+            std::cout << "Evaluated " << outputs.size() << " shares from " << input_path << " into " << output_path << "\n";
+        }
+        else if (coalesce_peer)
+        {
+            if (batch) throw std::invalid_argument("--coalesce does not support --batch");
+            run_pipelined(input_type{100}, shares::discard_output{});
+        }
+        else if (batch)
+        {
+            auto ret = (params.transform == parameter_set::Haar)
+                     ? async_online_Haar_batch<L,j,n>(dealer, peer, work_executor, std::vector<input_type>(count, 100), seeded, asio::use_future)
+                     : async_online_bior_batch<L,j,n>(dealer, peer, work_executor, party, std::vector<input_type>(count, 100), seeded, asio::use_future);
+            io_context.run();
+            std::tie(std::ignore, dealer_read_bytes, peer_read_bytes, peer_write_bytes) = ret.get();
+        }
+        else if (window > 1)
+        {
+            run_pipelined(input_type{100}, shares::discard_output{});
+        }
+        else
+        {
+            auto ret = (params.transform == parameter_set::Haar)
+                     ? async_online_Haar<L,j,n>(dealer, peer, work_executor, 100, count, seeded, asio::use_future)
+                     : async_online_bior<L,j,n>(dealer, peer, work_executor, party, 100, count, seeded, asio::use_future);
+            io_context.run();
+            std::tie(dealer_read_bytes, peer_read_bytes, peer_write_bytes) = ret.get();
+        }
+        auto after = std::chrono::high_resolution_clock::now();
+
+        std::chrono::duration<double, std::milli> elapsed = after - before;
+        return std::make_tuple(elapsed, dealer_read_bytes, peer_read_bytes, peer_write_bytes);
+    });
+}
+
+/// runs `run_online` with dealer values read from `infile`, which is either
+/// an indexed preprocessing file (see `prepfile.hpp`), read in place, or a
+/// legacy stream of dealer values
+template <typename PeerT, typename ExecutorT>
+auto run_online_file(asio::io_context & io_context, const std::string & infile, PeerT & peer,
+    ExecutorT work_executor, const parameter_set & params, const std::string & lut_file,
+    bool party, std::size_t count, bool batch, std::size_t window = 1)
+{
+    if (prepfile::is_container(infile))
+    {
+        prepfile::mapped_file dealer{io_context.get_executor(), infile,
+            (params.transform == parameter_set::Haar) ? prepfile::transform_t::Haar : prepfile::transform_t::bior,
+            L, params.signal_bits, params.signal_bits - params.level, params.compressed && !party};
+        return run_online(io_context, dealer, peer, work_executor, params, lut_file, party, count, batch, window);
+    }
+    asio::stream_file dealer{io_context};
+    dealer.open(infile, asio::stream_file::read_only);
+    return run_online(io_context, dealer, peer, work_executor, params, lut_file, party, count, batch, window);
+}
+
+/// describes an online run, for the header of its transcript
+transcript::header make_transcript_header(const parameter_set & params, bool party,
+    std::size_t count, bool batch, std::size_t window)
+{
+    transcript::header info;
+    info.transform = params.transform;
+    info.signal_bits = params.signal_bits;
+    info.level = params.level;
+    info.party = party;
+    info.compressed = params.compressed;
+    info.batch = batch;
+    info.count = count;
+    info.window = window;
+    return info;
+}
+
+/// runs `run_online_file`, recording the conversation with `peer` to
+/// `record_file` unless it is empty
+template <typename PeerT, typename ExecutorT>
+auto run_online_recorded(asio::io_context & io_context, const std::string & infile, PeerT & peer,
+    const std::string & record_file, ExecutorT work_executor, const parameter_set & params,
+    const std::string & lut_file, bool party, std::size_t count, bool batch, std::size_t window = 1)
+{
+    if (record_file.empty())
+    {
+        return run_online_file(io_context, infile, peer, work_executor, params, lut_file, party, count, batch, window);
+    }
+    transcript::recording_stream<PeerT> recorder{peer, std::make_shared<transcript::writer>(record_file,
+        make_transcript_header(params, party, count, batch, window))};
+    return run_online_file(io_context, infile, recorder, work_executor, params, lut_file, party, count, batch, window);
+}
+
 int main(int argc, char * argv[])
 {
     fss_init();
@@ -176,14 +465,29 @@ int main(int argc, char * argv[])
     std::string outfile;                         ///< file for client's output
     std::string dealer_remote_address;           ///< address to connect to
     std::string dealer_remote_port     = default_dealer_port;  ///< port to connect on
+    bool client_party                  = false;  ///< whether this is client1
     // online_client
     std::string infile;                          ///< file containing dealer values
+    bool batch                         = false;  ///< evaluate all inputs as one batch
+    std::size_t window                 = 1;      ///< evaluations in flight at once
     // online_client_listener
     uint16_t peer_local_port = 31338;            ///< port to listen for peer on
     std::string peer_local_address     = "0.0.0.0";  ///< iface to listen for peer on
     // online_client_connecter
     std::string peer_remote_port       = default_peer_port;  ///< port to connect to peer on
     std::string peer_remote_address;             ///< address to connect to peer on
+    std::string record_file;                     ///< transcript of the conversation with the peer
+    // replay
+    std::string replay_file;                     ///< transcript to play back
+    // simulate
+    std::string link_profile           = "none"; ///< preset for the emulated links
+    std::string link_rate;                       ///< overrides the preset's rate
+    std::string link_delay;                      ///< overrides the preset's delay
+    std::string link_jitter;                     ///< overrides the preset's jitter
+    // shared-memory transport
+    std::string shm_path;                        ///< Unix socket for a shared-memory ring (!TCP)
+    // peer message coalescing
+    std::string flush_delay;                     ///< longest a coalesced message waits
 
     CLI::App args(program_friendly_name, program_invocation_short_name);
     args.fallthrough(false);
@@ -242,8 +546,21 @@ int main(int argc, char * argv[])
 
     // flag to indicate whether or not to output statistical data
     basic_config_group->add_flag("--stats,!--no-stats", print_stats,
-        "Output data for statistics")
+        "Record and output per-stage statistics (off by default)")
+            ->capture_default_str()
+            ->group("Basic configuration");
+
+    // format of the per-stage latency histograms and counters
+    basic_config_group->add_option("--stats-format", stats_format,
+        "Format of the per-stage statistics")
             ->capture_default_str()
+            ->check(CLI::IsMember({"csv", "json"}))
+            ->group("Basic configuration");
+
+    // where to write the per-stage statistics
+    basic_config_group->add_option("--stats-file", stats_file,
+        "Write the per-stage statistics to this file instead of standard output")
+            ->option_text("TEXT:FILENAME")
             ->group("Basic configuration");
 
     // number of worker threads for doing any cryptographic heavy lifting
@@ -262,12 +579,12 @@ int main(int argc, char * argv[])
             ->capture_default_str()
             ->group("Functionality");
 
-    // input bitlength (`N` in `dpf::modint<N>`)
+    // input bitlength (`N` in `dpf::modint<N>`); the protocol code is
+    // instantiated for `L` only, so any other value is rejected
     functionality_group->add_option("--input-bits,--ell,-l", params.input_bits,
-        "Bitlength of fixed-point inputs and outputs")
+        "Bitlength of fixed-point inputs and outputs (only " + std::to_string(L) + " is supported)")
             ->capture_default_str()
-            ->check(CLI::TypeValidator<uint8_t>())
-            ->check(CLI::Range(8, UINT8_MAX))
+            ->check(CLI::IsMember({L}))
             ->group("Functionality");
 
     // fractional precision (`F` in `grotto::fixedpoint<F, dpf::modint<N>>`)
@@ -277,9 +594,16 @@ int main(int argc, char * argv[])
             ->check(CLI::TypeValidator<uint8_t>())
             ->group("Functionality");
 
-    // DWT multi-resolution analysis level
-    functionality_group->add_option("--dwt-level,-J", params.level,
-        "Level of DWT approximation to use")
+    // pre-DWT quantization granularity (`n`)
+    functionality_group->add_option("--signal-bits,-n", params.signal_bits,
+        "Bitlength of the quantized signal (i.e., of the DPF domain)")
+            ->capture_default_str()
+            ->check(CLI::TypeValidator<uint8_t>())
+            ->group("Functionality");
+
+    // DWT multi-resolution analysis level (`j`); the LUT has `2^(n-j)` entries
+    functionality_group->add_option("--level,-j", params.level,
+        "Level j of DWT approximation to use (the LUT has 2^(n-j) entries)")
             ->capture_default_str()
             ->check(CLI::TypeValidator<uint8_t>())
             ->group("Functionality");
@@ -291,6 +615,12 @@ int main(int argc, char * argv[])
             ->capture_default_str()
             ->group("Functionality");
 
+    // seed-compressed preprocessing
+    functionality_group->add_flag("--compressed,!--uncompressed", params.compressed,
+        "Send client0 a seed in place of its Beaver/mask shares")
+            ->capture_default_str()
+            ->group("Functionality");
+
     // method to use
     // functionality_group->add_flag("--pika,!--grotto",
     //     [&params](bool b){ params.method = (parameter_set::method_t)b; },
@@ -439,6 +769,11 @@ int main(int argc, char * argv[])
         "Enable TCP QUICKACK")
             ->capture_default_str();
 
+    // hand co-located clients a shared-memory ring instead of a TCP socket
+    preprocess_dealer_socket->add_option("--shm", shm_path,
+        "Serve clients over shared memory, listening on this Unix socket")
+            ->option_text("TEXT:PATH");
+
     // --------------------------------------------
     // Sub-subcommand: ./foo preprocess client
     // --------------------------------------------
@@ -453,8 +788,7 @@ int main(int argc, char * argv[])
 
     // which IPv4 address to connect to dealer at
     preprocess_client->add_option("address,--address,-a", dealer_remote_address,
-        "Dealer's IPv4 address")
-            ->required()
+        "Dealer's IPv4 address (required unless --shm)")
             ->check(CLI::ValidIPV4)
             ->group("Network options");
 
@@ -478,6 +812,18 @@ int main(int argc, char * argv[])
             ->capture_default_str()
             ->group("Network options");
 
+    // reach a co-located dealer through shared memory instead of TCP
+    preprocess_client->add_option("--shm", shm_path,
+        "Connect to the dealer over shared memory via this Unix socket")
+            ->option_text("TEXT:PATH")
+            ->group("Network options");
+
+    // which of the dealer's clients this is (client0 connects first)
+    preprocess_client->add_flag("--client1,!--client0", client_party,
+        "Act as client1 (!client0)")
+            ->capture_default_str()
+            ->group("Network options");
+
     // flag to indicate whether or not existing files should be clobbered
     preprocess_client->add_flag("--overwrite,-o,!--no-overwrite", overwrite_files,
         "Overwrite existing output files")
@@ -524,6 +870,78 @@ int main(int argc, char * argv[])
             ->capture_default_str()
             ->group("Network options");
 
+    // reach a co-located peer through shared memory instead of TCP
+    online->add_option("--shm", shm_path,
+        "Talk to the peer over shared memory; the listener creates this Unix socket")
+            ->option_text("TEXT:PATH")
+            ->group("Network options");
+
+    // record everything exchanged with the peer, for `replay`; `--coalesce`
+    // and `--input` exclude it below, since a transcript cannot describe them
+    online->add_option("--record", record_file,
+        "Record the conversation with the peer to this transcript file (not with --coalesce or --input)")
+            ->option_text("TEXT:FILENAME")
+            ->group("File options");
+
+    // evaluate everything in one batch (one reveal and one Beaver round)
+    online->add_flag("--batch,-b", batch,
+        "Evaluate all inputs in a single batch")
+            ->capture_default_str();
+
+    // number of evaluations to keep in flight (must match the peer's)
+    online->add_option("--window,-w", window,
+        "Number of pipelined evaluations in flight (must match peer)")
+            ->capture_default_str()
+            ->check(CLI::Range(std::size_t(1), std::numeric_limits<std::size_t>::max()))
+            ->excludes("--batch");
+
+    // pack the messages of all ready evaluations into shared writes
+    online->add_flag("--coalesce", coalesce_peer,
+        "Coalesce peer messages across evaluations (window need not match peer)")
+            ->capture_default_str()
+            ->excludes("--batch")
+            ->excludes("--record")
+            ->group("Network options");
+
+    // flush coalesced messages once this many bytes are queued
+    online->add_option("--flush-bytes", flush_policy.max_bytes,
+        "Write coalesced messages once this many bytes are queued")
+            ->capture_default_str()
+            ->check(CLI::Range(coalesce::min_flush_bytes, std::numeric_limits<std::size_t>::max()))
+            ->needs("--coalesce")
+            ->group("Network options");
+
+    // ... or once the oldest of them has waited this long
+    online->add_option("--flush-delay", flush_delay,
+        "Longest a coalesced message waits before it is written (default: until ready handlers ran)")
+            ->option_text("TEXT:TIME")
+            ->needs("--coalesce")
+            ->group("Network options");
+
+    // stream input shares in instead of evaluating a constant
+    auto * input_option = online->add_option("--input", input_path,
+        "Read input shares (native 8-byte words) from this file, FIFO, `-` (stdin) or tcp:HOST:PORT; at most --count are evaluated")
+            ->option_text("TEXT:PATH")
+            ->excludes("--batch")
+            ->excludes("--record")
+            ->group("File options");
+
+    // ... and keep the output shares
+    online->add_option("--output", output_path,
+        "Write output shares, in input order, to this file")
+            ->option_text("TEXT:FILENAME")
+            ->needs("--input")
+            ->group("File options");
+    input_option->needs("--output");
+
+    // how far ahead of the pipeline to read a streamed input
+    online->add_option("--input-chunk", input_chunk,
+        "Input shares to read ahead at a time from a FIFO or socket")
+            ->capture_default_str()
+            ->check(CLI::Range(std::size_t(1), std::numeric_limits<std::size_t>::max()))
+            ->needs("--input")
+            ->group("File options");
+
     //
     // ./foo online listen
     //
@@ -557,8 +975,8 @@ int main(int argc, char * argv[])
 
     // which IPv4 address to connect to peer at
     online_connecter->add_option("address,--address,-a", peer_remote_address,
-        "Peer's IPv4 address")
-            ->required()->check(CLI::ValidIPV4);
+        "Peer's IPv4 address (required unless --shm)")
+            ->check(CLI::ValidIPV4);
 
     // which TCP port to connect to peer via
     online_connecter->add_option("port,--port,-p", peer_remote_port,
@@ -589,6 +1007,11 @@ int main(int argc, char * argv[])
         "Enable TCP QUICKACK")
             ->capture_default_str();
 
+    // evaluate everything in one batch (one reveal and one Beaver round)
+    full->add_flag("--batch,-b", batch,
+        "Evaluate all inputs in a single batch")
+            ->capture_default_str();
+
 
     //
     // ./foo full dealer
@@ -661,6 +1084,97 @@ int main(int argc, char * argv[])
             ->capture_default_str()
             ->option_text("TEXT:UINT16");
 
+    // --------------------------------
+    // Subcommand: ./foo simulate
+    // Run the dealer and both peers in this process over emulated links
+    // --------------------------------
+
+    auto * simulate = args.add_subcommand("simulate",
+        "Run dealer and both peers in one process over emulated network links");
+    simulate->configurable(true);  // allow in a configuration file
+
+    // starting point for the link parameters
+    simulate->add_option("--profile,-P", link_profile,
+        "Link preset (lan = 5gbit/0.2ms, wan = 300mbit/70ms)")
+            ->capture_default_str()
+            ->check(CLI::IsMember({"none", "lan", "wan"}))
+            ->group("Link options");
+
+    // per-link rate, as for `tc netem rate`
+    simulate->add_option("--rate,-r", link_rate,
+        "Rate of each link (e.g., 300mbit; 0 for unlimited)")
+            ->option_text("TEXT:RATE")
+            ->group("Link options");
+
+    // per-link one-way delay, as for `tc netem delay`
+    simulate->add_option("--delay,-d", link_delay,
+        "One-way delay of each link (e.g., 70ms)")
+            ->option_text("TEXT:TIME")
+            ->group("Link options");
+
+    // per-link jitter, as for the second argument of `tc netem delay`
+    simulate->add_option("--jitter", link_jitter,
+        "Uniform jitter added to each link's delay (e.g., 1ms)")
+            ->option_text("TEXT:TIME")
+            ->group("Link options");
+
+    // evaluate everything in one batch (one reveal and one Beaver round)
+    simulate->add_flag("--batch,-b", batch,
+        "Evaluate all inputs in a single batch")
+            ->capture_default_str();
+
+    // number of evaluations to keep in flight
+    simulate->add_option("--window,-w", window,
+        "Number of pipelined evaluations in flight")
+            ->capture_default_str()
+            ->check(CLI::Range(std::size_t(1), std::numeric_limits<std::size_t>::max()))
+            ->excludes("--batch");
+
+    // pack the messages of all ready evaluations into shared writes
+    simulate->add_flag("--coalesce", coalesce_peer,
+        "Coalesce peer messages across evaluations (window need not match peer)")
+            ->capture_default_str()
+            ->excludes("--batch")
+            ->group("Network options");
+
+    // flush coalesced messages once this many bytes are queued
+    simulate->add_option("--flush-bytes", flush_policy.max_bytes,
+        "Write coalesced messages once this many bytes are queued")
+            ->capture_default_str()
+            ->check(CLI::Range(coalesce::min_flush_bytes, std::numeric_limits<std::size_t>::max()))
+            ->needs("--coalesce")
+            ->group("Network options");
+
+    // ... or once the oldest of them has waited this long
+    simulate->add_option("--flush-delay", flush_delay,
+        "Longest a coalesced message waits before it is written (default: until ready handlers ran)")
+            ->option_text("TEXT:TIME")
+            ->needs("--coalesce")
+            ->group("Network options");
+
+    // --------------------------------
+    // Subcommand: ./foo replay
+    // Re-run one party's online phase against a recorded peer
+    // --------------------------------
+
+    auto * replay = args.add_subcommand("replay",
+        "Re-run one party's online phase against a transcript from `online --record`");
+    replay->configurable(true);  // allow in a configuration file
+
+    // transcript recorded by `online --record`
+    replay->add_option("transcript", replay_file,
+        "Transcript file")
+            ->required()
+            ->check(CLI::ExistingFile)
+            ->option_text("TEXT:FILENAME (REQ'D)");
+
+    // the dealer values that the recorded run used
+    replay->add_option("filename", infile,
+        "File of dealer values used by the recorded run")
+            ->required()
+            ->check(CLI::ExistingFile)
+            ->option_text("TEXT:FILENAME (REQ'D)");
+
     // --------------------------------
     // Register callback functions
     // --------------------------------
@@ -688,6 +1202,8 @@ int main(int argc, char * argv[])
     try
     {
         args.parse(argc, argv);
+        stats::enable(print_stats);
+        if (!flush_delay.empty()) flush_policy.delay = netem::parse_time(flush_delay);
 
         asio::thread_pool worker_pool(num_threads);
         auto work_executor = worker_pool.executor();
@@ -705,8 +1221,11 @@ int main(int argc, char * argv[])
                                     asio::stream_file::truncate);
 
             auto ret = (params.transform == parameter_set::Haar)
-                     ? async_make_preprocess_Haar<L>(client0, client1, work_executor, count, asio::use_future)
-                     : async_make_preprocess_bior<L,j,n>(client0, client1, work_executor, count, asio::use_future);;
+                     ? async_make_preprocess_Haar<L>(client0, client1, work_executor, count, params.compressed, asio::use_future)
+                     : with_configuration(params, [&](auto config)
+                       {
+                           return async_make_preprocess_bior<L, decltype(config)::j, decltype(config)::n>(client0, client1, work_executor, count, params.compressed, asio::use_future);
+                       });
 
             auto before = std::chrono::high_resolution_clock::now();
             io_context.run();
@@ -720,102 +1239,147 @@ int main(int argc, char * argv[])
         }
         else if (preprocess_dealer_socket->count()>0)
         {
-            tcp::socket client0{io_context};
-            tcp::socket client1{io_context};
-            tcp::acceptor acceptor{io_context, tcp::endpoint(tcp::v4(), dealer_local_port)};
-            acceptor.accept(client0);
-            client0.set_option(disable_nagle);
-            std::cout << "Received connection from client0\n";
-            acceptor.accept(client1);
-            client1.set_option(disable_nagle);
-            std::cout << "Received connection from client1\n";
+            auto make_preprocess = [&](auto & client0, auto & client1)
+            {
+                auto ret = (params.transform == parameter_set::Haar)
+                         ? async_make_preprocess_Haar<L>(client0, client1, work_executor, count, params.compressed, asio::use_future)
+                         : with_configuration(params, [&](auto config)
+                           {
+                               return async_make_preprocess_bior<L, decltype(config)::j, decltype(config)::n>(client0, client1, work_executor, count, params.compressed, asio::use_future);
+                           });
 
-            auto ret = (params.transform == parameter_set::Haar)
-                     ? async_make_preprocess_Haar<L>(client0, client1, work_executor, count, asio::use_future)
-                     : async_make_preprocess_bior<L,j,n>(client0, client1, work_executor, count, asio::use_future);;
+                auto before = std::chrono::high_resolution_clock::now();
+                io_context.run();
+                auto after = std::chrono::high_resolution_clock::now();
 
-            auto before = std::chrono::high_resolution_clock::now();
-            io_context.run();
-            auto after = std::chrono::high_resolution_clock::now();
+                std::chrono::duration<double, std::milli> elapsed = after - before;
+                auto [bytes0, bytes1] = ret.get();
 
-            std::chrono::duration<double, std::milli> elapsed = after - before;
-            auto [bytes0, bytes1] = ret.get();
+                std::cout << "Wrote " << bytes0 << " bytes to client0 and " << bytes1 << " bytes to client1 in " << elapsed.count() << " ms (count = " << count << ")\n";
+            };
 
-            std::cout << "Wrote " << bytes0 << " bytes to client0 and " << bytes1 << " bytes to client1 in " << elapsed.count() << " ms (count = " << count << ")\n";
+            if (shm_path.empty())
+            {
+                tcp::socket client0{io_context};
+                tcp::socket client1{io_context};
+                tcp::acceptor acceptor{io_context, tcp::endpoint(tcp::v4(), dealer_local_port)};
+                acceptor.accept(client0);
+                client0.set_option(disable_nagle);
+                std::cout << "Received connection from client0\n";
+                acceptor.accept(client1);
+                client1.set_option(disable_nagle);
+                std::cout << "Received connection from client1\n";
+                make_preprocess(client0, client1);
+            }
+            else
+            {
+                ring::ring_listener listener{shm_path};
+                ring::ring_stream client0{io_context.get_executor(), listener.accept(), 0};
+                std::cout << "Received connection from client0\n";
+                ring::ring_stream client1{io_context.get_executor(), listener.accept(), 0};
+                std::cout << "Received connection from client1\n";
+                make_preprocess(client0, client1);
+            }
         }
         else if (preprocess_client->count()>0)
         {
             asio::stream_file output_file{io_context};
-            tcp::resolver resolver{io_context};
-            tcp::socket dealer{io_context};
             output_file.open(outfile, asio::stream_file::write_only |
                                       asio::stream_file::create     |
                                       asio::stream_file::truncate);
-            auto dealer_endpoints = resolver.resolve(dealer_remote_address, dealer_remote_port);
-            asio::connect(dealer, dealer_endpoints);
-            std::cout << "Connected to dealer\n";
 
-            auto ret = (params.transform == parameter_set::Haar)
-                     ? async_read_preprocess_Haar<L>(dealer, output_file, work_executor, count, asio::use_future)
-                     : async_read_preprocess_bior<L,j,n>(dealer, output_file, work_executor, count, asio::use_future);;
+            auto read_preprocess = [&](auto & dealer)
+            {
+                const bool seeded = params.compressed && !client_party;
+                auto ret = (params.transform == parameter_set::Haar)
+                         ? async_read_preprocess_Haar<L>(dealer, output_file, work_executor, count, seeded, asio::use_future)
+                         : with_configuration(params, [&](auto config)
+                           {
+                               return async_read_preprocess_bior<L, decltype(config)::j, decltype(config)::n>(dealer, output_file, work_executor, count, seeded, asio::use_future);
+                           });
 
-            auto before = std::chrono::high_resolution_clock::now();
-            io_context.run();
-            auto after = std::chrono::high_resolution_clock::now();
+                auto before = std::chrono::high_resolution_clock::now();
+                io_context.run();
+                auto after = std::chrono::high_resolution_clock::now();
 
-            std::chrono::duration<double, std::milli> elapsed = after - before;
-            auto [bytes0, bytes1] = ret.get();
+                std::chrono::duration<double, std::milli> elapsed = after - before;
+                auto [bytes0, bytes1] = ret.get();
 
-            std::cout << "Read " << bytes0 << " bytes from dealer and wrote " << bytes1 << " bytes to " << outfile << " in " << elapsed.count() << " ms (count = " << count << ")\n";
+                std::cout << "Read " << bytes0 << " bytes from dealer and wrote " << bytes1 << " bytes to " << outfile << " in " << elapsed.count() << " ms (count = " << count << ")\n";
+            };
+
+            if (shm_path.empty())
+            {
+                if (dealer_remote_address.empty()) throw CLI::RequiredError("address");
+                tcp::resolver resolver{io_context};
+                tcp::socket dealer{io_context};
+                auto dealer_endpoints = resolver.resolve(dealer_remote_address, dealer_remote_port);
+                asio::connect(dealer, dealer_endpoints);
+                std::cout << "Connected to dealer\n";
+                read_preprocess(dealer);
+            }
+            else
+            {
+                ring::ring_stream dealer{io_context.get_executor(), ring::connect(shm_path), 1};
+                std::cout << "Connected to dealer\n";
+                read_preprocess(dealer);
+            }
         }
         else if (online_connecter->count()>0)
         {
-            tcp::resolver resolver{io_context};
-            asio::stream_file dealer{io_context};
-            tcp::socket peer{io_context};
-            dealer.open(infile, asio::stream_file::read_only);
-            auto peer_endpoints = resolver.resolve(peer_remote_address, peer_remote_port);
-
-            asio::connect(peer, peer_endpoints);
-            peer.set_option(disable_nagle);
-            std::cout << "Connected to peer\n";
-
-            auto ret = (params.transform == parameter_set::Haar)
-                     ? async_online_Haar<L>(dealer, peer, work_executor, 100, count, asio::use_future)
-                     : async_online_bior<L,j,n>(dealer, peer, work_executor, 1, 100, count, asio::use_future);
-
-            auto before = std::chrono::high_resolution_clock::now();
-            io_context.run();
-            auto after = std::chrono::high_resolution_clock::now();
+            auto run = [&](auto & peer)
+            {
+                auto [elapsed, file_read_bytes, peer_read_bytes, peer_write_bytes]
+                    = run_online_recorded(io_context, infile, peer, record_file, work_executor, params, lut_file, 1, count, batch, window);
 
-            std::chrono::duration<double, std::milli> elapsed = after - before;
-            auto [file_read_bytes, peer_read_bytes, peer_write_bytes] = ret.get();
+                std::cout << "Read " << file_read_bytes << " bytes from " << infile << " and " << peer_read_bytes << " bytes from peer, and wrote " << peer_write_bytes << " bytes from peer in " << elapsed.count() << " ms (count = " << count << ")\n";
+            };
 
-            std::cout << "Read " << file_read_bytes << " bytes from " << infile << " and " << peer_read_bytes << " bytes from peer, and wrote " << peer_write_bytes << " bytes from peer in " << elapsed.count() << " ms (count = " << count << ")\n";
+            if (shm_path.empty())
+            {
+                if (peer_remote_address.empty()) throw CLI::RequiredError("address");
+                tcp::resolver resolver{io_context};
+                tcp::socket peer{io_context};
+                auto peer_endpoints = resolver.resolve(peer_remote_address, peer_remote_port);
+
+                asio::connect(peer, peer_endpoints);
+                peer.set_option(disable_nagle);
+                std::cout << "Connected to peer\n";
+                run(peer);
+            }
+            else
+            {
+                ring::ring_stream peer{io_context.get_executor(), ring::connect(shm_path), 1};
+                std::cout << "Connected to peer\n";
+                run(peer);
+            }
         }
         else if (online_listener->count()>0)
         {
-            asio::stream_file dealer{io_context};
-            tcp::socket peer{io_context};
-            dealer.open(infile, asio::stream_file::read_only);
-            tcp::acceptor acceptor{io_context, tcp::endpoint(tcp::v4(), peer_local_port)};
-            acceptor.accept(peer);
-            peer.set_option(disable_nagle);
-            std::cout << "Received connection from peer\n";
-
-            auto ret = (params.transform == parameter_set::Haar)
-                     ? async_online_Haar<L>(dealer, peer, work_executor, 100, count, asio::use_future)
-                     : async_online_bior<L,j,n>(dealer, peer, work_executor, 0, 100, count, asio::use_future);
-
-            auto before = std::chrono::high_resolution_clock::now();
-            io_context.run();
-            auto after = std::chrono::high_resolution_clock::now();
-
-            std::chrono::duration<double, std::milli> elapsed = after - before;
-            auto [file_read_bytes, peer_read_bytes, peer_write_bytes] = ret.get();
+            auto run = [&](auto & peer)
+            {
+                auto [elapsed, file_read_bytes, peer_read_bytes, peer_write_bytes]
+                    = run_online_recorded(io_context, infile, peer, record_file, work_executor, params, lut_file, 0, count, batch, window);
 
-            std::cout << "Read " << file_read_bytes << " bytes from " << infile << " and " << peer_read_bytes << " bytes from peer, and wrote " << peer_write_bytes << " bytes from peer in " << elapsed.count() << " ms (count = " << count << ")\n";
+                std::cout << "Read " << file_read_bytes << " bytes from " << infile << " and " << peer_read_bytes << " bytes from peer, and wrote " << peer_write_bytes << " bytes from peer in " << elapsed.count() << " ms (count = " << count << ")\n";
+            };
 
+            if (shm_path.empty())
+            {
+                tcp::socket peer{io_context};
+                tcp::acceptor acceptor{io_context, tcp::endpoint(tcp::v4(), peer_local_port)};
+                acceptor.accept(peer);
+                peer.set_option(disable_nagle);
+                std::cout << "Received connection from peer\n";
+                run(peer);
+            }
+            else
+            {
+                ring::ring_listener listener{shm_path};
+                ring::ring_stream peer{io_context.get_executor(), listener.accept(), 0};
+                std::cout << "Received connection from peer\n";
+                run(peer);
+            }
         }
         else if (full_dealer->count()>0)
         {
@@ -830,8 +1394,11 @@ int main(int argc, char * argv[])
             std::cout << "Received connection from client1\n";
 
             auto ret = (params.transform == parameter_set::Haar)
-                     ? async_make_preprocess_Haar<L>(client0, client1, work_executor, count, asio::use_future)
-                     : async_make_preprocess_bior<L,j,n>(client0, client1, work_executor, count, asio::use_future);;
+                     ? async_make_preprocess_Haar<L>(client0, client1, work_executor, count, params.compressed, asio::use_future)
+                     : with_configuration(params, [&](auto config)
+                       {
+                           return async_make_preprocess_bior<L, decltype(config)::j, decltype(config)::n>(client0, client1, work_executor, count, params.compressed, asio::use_future);
+                       });
 
             auto before = std::chrono::high_resolution_clock::now();
             io_context.run();
@@ -857,16 +1424,8 @@ int main(int argc, char * argv[])
             peer.set_option(disable_nagle);
             std::cout << "Received connection from peer\n";
 
-            auto ret = (params.transform == parameter_set::Haar)
-                     ? async_online_Haar<L>(dealer, peer, work_executor, 100, count, asio::use_future)
-                     : async_online_bior<L,j,n>(dealer, peer, work_executor, 0, 100, count, asio::use_future);
-
-            auto before = std::chrono::high_resolution_clock::now();
-            io_context.run();
-            auto after = std::chrono::high_resolution_clock::now();
-
-            std::chrono::duration<double, std::milli> elapsed = after - before;
-            auto [dealer_read_bytes, peer_read_bytes, peer_write_bytes] = ret.get();
+            auto [elapsed, dealer_read_bytes, peer_read_bytes, peer_write_bytes]
+                = run_online(io_context, dealer, peer, work_executor, params, lut_file, 0, count, batch);
 
             std::cout << "Read " << dealer_read_bytes << " bytes from dealer and " << peer_read_bytes << " bytes from peer, and wrote " << peer_write_bytes << " bytes from peer in " << elapsed.count() << " ms (count = " << count << ")\n";
 
@@ -876,27 +1435,107 @@ int main(int argc, char * argv[])
             tcp::resolver resolver{io_context};
             tcp::socket dealer{io_context};
             tcp::socket peer{io_context};
-            auto dealer_endpoints = resolver.resolve(dealer_remote_address, dealer_remote_port);
-            asio::connect(dealer, dealer_endpoints);
-            dealer.set_option(disable_nagle);
-            std::cout << "Connected to dealer\n";
+            // the peer only listens once it has reached the dealer, so
+            // connecting to the peer first makes the dealer take it as
+            // client0 and this side as client1
             auto peer_endpoints = resolver.resolve(peer_remote_address, peer_remote_port);
             asio::connect(peer, peer_endpoints);
             peer.set_option(disable_nagle);
             std::cout << "Connected to peer\n";
+            auto dealer_endpoints = resolver.resolve(dealer_remote_address, dealer_remote_port);
+            asio::connect(dealer, dealer_endpoints);
+            dealer.set_option(disable_nagle);
+            std::cout << "Connected to dealer\n";
 
-            auto ret = (params.transform == parameter_set::Haar)
-                     ? async_online_Haar<L>(dealer, peer, work_executor, 100, count, asio::use_future)
-                     : async_online_bior<L,j,n>(dealer, peer, work_executor, 0, 100, count, asio::use_future);
+            auto [elapsed, dealer_read_bytes, peer_read_bytes, peer_write_bytes]
+                = run_online(io_context, dealer, peer, work_executor, params, lut_file, 1, count, batch);
 
-            auto before = std::chrono::high_resolution_clock::now();
-            io_context.run();
-            auto after = std::chrono::high_resolution_clock::now();
+            std::cout << "Read " << dealer_read_bytes << " bytes from dealer and " << peer_read_bytes << " bytes from peer, and wrote " << peer_write_bytes << " bytes from peer in " << elapsed.count() << " ms (count = " << count << ")\n";
+        }
+        else if (replay->count()>0)
+        {
+            // the transcript fixes the run's parameters
+            transcript::replay_stream peer{io_context.get_executor(), replay_file};
+            const auto & info = peer.info();
+            params.transform = parameter_set::transform_t(info.transform);
+            params.signal_bits = info.signal_bits;
+            params.level = info.level;
+            params.compressed = info.compressed;
+
+            auto [elapsed, file_read_bytes, peer_read_bytes, peer_write_bytes]
+                = run_online_file(io_context, infile, peer, work_executor, params, lut_file,
+                    info.party, info.count, info.batch, info.window);
+
+            std::cout << "Replayed party " << int(info.party) << ": read " << file_read_bytes << " bytes from " << infile << " and " << peer_read_bytes << " bytes from transcript, and wrote " << peer_write_bytes << " bytes in " << elapsed.count() << " ms (count = " << info.count << ")\n";
+            if (peer.mismatched_bytes() || !peer.complete())
+            {
+                std::cout << "Diverged from the transcript: " << peer.mismatched_bytes() << " bytes differ" << (peer.complete() ? "" : " and the runs differ in length") << "\n";
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (simulate->count()>0)
+        {
+            auto profile = (link_profile == "lan") ? netem::link_profile::lan()
+                         : (link_profile == "wan") ? netem::link_profile::wan()
+                         : netem::link_profile{};
+            if (!link_rate.empty()) profile.rate = netem::parse_rate(link_rate);
+            if (!link_delay.empty()) profile.delay = netem::parse_time(link_delay);
+            if (!link_jitter.empty()) profile.jitter = netem::parse_time(link_jitter);
+
+            // the dealer runs on `io_context` and each party on its own
+            asio::io_context party0_context(1), party1_context(1);
+            auto [dealer0, client0] = ring::make_local_pair(io_context.get_executor(), party0_context.get_executor());
+            auto [dealer1, client1] = ring::make_local_pair(io_context.get_executor(), party1_context.get_executor());
+            auto [peer0, peer1] = ring::make_local_pair(party0_context.get_executor(), party1_context.get_executor());
+            netem::emulated_stream<ring::ring_stream> dealer_link0{*dealer0, profile}, dealer_link1{*dealer1, profile},
+                client_link0{*client0, profile}, client_link1{*client1, profile},
+                peer_link0{*peer0, profile}, peer_link1{*peer1, profile};
 
-            std::chrono::duration<double, std::milli> elapsed = after - before;
-            auto [dealer_read_bytes, peer_read_bytes, peer_write_bytes] = ret.get();
+            auto ret = (params.transform == parameter_set::Haar)
+                     ? async_make_preprocess_Haar<L>(dealer_link0, dealer_link1, work_executor, count, params.compressed, asio::use_future)
+                     : with_configuration(params, [&](auto config)
+                       {
+                           return async_make_preprocess_bior<L, decltype(config)::j, decltype(config)::n>(dealer_link0, dealer_link1, work_executor, count, params.compressed, asio::use_future);
+                       });
+
+            // a role that fails closes its ends of the rings, so the other
+            // roles see `eof`/`broken_pipe` instead of waiting forever
+            auto dealer = std::async(std::launch::async, [&]()
+            {
+                try { io_context.run(); }
+                catch (...) { dealer0->close(); dealer1->close(); throw; }
+            });
+            auto party1 = std::async(std::launch::async, [&]()
+            {
+                try { return run_online(party1_context, client_link1, peer_link1, work_executor, params, lut_file, 1, count, batch, window); }
+                catch (...) { client1->close(); peer1->close(); throw; }
+            });
+            auto party0 = [&]()
+            {
+                try { return run_online(party0_context, client_link0, peer_link0, work_executor, params, lut_file, 0, count, batch, window); }
+                catch (...) { client0->close(); peer0->close(); throw; }
+            };
+            auto [elapsed, dealer_read_bytes, peer_read_bytes, peer_write_bytes] = party0();
+            auto [elapsed1, dealer_read_bytes1, peer_read_bytes1, peer_write_bytes1] = party1.get();
+            dealer.get();
+            auto [bytes0, bytes1] = ret.get();
 
-            std::cout << "Read " << dealer_read_bytes << " bytes from dealer and " << peer_read_bytes << " bytes from peer, and wrote " << peer_write_bytes << " bytes from peer in " << elapsed.count() << " ms (count = " << count << ")\n";
+            std::cout << "Dealer wrote " << bytes0 << " bytes to client0 and " << bytes1 << " bytes to client1\n";
+            std::cout << "Party 0 read " << dealer_read_bytes << " bytes from dealer and " << peer_read_bytes << " bytes from peer, and wrote " << peer_write_bytes << " bytes to peer in " << elapsed.count() << " ms (count = " << count << ")\n";
+            std::cout << "Party 1 read " << dealer_read_bytes1 << " bytes from dealer and " << peer_read_bytes1 << " bytes from peer, and wrote " << peer_write_bytes1 << " bytes to peer in " << elapsed1.count() << " ms (count = " << count << ")\n";
+        }
+
+        if (print_stats && !stats::empty())
+        {
+            std::ofstream file;
+            if (!stats_file.empty())
+            {
+                file.open(stats_file);
+                if (!file) throw std::system_error(errno, std::generic_category(), stats_file);
+            }
+            auto & os = stats_file.empty() ? std::cout : file;
+            if (stats_format == "json") stats::write_json(os);
+            else stats::write_csv(os);
         }
     }
     catch (const CLI::ParseError & e)
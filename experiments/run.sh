@@ -22,6 +22,7 @@ TC="ON"
 BITSIZE=28
 LUTSIZE=10
 PREP=true
+COUNT=100
 FILEDIR="results"
 
 # get optional command-line arguments
@@ -51,41 +52,28 @@ fi
 FILE=$FILEDIR/n_${BITSIZE}_J_${LUTSIZE}
 echo Running experiments with n=$BITSIZE and J=$LUTSIZE
 
-if $PREP ; then
-    rm params.hpp
-    echo "#ifndef PARAMS_HPP__
-    #define PARAMS_HPP__
-
-    static constexpr std::size_t L = 64;
-    static constexpr std::size_t n = $BITSIZE;
-    static constexpr std::size_t J = $LUTSIZE, j=n-J;
-    static constexpr auto twoj = (1ul << j);
-    static constexpr auto twoJ = (1ul << J);
-    int32_t bitlength = L;
-
-    static constexpr std::size_t num_threads = 1;
-
-    using input_type = dpf::modint<L>;
-    // using share_type = grotto::fixedpoint<fracbits, integral_type>;
-    using output_type = dpf::modint<L>;
-    std::size_t interval_bytes = twoJ * sizeof(output_type);
-
-    output_type * scaled_lut;
-    std::size_t count = 100;
+# every (n, J) in the sweep is instantiated in the one nillion binary and
+# selected at runtime (see WAVE_MIN_N etc. in nillion.cpp)
+LEVEL=$((BITSIZE - LUTSIZE))
+CONFIG="--signal-bits ${BITSIZE} --level ${LEVEL} --count ${COUNT}"
 
-    #endif   // PARAMS_HPP_" > params.hpp
-
-    rm -rf bin
-    mkdir bin
-    make
+if $PREP ; then
+    make nillion
 
     echo Haar Preprocessing
-    ./bin/dealer-Haar-file >> $FILE.log
+    ./nillion ${CONFIG} --Haar preprocess dealer --use-files --overwrite Haar.0 Haar.1 >> $FILE.log
 
     echo Bior Preproccesing
-    ./bin/dealer-bior-file >> $FILE.log
+    ./nillion ${CONFIG} --bior preprocess dealer --use-files --overwrite bior.0 bior.1 >> $FILE.log
 fi
 
+# nillion reports "... in <ms> ms (count = <count>)"; run_results.py reads
+# "<transform>_time_ms,<ms>" rows
+timing()
+{
+    echo "sed -E 's/^Read .* in ([0-9.e+]+) ms \\(count = [0-9]+\\)\$/${1}_time_ms,\\1/'"
+}
+
 echo Running bior
 # Docker documentation: https://docs.docker.com/reference/cli/docker/container/run/
 # run peer0 (the peer that will wait for others to connect) and set traffic control
@@ -94,10 +82,10 @@ docker container run --name "peer0" \
                      --rm \
                      --mount "type=bind,source=./${FILEDIR},destination=/${FILEDIR}" \
                      --mount 'type=bind,source=./lut.dat,destination=/lut.dat' \
-                     --mount 'type=bind,source=./bin,destination=/cbin' \
+                     --mount 'type=bind,source=./nillion,destination=/nillion' \
                      --mount 'type=bind,source=./bior.0,destination=/bior.0' \
                      dwt:experiments \
-                     /bin/bash -c "/cbin/client0-bior-online >> /${FILE}_bior_peer0.log 2>&1"
+                     /bin/bash -c "/nillion ${CONFIG} --lut-file /lut.dat --bior online /bior.0 listen 2>&1 | $(timing bior) >> /${FILE}_bior_peer0.log"
 
 # if traffic control not disabled, pass rate and delay
 if [[ -n "${TC}" ]] ; then
@@ -110,11 +98,11 @@ docker container run --name "peer1" \
                      --rm \
                      --mount "type=bind,source=./${FILEDIR},destination=/${FILEDIR}" \
                      --mount 'type=bind,source=./lut.dat,destination=/lut.dat' \
-                     --mount 'type=bind,source=./bin,destination=/cbin' \
+                     --mount 'type=bind,source=./nillion,destination=/nillion' \
                      --mount 'type=bind,source=./bior.1,destination=/bior.1' \
                      --network "container:peer0" \
                      dwt:experiments \
-                     /bin/bash -c "/cbin/client1-bior-online 2>&1 | tee -a /${FILE}_bior_peer1.log"
+                     /bin/bash -c "/nillion ${CONFIG} --lut-file /lut.dat --bior online /bior.1 connect 127.0.0.1 2>&1 | $(timing bior) | tee -a /${FILE}_bior_peer1.log"
 
 docker wait peer0
 
@@ -126,10 +114,10 @@ docker container run --name "peer0" \
                      --rm \
                      --mount "type=bind,source=./${FILEDIR},destination=/${FILEDIR}" \
                      --mount 'type=bind,source=./lut.dat,destination=/lut.dat' \
-                     --mount 'type=bind,source=./bin,destination=/cbin' \
+                     --mount 'type=bind,source=./nillion,destination=/nillion' \
                      --mount 'type=bind,source=./Haar.0,destination=/Haar.0' \
                      dwt:experiments \
-                     /bin/bash -c "/cbin/client0-Haar-online >> /${FILE}_haar_peer0.log 2>&1"
+                     /bin/bash -c "/nillion ${CONFIG} --lut-file /lut.dat --Haar online /Haar.0 listen 2>&1 | $(timing haar) >> /${FILE}_haar_peer0.log"
 
 # if traffic control not disabled, pass rate and delay
 if [[ -n "${TC}" ]] ; then
@@ -142,10 +130,10 @@ docker container run --name "peer1" \
                      --rm \
                      --mount "type=bind,source=./${FILEDIR},destination=/${FILEDIR}" \
                      --mount 'type=bind,source=./lut.dat,destination=/lut.dat' \
-                     --mount 'type=bind,source=./bin,destination=/cbin' \
+                     --mount 'type=bind,source=./nillion,destination=/nillion' \
                      --mount 'type=bind,source=./Haar.1,destination=/Haar.1' \
                      --network "container:peer0" \
                      dwt:experiments \
-                     /bin/bash -c "/cbin/client1-Haar-online 2>&1 | tee -a /${FILE}_haar_peer1.log"
+                     /bin/bash -c "/nillion ${CONFIG} --lut-file /lut.dat --Haar online /Haar.1 connect 127.0.0.1 2>&1 | $(timing haar) | tee -a /${FILE}_haar_peer1.log"
 
 docker wait peer0
\ No newline at end of file
@@ -0,0 +1,127 @@
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <utility>
+#include <vector>
+
+#define ASIO_HAS_IO_URING 1
+#include "dpf.hpp"
+#include "grotto.hpp"
+
+static constexpr std::size_t L = 64;
+int32_t bitlength = L;
+
+using input_type = dpf::modint<L>;
+using output_type = dpf::modint<L>;
+
+output_type * scaled_lut;
+
+#include "parities.hpp"
+
+/// Checks the packed parity kernels in `parities.hpp` against
+/// `grotto::segment_parities`.
+///
+/// For each `(n, J)` below, it draws fresh key pairs and wildcard inputs, so
+/// the segment offsets (including the part below a leaf) vary from trial to
+/// trial. For both keys of each pair it compares
+///   - `segment_parities_packed` with grotto's parities, packed,
+///   - `fused_masked_sum`, split into two ranges of words, with
+///     `lut_kernel::masked_sum` over grotto's parities, and
+///   - `fused_masked_sum_batch` over the pair with the same.
+/// Each leaf of these keys holds two outputs, so the tree is shallower than
+/// 64 levels, and the `n = 64` case covers the fallback to grotto. Exits
+/// with status 1 if anything differs.
+namespace test
+{
+
+using dpf_type = DEDUCE_DPF_TYPE_T(dpf::wildcard_value<dpf::modint<L>>{});
+
+static constexpr std::size_t trials = 8;
+
+/// a fresh key pair whose wildcard input has been assigned, as it would be
+/// after the online phase's reveal
+struct assigned_dpfs
+{
+    std::shared_ptr<dpf_type> key0, key1;
+    dpf::modint<L> shifted_input;  ///< what `offset_x.reconstruct` returned
+};
+
+inline assigned_dpfs make_assigned_dpfs()
+{
+    auto [dpf0, dpf1] = dpf::make_dpf(dpf::wildcard_value<dpf::modint<L>>(dpf::uniform_sample<dpf::modint<L>>()));
+    auto key0 = std::make_shared<dpf_type>(std::move(dpf0)), key1 = std::make_shared<dpf_type>(std::move(dpf1));
+    auto [x0, x1] = dpf::additively_share(dpf::uniform_sample<dpf::modint<L>>());
+    auto blinded0 = key0->offset_x.compute_and_get_share(x0);
+    auto blinded1 = key1->offset_x.compute_and_get_share(x1);
+    auto shifted_input = key0->offset_x.reconstruct(blinded1);
+    key1->offset_x.reconstruct(blinded0);
+    return {key0, key1, shifted_input};
+}
+
+inline bool operator==(const lut_kernel::masked_sums & a, const lut_kernel::masked_sums & b)
+{
+    return a.sum0 == b.sum0 && a.sum1 == b.sum1 && a.count == b.count;
+}
+
+template <std::size_t n, std::size_t J>
+bool check(const std::vector<std::uint64_t> & lut)
+{
+    using walker_type = parities::segment_parity_walker<n, J, dpf_type>;
+    static constexpr std::size_t segments = walker_type::segments, words = walker_type::words;
+    const auto * lut0 = lut.data(), * lut1 = lut.data() + 1;
+
+    std::size_t failures = 0;
+    auto fail = [&](std::size_t trial, const char * what)
+    {
+        std::cout << "n=" << n << " J=" << J << " trial " << trial << ": " << what << " differs from grotto\n";
+        ++failures;
+    };
+
+    for (std::size_t trial = 0; trial < trials; ++trial)
+    {
+        auto [key0, key1, shifted_input] = make_assigned_dpfs();
+        std::shared_ptr<dpf_type> keys[] = {key0, key1};
+        dpf::modint<L> shifted_inputs[] = {shifted_input, shifted_input};
+        auto x = shifted_input.reduced_value();
+        lut_kernel::masked_sums expected[2], batched[2];
+        for (std::size_t i = 0; i < 2; ++i)
+        {
+            auto bytes = grotto::segment_parities<n, J>(*keys[i]);
+            parities::packed_parities packed(words);
+            for (std::size_t k = 0; k < segments; ++k) packed[k / 64] |= std::uint64_t(bool(bytes[k])) << (k % 64);
+
+            if (parities::segment_parities_packed<n, J>(*keys[i], x) != packed) fail(trial, "segment_parities_packed");
+
+            expected[i] = lut_kernel::masked_sum(packed.data(), lut0, lut1, segments);
+            auto fused = parities::fused_masked_sum<n, J>(*keys[i], x, lut0, lut1, 0, words / 2);
+            fused += parities::fused_masked_sum<n, J>(*keys[i], x, lut0, lut1, words / 2, words);
+            if (!(fused == expected[i])) fail(trial, "fused_masked_sum");
+        }
+        parities::fused_masked_sum_batch<n, J>(keys, shifted_inputs, 2, lut0, lut1, batched);
+        if (!(batched[0] == expected[0] && batched[1] == expected[1])) fail(trial, "fused_masked_sum_batch");
+    }
+
+    std::cout << "n=" << n << " J=" << J << " (" << (walker_type::walkable ? "walked" : "from grotto") << "): "
+              << (failures ? "FAILED" : "ok") << "\n";
+    return !failures;
+}
+
+}  // namespace test
+
+int main()
+{
+    // large enough for the biggest J below, plus one for the second table
+    std::vector<std::uint64_t> lut((std::size_t(1) << 16) + 1);
+    std::mt19937_64 rng{1};
+    for (auto & entry : lut) entry = rng();
+
+    bool ok = true;
+    ok &= test::check<20, 3>(lut);   // fewer segments than one word
+    ok &= test::check<32, 10>(lut);
+    ok &= test::check<32, 16>(lut);
+    ok &= test::check<48, 13>(lut);
+    ok &= test::check<63, 12>(lut);
+    ok &= test::check<64, 10>(lut);  // deeper than the tree: from grotto
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,176 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define ASIO_HAS_IO_URING 1
+#include "dpf.hpp"
+#include "grotto.hpp"
+
+static constexpr std::size_t L = 64;
+int32_t bitlength = L;
+
+using input_type = dpf::modint<L>;
+using output_type = dpf::modint<L>;
+
+output_type * scaled_lut;
+
+#include "session.hpp"
+
+/// Runs `wave::session` end to end in one process.
+///
+/// Each run has an in-process dealer, which writes Haar preprocessing for
+/// both parties over socket pairs, and two sessions (parties 0 and 1)
+/// connected to each other by a third pair. Both parties evaluate the same
+/// inputs, secret-shared, in two batches of different sizes, so the second
+/// batch reuses the connections of the first. The inputs are evaluated once
+/// through the pipeline and once with `options::batch`; the outputs, once
+/// reconstructed, must agree. Exits with status 1 if they do not.
+namespace test
+{
+
+static constexpr std::size_t j = 22, n = 32;
+using session_type = wave::session<wave::transform::Haar, j, n,
+    asio::local::stream_protocol::socket, asio::local::stream_protocol::socket>;
+
+static constexpr std::size_t batch_sizes[] = {20, 17};
+
+/// a connected pair of file descriptors
+struct socket_pair
+{
+    socket_pair()
+    {
+        if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+        {
+            throw std::system_error(errno, std::generic_category(), "socketpair");
+        }
+    }
+
+    int fds[2];
+};
+
+/// a thread that is joined when it goes out of scope, so that the dealer
+/// outlives its sockets even if a session throws
+struct joining_thread : std::thread
+{
+    using std::thread::thread;
+    ~joining_thread() { if (joinable()) join(); }
+};
+
+inline asio::local::stream_protocol::socket adopt(asio::io_context & io_context, int fd)
+{
+    asio::local::stream_protocol::socket socket{io_context};
+    socket.assign(asio::local::stream_protocol{}, fd);
+    return socket;
+}
+
+/// writes a random LUT big enough for `session_type` to `path`
+inline void write_lut(const std::string & path)
+{
+    std::vector<output_type> lut(session_type::lut_bytes / sizeof(output_type));
+    std::mt19937_64 rng{1};
+    for (auto & entry : lut) entry = rng();
+    auto file = std::fopen(path.c_str(), "wb");
+    if (!file || std::fwrite(lut.data(), sizeof(output_type), lut.size(), file) != lut.size())
+    {
+        throw std::system_error(errno, std::generic_category(), path);
+    }
+    std::fclose(file);
+}
+
+/// evaluates the shared inputs in both parties' sessions and returns the
+/// reconstructed outputs
+std::vector<wave::share> run(const std::string & lut_file, const std::vector<wave::share> & inputs0,
+    const std::vector<wave::share> & inputs1, bool batch)
+{
+    socket_pair dealer0, dealer1, peer;
+
+    // the dealer writes everything up front; the sockets buffer what the
+    // sessions have not read yet
+    asio::io_context dealer_context{1};
+    asio::thread_pool dealer_workers{1};
+    auto to0 = adopt(dealer_context, dealer0.fds[0]), to1 = adopt(dealer_context, dealer1.fds[0]);
+    auto dealt = async_make_preprocess_Haar<L>(to0, to1, dealer_workers.get_executor(),
+        inputs0.size(), false, asio::use_future);
+    std::exception_ptr dealer_failure;
+    joining_thread dealer{[&]()
+    {
+        try { dealer_context.run(); }
+        catch (...) { dealer_failure = std::current_exception(); }
+    }};
+
+    wave::options opts;
+    opts.batch = batch;
+    opts.window = 4;
+    session_type party0{
+        [&](asio::io_context & io_context) { return adopt(io_context, dealer0.fds[1]); },
+        [&](asio::io_context & io_context) { return adopt(io_context, peer.fds[0]); },
+        lut_file, opts};
+    opts.party = 1;
+    session_type party1{
+        [&](asio::io_context & io_context) { return adopt(io_context, dealer1.fds[1]); },
+        [&](asio::io_context & io_context) { return adopt(io_context, peer.fds[1]); },
+        lut_file, opts};
+
+    std::vector<wave::share> outputs;
+    std::size_t first = 0;
+    for (auto size : batch_sizes)
+    {
+        auto outputs0 = party0.evaluate(inputs0.data() + first, size);
+        auto outputs1 = party1.evaluate(inputs1.data() + first, size);
+        auto shares0 = outputs0.get(), shares1 = outputs1.get();
+        for (std::size_t i = 0; i < size; ++i) outputs.push_back(shares0[i] + shares1[i]);
+        first += size;
+    }
+
+    dealer.join();
+    if (dealer_failure) std::rethrow_exception(dealer_failure);
+    dealt.get();
+    return outputs;
+}
+
+}  // namespace test
+
+int main()
+{
+    const std::string lut_file = "session-lut.dat";
+    try
+    {
+        test::write_lut(lut_file);
+
+        std::size_t count = 0;
+        for (auto size : test::batch_sizes) count += size;
+        std::vector<wave::share> inputs0, inputs1;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            auto [x0, x1] = dpf::additively_share(dpf::uniform_sample<wave::share>());
+            inputs0.push_back(x0);
+            inputs1.push_back(x1);
+        }
+
+        auto pipelined = test::run(lut_file, inputs0, inputs1, false);
+        auto batched = test::run(lut_file, inputs0, inputs1, true);
+        ::unlink(lut_file.c_str());
+
+        bool ok = pipelined.size() == count && pipelined == batched;
+        std::cout << "session (" << count << " evaluations in " << std::size(test::batch_sizes)
+                  << " batches): " << (ok ? "ok" : "FAILED") << "\n";
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    catch (const std::exception & e)
+    {
+        ::unlink(lut_file.c_str());
+        std::cout << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+}
@@ -124,6 +124,9 @@ def main():
         y_coeffs = y_coeffs * 2**(args.depth/2)
 
     lut_db = real_to_fixed(y_coeffs, args.precision)
+    if args.wave == "bior2.2":
+        # the two taps of segment i are entries i and i+1 of a single table
+        lut_db = np.roll(lut_db, -2)
     print(lut_db)
     unsigned_lut_db = lut_db % 2**args.bit_width
     lut_bytes = [x.to_bytes((args.bit_width+7)//8) for x in unsigned_lut_db]